@@ -17,6 +17,7 @@ Functions that will be automatically called by ELinks (if they're defined):
 
 follow_url_hook() -- Rewrite a URL for a link that's about to be followed.
 goto_url_hook() -- Rewrite a URL received from a "Go to URL" dialog box.
+pre_format_html_buffer_hook() -- Edit a document's body before it's formatted.
 pre_format_html_hook() -- Rewrite a document's body before it's formatted.
 proxy_for_hook() -- Determine what proxy server to use for a given URL.
 quit_hook() -- Clean up before ELinks exits.
@@ -24,6 +25,7 @@ quit_hook() -- Clean up before ELinks exits.
 """
 
 import elinks
+import re
 
 dumbprefixes = {
         "7th" : "http://7thguard.net/",
@@ -77,6 +79,26 @@ def follow_url_hook(url):
     if url.startswith(google_redirect):
         return url.replace(google_redirect, '')
 
+def pre_format_html_buffer_hook(url, buffer):
+    """Edit the body of a document in place before it's formatted.
+
+    This function is called before pre_format_html_hook() and gets a
+    read-only buffer over the body instead of a copy of it. It can search
+    the buffer, e.g. with the re module, and edit the body with
+    elinks.replace_document_range(). Its return value is ignored.
+
+    Arguments:
+
+    url -- The URL of the document.
+    buffer -- A buffer over the body of the document.
+
+    """
+    if "cygwin.com" in url:
+        match = re.search('<body bgcolor="#000000" color="#000000"', buffer)
+        if match:
+            elinks.replace_document_range(match.start(), match.end(),
+                '<body bgcolor="#ffffff" color="#000000"')
+
 def pre_format_html_hook(url, html):
     """Rewrite the body of a document before it's formatted.
 
@@ -90,10 +112,7 @@ def pre_format_html_hook(url, html):
     html -- The body of the document.
 
     """
-    if "cygwin.com" in url:
-        return html.replace('<body bgcolor="#000000" color="#000000"',
-                            '<body bgcolor="#ffffff" color="#000000"')
-    elif url.startswith("https://www.mbank.com.pl/ib_navibar_3.asp"):
+    if url.startswith("https://www.mbank.com.pl/ib_navibar_3.asp"):
         return html.replace('<td valign="top"><img',
                             '<tr><td valign="top"><img')
     elif url.startswith("http://lp3.polskieradio.pl/"):
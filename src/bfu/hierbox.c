@@ -29,6 +29,8 @@ update_hierbox_browser(struct hierbox_browser *browser)
 {
 	struct hierbox_dialog_list_item *item;
 
+	invalidate_listbox_index(&browser->index);
+
 	foreach (item, browser->dialogs) {
 		redraw_windows(REDRAW_WINDOW_AND_FRONT, item->dlg_data->win);
 	}
@@ -112,6 +114,8 @@ done_listbox_item(struct hierbox_browser *browser, struct listbox_item *item)
 		if (item->visible) update_hierbox_browser(browser);
 	}
 
+	/* The row index must never keep pointing at freed items. */
+	invalidate_listbox_index(&browser->index);
 	mem_free(item);
 }
 
@@ -202,6 +206,8 @@ hierbox_ev_kbd(struct dialog_data *dlg_data)
 
 	}
 
+	invalidate_listbox_index(&browser->index);
+
 	if (browser->expansion_callback)
 		browser->expansion_callback();
 
@@ -228,6 +234,7 @@ hierbox_ev_init(struct dialog_data *dlg_data)
 	foreach (litem, browser->root.child) {
 		litem->visible = 1;
 	}
+	invalidate_listbox_index(&browser->index);
 
 	/* Return this so that the generic dialog code will run and initialise
 	 * the widgets and stuff. */
@@ -245,6 +252,8 @@ hierbox_ev_abort(struct dialog_data *dlg_data)
 	if (!browser->do_not_save_state)
 		copy_struct(&browser->box_data, box);
 	del_from_list(box);
+	if (list_empty(browser->boxes))
+		done_listbox_index(&browser->index);
 
 	/* Delete the dialog list entry */
 	foreach (item, browser->dialogs) {
@@ -937,6 +946,7 @@ search_hierbox_browser(void *data, unsigned char *text)
 
 	traverse_listbox_items_list(box->items->next, box, 0, 0,
 				    scan_for_matches, context);
+	invalidate_listbox_index(box->index);
 
 	if (!context->item && *text) {
 		switch (get_opt_int("document.browse.search.show_not_found",
@@ -87,6 +87,11 @@ struct hierbox_browser {
 	 * their state restored. This member can be used to mark such
 	 * browsers. */
 	unsigned int do_not_save_state:1;
+
+	/** Row index of the visible items
+	 * Shared by all the open listboxes of this browser and released
+	 * when the last of them is closed. */
+	struct listbox_index index;
 };
 
 /** Define a hierbox browser
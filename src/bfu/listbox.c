@@ -69,6 +69,93 @@ dlg_format_listbox(struct dialog_data *dlg_data,
 }
 
 
+void
+invalidate_listbox_index(struct listbox_index *index)
+{
+	if (index) index->valid = 0;
+}
+
+void
+done_listbox_index(struct listbox_index *index)
+{
+	mem_free_if(index->rows);
+	memset(index, 0, sizeof(*index));
+}
+
+/* Append @item and, if it is an expanded folder, its visible offspring to
+ * the row table. Returns 0 if we ran out of memory. */
+static int
+add_listbox_index_rows(struct listbox_index *index, struct listbox_item *item)
+{
+	struct listbox_item *child;
+
+	if (index->size >= index->allocated) {
+		int allocated = index->allocated ? index->allocated * 2 : 256;
+		struct listbox_item **rows;
+
+		rows = mem_realloc(index->rows, allocated * sizeof(*rows));
+		if (!rows) return 0;
+
+		index->rows = rows;
+		index->allocated = allocated;
+	}
+
+	item->row = index->size;
+	index->rows[index->size++] = item;
+
+	if (!item->expanded) return 1;
+
+	foreach (child, item->child) {
+		if (child->visible
+		    && !add_listbox_index_rows(index, child))
+			return 0;
+	}
+
+	return 1;
+}
+
+/* Returns the row index of @box, rebuilding it if it was invalidated, or
+ * NULL if there is none. */
+static struct listbox_index *
+get_listbox_index(struct listbox_data *box)
+{
+	struct listbox_index *index = box->index;
+	struct listbox_item *item;
+
+	if (!index) return NULL;
+	if (index->valid) return index;
+
+	index->size = 0;
+	foreach (item, *box->items) {
+		if (item->visible
+		    && !add_listbox_index_rows(index, item))
+			return NULL;
+	}
+
+	index->valid = 1;
+	return index;
+}
+
+static inline int
+listbox_index_has_item(struct listbox_index *index, struct listbox_item *item)
+{
+	return index && index->valid && item
+		&& item->row >= 0 && item->row < index->size
+		&& index->rows[item->row] == item;
+}
+
+/* Returns the row which is @offset rows away from @row, clamped to the
+ * first and last rows. */
+static inline int
+listbox_index_move(struct listbox_index *index, int row, int offset)
+{
+	if (offset > 0)
+		return (offset >= index->size - row) ? index->size - 1
+						     : row + offset;
+
+	return (-offset >= row) ? 0 : row + offset;
+}
+
 /*
  *,item00->prev
  *|item00->root = NULL  ,item10->prev
@@ -129,6 +216,13 @@ traverse_listbox_items_list(struct listbox_item *item, struct listbox_data *box,
 
 	if (!item) return NULL;
 
+	/* Plain visible moves can be answered by the row index. */
+	if (!fn && follow_visible && offset
+	    && listbox_index_has_item(box->index, item))
+		return box->index->rows[listbox_index_move(box->index,
+							    item->row,
+							    offset)];
+
 	if (infinite)
 		offset = 1;
 
@@ -274,12 +368,31 @@ void
 listbox_sel_move(struct widget_data *widget_data, int dist)
 {
 	struct listbox_data *box = get_listbox_widget_data(widget_data);
+	struct listbox_index *index;
 
 	if (list_empty(*box->items)) return;
 
 	if (!box->top) box->top = box->items->next;
 	if (!box->sel) box->sel = box->top;
 
+	index = get_listbox_index(box);
+	if (listbox_index_has_item(index, box->top)
+	    && listbox_index_has_item(index, box->sel)) {
+		int row = listbox_index_move(index, box->sel->row, dist);
+
+		box->sel = index->rows[row];
+		box->sel_offset = row - box->top->row;
+
+		if (box->sel_offset < 0) {
+			box->sel_offset = 0;
+			box->top = box->sel;
+		} else if (box->sel_offset >= widget_data->box.height) {
+			box->sel_offset = int_max(widget_data->box.height - 1, 0);
+			box->top = index->rows[row - box->sel_offset];
+		}
+		return;
+	}
+
 	/* We want to have these visible if possible. */
 	if (box->top && !box->top->visible) {
 		box->top = traverse_listbox_items_list(box->top, box,
@@ -327,6 +440,10 @@ static int
 listbox_item_offset(struct listbox_data *box, struct listbox_item *item)
 {
 	struct listbox_context ctx;
+	struct listbox_index *index = get_listbox_index(box);
+
+	if (listbox_index_has_item(index, item))
+		return item->row;
 
 	memset(&ctx, 0, sizeof(ctx));
 	ctx.item = item;
@@ -502,6 +619,7 @@ display_listbox(struct dialog_data *dlg_data, struct widget_data *widget_data)
 	struct terminal *term = dlg_data->win->term;
 	struct listbox_data *box = get_listbox_widget_data(widget_data);
 	struct listbox_context data;
+	struct listbox_index *index;
 
 	listbox_sel_move(widget_data, 0);
 
@@ -514,6 +632,31 @@ display_listbox(struct dialog_data *dlg_data, struct widget_data *widget_data)
 	data.box = box;
 	data.dlg_data = dlg_data;
 
+	index = get_listbox_index(box);
+	if (listbox_index_has_item(index, box->top)) {
+		int last = int_min(box->top->row + widget_data->box.height,
+				   index->size);
+		int row;
+
+		/* Catch visibility changes nobody told us about before
+		 * drawing anything from the index. */
+		for (row = box->top->row; row < last; row++) {
+			if (!index->rows[row]->visible) {
+				invalidate_listbox_index(index);
+				break;
+			}
+		}
+
+		for (row = box->top->row; index->valid && row < last; row++) {
+			int offset = 1;
+
+			display_listbox_item(index->rows[row], &data, &offset);
+		}
+
+		if (index->valid) return EVENT_PROCESSED;
+		data.offset = 0;
+	}
+
 	traverse_listbox_items_list(box->top, box, widget_data->box.height,
 				    1, display_listbox_item, &data);
 
@@ -557,6 +700,8 @@ init_listbox(struct dialog_data *dlg_data, struct widget_data *widget_data)
 
 	box->ops = browser->ops;
 	box->items = &browser->root.child;
+	box->index = &browser->index;
+	invalidate_listbox_index(box->index);
 
 	add_to_list(browser->boxes, box);
 	return EVENT_PROCESSED;
@@ -607,8 +752,10 @@ mouse_listbox(struct dialog_data *dlg_data, struct widget_data *widget_data)
 			int xdepth = widget_data->box.x + box->sel->depth * 5;
 			int x = ev->info.mouse.x;
 
-			if (x >= xdepth && x <= xdepth + 2)
+			if (x >= xdepth && x <= xdepth + 2) {
 				box->sel->expanded = !box->sel->expanded;
+				invalidate_listbox_index(box->index);
+			}
 		}
 
 		display_widget(dlg_data, widget_data);
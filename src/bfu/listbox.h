@@ -106,6 +106,26 @@ struct listbox_data {
 
 	int sel_offset; /* Offset of selected item against the box top */
 	LIST_OF(struct listbox_item) *items; /* The list being displayed */
+
+	/* Row index shared by all boxes of the browser, see listbox_index */
+	struct listbox_index *index;
+};
+
+/* Flattened table of the rows a hierbox browser currently shows, that is
+ * all the visible items with visible and expanded ancestors, in display
+ * order. It lets scrolling, selection and drawing find an item's row (and
+ * the item at a given row) without walking the item tree from the top.
+ *
+ * The table is rebuilt lazily when a box needs it and the previous one has
+ * been invalidated. Anything adding, removing, moving, (un)expanding or
+ * hiding items has to call invalidate_listbox_index(); this is already done
+ * by update_hierbox_browser() and done_listbox_item(). */
+struct listbox_index {
+	struct listbox_item **rows;
+	int size;
+	int allocated;
+
+	unsigned int valid:1;
 };
 
 enum listbox_item_type {
@@ -129,6 +149,10 @@ struct listbox_item {
 	unsigned int marked:1;
 
 	void *udata;
+
+	/* The row of the item in the listbox_index, if it has one. Only
+	 * trust it after checking that index->rows[row] is the item. */
+	int row;
 };
 
 extern const struct widget_ops listbox_ops;
@@ -137,6 +161,9 @@ void dlg_format_listbox(struct dialog_data *, struct widget_data *, int, int *,
 
 struct listbox_item *traverse_listbox_items_list(struct listbox_item *, struct listbox_data *, int, int, int (*)(struct listbox_item *, void *, int *), void *);
 
+void invalidate_listbox_index(struct listbox_index *index);
+void done_listbox_index(struct listbox_index *index);
+
 void listbox_sel_move(struct widget_data *, int);
 void listbox_sel(struct widget_data *widget_data, struct listbox_item *item);
 struct listbox_data *get_listbox_widget_data(struct widget_data *widget_data);
@@ -5,15 +5,21 @@
 #endif
 
 #include <string.h>
+#ifdef CONFIG_GZIP
+#include <zlib.h>
+#endif
 
 #include "elinks.h"
 
 #include "bfu/dialog.h"
 #include "cache/cache.h"
 #include "cache/dialogs.h"
+#include "cache/disk.h"
 #include "config/options.h"
 #include "main/main.h"
 #include "main/object.h"
+#include "main/select.h"
+#include "main/timer.h"
 #include "network/connection.h"
 #include "protocol/protocol.h"
 #include "protocol/proxy.h"
@@ -100,6 +106,45 @@ get_cache_entry_loading_count(void)
 	return i;
 }
 
+int
+get_cache_entry_compressed_count(void)
+{
+	int i = 0;
+#ifdef CONFIG_GZIP
+	struct cache_entry *cached;
+
+	foreach (cached, cache_entries)
+		i += !!cached->compressed;
+#endif
+
+	return i;
+}
+
+/* The memory taken by the data of @cached, which is less than its
+ * @data_size if it is compressed. */
+static inline off_t
+get_cache_entry_memory_size(struct cache_entry *cached)
+{
+#ifdef CONFIG_GZIP
+	if (cached->compressed)
+		return cached->compressed_size;
+#endif
+	return cached->data_size;
+}
+
+#ifdef CONFIG_GZIP
+static void schedule_cache_compression(void);
+
+static inline void
+touch_cache_entry(struct cache_entry *cached)
+{
+	cached->access_time = time(NULL);
+	schedule_cache_compression();
+}
+#else
+#define touch_cache_entry(cached)
+#endif
+
 struct cache_entry *
 find_in_cache(struct uri *uri)
 {
@@ -116,6 +161,7 @@ find_in_cache(struct uri *uri)
 			continue;
 
 		move_to_top_of_list(cache_entries, cached);
+		touch_cache_entry(cached);
 
 		return cached;
 	}
@@ -132,7 +178,7 @@ get_cache_entry(struct uri *uri)
 
 	if (cached) return cached;
 
-	shrink_memory(0);
+	shrink_memory_when_idle();
 
 	cached = mem_calloc(1, sizeof(*cached));
 	if (!cached) return NULL;
@@ -159,6 +205,7 @@ get_cache_entry(struct uri *uri)
 	cached->box_item = add_listbox_leaf(&cache_browser, NULL, cached);
 
 	add_to_list(cache_entries, cached);
+	touch_cache_entry(cached);
 
 	return cached;
 }
@@ -173,10 +220,51 @@ cache_entry_has_expired(struct cache_entry *cached)
 	return timeval_cmp(&cached->max_age, &now) <= 0;
 }
 
+/* Returns the time since when @cached is stale or 0 if it is still fresh. */
+static time_t
+get_cache_entry_stale_time(struct cache_entry *cached)
+{
+	int interval = get_opt_int("document.cache.revalidation_interval", NULL);
+	time_t stale_time = 0;
+
+	if (cached->expire && cache_entry_has_expired(cached))
+		stale_time = timeval_to_seconds(&cached->max_age);
+
+	if (cached->cache_mode <= CACHE_MODE_CHECK_IF_MODIFIED
+	    && (cached->last_modified || cached->etag)
+	    && interval >= 0
+	    && cached->seconds + interval < time(NULL)
+	    && (!stale_time || cached->seconds + interval < stale_time))
+		stale_time = cached->seconds + interval;
+
+	return stale_time;
+}
+
+int
+cache_entry_is_stale(struct cache_entry *cached)
+{
+	return !!get_cache_entry_stale_time(cached);
+}
+
+/* Whether the stale @cached can still be used while it is revalidated. */
+static int
+may_use_stale_cache_entry(struct cache_entry *cached, time_t stale_time)
+{
+	int period = get_opt_int("document.cache.stale_while_revalidate", NULL);
+
+	if (period < 0) return 0;
+
+	if (period < cached->stale_while_revalidate)
+		period = cached->stale_while_revalidate;
+
+	return time(NULL) < stale_time + period;
+}
+
 struct cache_entry *
 get_validated_cache_entry(struct uri *uri, enum cache_mode cache_mode)
 {
 	struct cache_entry *cached;
+	time_t stale_time;
 
 	/* We have to check if something should be reloaded */
 	if (cache_mode > CACHE_MODE_NORMAL)
@@ -184,27 +272,29 @@ get_validated_cache_entry(struct uri *uri, enum cache_mode cache_mode)
 
 	/* We only consider complete entries */
 	cached = find_in_cache(uri);
+	if (!cached) cached = load_disk_cache_entry(uri, 1);
 	if (!cached || cached->incomplete)
 		return NULL;
 
 
 	/* A bit of a gray zone. Delete the entry if the it has the strictest
 	 * cache mode and we don't want the most aggressive mode or we have to
-	 * remove the redirect or the entry expired. Please enlighten me.
+	 * remove the redirect. Please enlighten me.
 	 * --jonas */
 	if ((cached->cache_mode == CACHE_MODE_NEVER && cache_mode != CACHE_MODE_ALWAYS)
-	    || (cached->redirect && !get_opt_bool("document.cache.cache_redirects", NULL))
-	    || (cached->expire && cache_entry_has_expired(cached))) {
+	    || (cached->redirect && !get_opt_bool("document.cache.cache_redirects", NULL))) {
 		if (!is_object_used(cached)) delete_cache_entry(cached);
 		return NULL;
 	}
 
-	if (cached->cache_mode <= CACHE_MODE_CHECK_IF_MODIFIED
-	    && cache_mode <= CACHE_MODE_CHECK_IF_MODIFIED
-	    && (cached->last_modified || cached->etag)
-	    && get_opt_int("document.cache.revalidation_interval", NULL) >= 0) {
-		if (cached->seconds + get_opt_int("document.cache.revalidation_interval", NULL) < time(NULL))
-			return NULL;
+	/* Stale entries have to be reloaded or revalidated, unless they may
+	 * be displayed while that happens in the background. */
+	stale_time = get_cache_entry_stale_time(cached);
+	if (stale_time && !may_use_stale_cache_entry(cached, stale_time)) {
+		if (cached->expire && cache_entry_has_expired(cached)
+		    && !is_object_used(cached))
+			delete_cache_entry(cached);
+		return NULL;
 	}
 
 	return cached;
@@ -269,6 +359,9 @@ enlarge_entry(struct cache_entry *cached, off_t size)
 
 #define CACHE_PAD(x) (((x) | 0x3fff) + 1)
 
+/* The most the last fragment grows by at once when data is appended. */
+#define CACHE_GROWTH_MAX (1024 * 1024)
+
 /* One byte is reserved for data in struct fragment. */
 #define FRAGSIZE(x) (sizeof(struct fragment) + (x) - 1)
 
@@ -370,6 +463,57 @@ remove_overlaps(struct cache_entry *cached, struct fragment *f, int *trunc)
 	}
 }
 
+/* Append the data to the last fragment if it ends right where the data
+ * starts. Nearly all the data comes in this way, from connections
+ * reading the document from the start to the end, so it is worth not
+ * walking the fragments and not making up a new fragment each time the
+ * padding of the last one runs out. Instead, the last fragment is grown
+ * geometrically so that reading a document made of many small chunks
+ * does not remap it too many times. Returns zero if the slow path has to
+ * be taken. */
+static int
+append_to_last_fragment(struct cache_entry *cached, off_t offset,
+			const unsigned char *data, ssize_t length)
+{
+	struct fragment *f;
+	off_t end_offset = offset + length;
+	off_t needed;
+
+	if (list_empty(cached->frag)) return 0;
+
+	f = cached->frag.prev;
+	if (f->offset + f->length != offset) return 0;
+
+	/* Appending short of the known length of the entry truncates it,
+	 * leave that to the slow path. */
+	if (cached->length > end_offset) return 0;
+
+	needed = end_offset - f->offset;
+	if (needed > f->real_length) {
+		struct fragment *nf;
+		off_t size = f->real_length;
+
+		size += size < CACHE_GROWTH_MAX ? size : CACHE_GROWTH_MAX;
+		if (size < needed) size = needed;
+		size = CACHE_PAD(size - 1);
+		if (size != (size_t) size) return 0;
+
+		nf = frag_realloc(f, size);
+		if (!nf) return 0;
+
+		nf->prev->next = nf;
+		nf->next->prev = nf;
+		f = nf;
+		f->real_length = size;
+	}
+
+	memcpy(f->data + f->length, data, length);
+	enlarge_entry(cached, length);
+	f->length = needed;
+
+	return 1;
+}
+
 /* Note that this function is maybe overcommented, but I'm certainly not
  * unhappy from that. */
 int
@@ -382,6 +526,8 @@ add_fragment(struct cache_entry *cached, off_t offset,
 
 	if (!length) return 0;
 
+	uncompress_cache_entry(cached);
+
 	end_offset = offset + length;
 	if (cached->length < end_offset)
 		cached->length = end_offset;
@@ -390,6 +536,11 @@ add_fragment(struct cache_entry *cached, off_t offset,
 	 * used in HTML renderer. */
 	cached->cache_id = id_counter++;
 
+	if (append_to_last_fragment(cached, offset, data, length)) {
+		dump_frags(cached, "add_fragment");
+		return 1;
+	}
+
 	/* Possibly insert the new data in the middle of existing fragment. */
 	foreach (f, cached->frag) {
 		int ret = 0;
@@ -482,6 +633,11 @@ get_cache_fragment(struct cache_entry *cached)
 	struct fragment *first_frag, *adj_frag, *frag, *new_frag;
 	int new_frag_len;
 
+	uncompress_cache_entry(cached);
+#ifdef CONFIG_GZIP
+	cached->access_time = time(NULL);
+#endif
+
 	if (list_empty(cached->frag))
 		return NULL;
 
@@ -550,6 +706,56 @@ get_cache_fragment(struct cache_entry *cached)
 	return new_frag;
 }
 
+int
+replace_cache_range(struct cache_entry *cached, off_t offset, off_t length,
+		    const unsigned char *data, ssize_t datalen)
+{
+	struct fragment *f = get_cache_fragment(cached);
+	off_t end_offset = offset + length;
+	off_t new_length;
+
+	if (!f) {
+		/* An empty entry can only get new data. */
+		if (cached->length || offset || length) return -1;
+		return add_fragment(cached, 0, data, datalen) < 0 ? -1 : 0;
+	}
+
+	if (f->length != cached->length
+	    || offset < 0 || length < 0 || datalen < 0
+	    || end_offset > f->length)
+		return -1;
+
+	new_length = f->length - length + datalen;
+	if (new_length > f->real_length) {
+		struct fragment *nf;
+		off_t size = CACHE_PAD(new_length - 1);
+
+		if (size != (size_t) size) return -1;
+
+		nf = frag_realloc(f, size);
+		if (!nf) return -1;
+
+		nf->prev->next = nf;
+		nf->next->prev = nf;
+		f = nf;
+		f->real_length = size;
+	}
+
+	if (length != datalen)
+		memmove(f->data + offset + datalen, f->data + end_offset,
+			f->length - end_offset);
+	memcpy(f->data + offset, data, datalen);
+
+	enlarge_entry(cached, datalen - length);
+	f->length = new_length;
+	cached->length = new_length;
+	cached->cache_id = id_counter++;
+
+	dump_frags(cached, "replace_cache_range");
+
+	return 0;
+}
+
 static void
 delete_fragment(struct cache_entry *cached, struct fragment *f)
 {
@@ -563,11 +769,32 @@ delete_fragment(struct cache_entry *cached, struct fragment *f)
 	}
 }
 
+/* Free the memory reserved for the fragment beyond its data. */
+static struct fragment *
+shrink_fragment(struct fragment *f)
+{
+	struct fragment *nf;
+
+	if (f->real_length == f->length)
+		return f;
+
+	nf = frag_realloc(f, f->length);
+	if (!nf) return f;
+
+	nf->next->prev = nf;
+	nf->prev->next = nf;
+	nf->real_length = nf->length;
+
+	return nf;
+}
+
 static void
 truncate_entry(struct cache_entry *cached, off_t offset, int final)
 {
 	struct fragment *f;
 
+	uncompress_cache_entry(cached);
+
 	if (cached->length > offset) {
 		cached->length = offset;
 		cached->incomplete = 1;
@@ -585,17 +812,8 @@ truncate_entry(struct cache_entry *cached, off_t offset, int final)
 			enlarge_entry(cached, -(f->length - size));
 			f->length = size;
 
-			if (final) {
-				struct fragment *nf;
-
-				nf = frag_realloc(f, f->length);
-				if (nf) {
-					nf->next->prev = nf;
-					nf->prev->next = nf;
-					f = nf;
-					f->real_length = f->length;
-				}
-			}
+			if (final)
+				f = shrink_fragment(f);
 
 			f = f->next;
 		}
@@ -612,6 +830,8 @@ free_entry_to(struct cache_entry *cached, off_t offset)
 {
 	struct fragment *f;
 
+	uncompress_cache_entry(cached);
+
 	foreach (f, cached->frag) {
 		if (f->offset + f->length <= offset) {
 			struct fragment *tmp = f;
@@ -634,6 +854,14 @@ free_entry_to(struct cache_entry *cached, off_t offset)
 void
 delete_entry_content(struct cache_entry *cached)
 {
+#ifdef CONFIG_GZIP
+	if (cached->compressed) {
+		cache_size += cached->data_size - cached->compressed_size;
+		mem_free(cached->compressed);
+		cached->compressed = NULL;
+		cached->compressed_size = 0;
+	}
+#endif
 	enlarge_entry(cached, -cached->data_size);
 
 	while (cached->frag.next != (void *) &cached->frag) {
@@ -650,6 +878,148 @@ delete_entry_content(struct cache_entry *cached)
 	mem_free_set(&cached->etag, NULL);
 }
 
+#ifdef CONFIG_GZIP
+/* Compressing only pays off if it saves at least this part of the data. */
+#define CACHE_COMPRESS_MIN_SAVING 8
+
+static timer_id_T compress_timer = TIMER_ID_UNDEF;
+
+/* Replaces the fragments of the complete @cached entry with their compressed
+ * copy. The cache_id is kept, the data stays the same after all. Entries
+ * which cannot be compressed or do not shrink enough are marked so that
+ * they are not tried again until their data changes. */
+static void
+compress_cache_entry(struct cache_entry *cached)
+{
+	struct fragment *frag = get_cache_fragment(cached);
+	unsigned char *data, *shrunk;
+	uLongf size;
+
+	if (!frag || !list_is_singleton(cached->frag)
+	    || frag->length != cached->data_size) {
+		cached->compress_tried = 1;
+		return;
+	}
+
+	size = compressBound(frag->length);
+	data = mem_alloc(size);
+	if (!data) return;
+
+	if (compress2(data, &size, frag->data, frag->length, Z_BEST_SPEED) != Z_OK
+	    || size > frag->length - frag->length / CACHE_COMPRESS_MIN_SAVING) {
+		cached->compress_tried = 1;
+		mem_free(data);
+		return;
+	}
+
+	shrunk = mem_realloc(data, size);
+	if (shrunk) data = shrunk;
+
+	cached->compressed = data;
+	cached->compressed_size = size;
+	cache_size -= cached->data_size - size;
+
+	del_from_list(frag);
+	frag_free(frag);
+}
+
+void
+uncompress_cache_entry(struct cache_entry *cached)
+{
+	struct fragment *frag;
+	uLongf size = cached->data_size;
+
+	if (!cached->compressed) return;
+
+	frag = frag_alloc(size);
+	if (!frag) {
+		/* Without the data the entry has to be loaded again. */
+		delete_entry_content(cached);
+		return;
+	}
+
+	frag->real_length = cached->data_size;
+
+	if (uncompress(frag->data, &size, cached->compressed,
+		       cached->compressed_size) != Z_OK
+	    || size != cached->data_size) {
+		INTERNAL("compressed cache entry is corrupted");
+		frag_free(frag);
+		delete_entry_content(cached);
+		return;
+	}
+
+	frag->length = size;
+	add_to_list(cached->frag, frag);
+
+	cache_size += cached->data_size - cached->compressed_size;
+	mem_free(cached->compressed);
+	cached->compressed = NULL;
+	cached->compressed_size = 0;
+
+	schedule_cache_compression();
+}
+
+/* Compresses the complete entries nobody has looked at for
+ * document.cache.memory.compress_delay seconds, the oldest first. Entries
+ * locked by formatted documents are compressed as well since the documents
+ * only need the source when they are formatted again, which goes through
+ * get_cache_fragment(). Lazily formatted documents need it for every line
+ * they display, so they keep it uncompressed, see @data_users. */
+static int
+compress_idle_cache_entries(void *data)
+{
+	int delay = get_opt_int("document.cache.memory.compress_delay", NULL);
+	time_t now = time(NULL);
+	struct cache_entry *cached;
+	int pending = 0;
+
+	if (delay <= 0) return 0;
+
+	foreachback (cached, cache_entries) {
+		if (cached->compressed || cached->compress_tried
+		    || cached->incomplete || !cached->valid)
+			continue;
+
+		if (is_entry_used(cached) || cached->data_users
+		    || cached->access_time + delay > now) {
+			pending = 1;
+			continue;
+		}
+
+		compress_cache_entry(cached);
+
+		if (idle_work_should_yield())
+			return 1;
+	}
+
+	if (pending) schedule_cache_compression();
+
+	return 0;
+}
+
+static void
+compress_cache_entries_later(void *data)
+{
+	compress_timer = TIMER_ID_UNDEF;
+	register_idle_work(compress_idle_cache_entries, NULL);
+}
+
+static void
+schedule_cache_compression(void)
+{
+	int delay;
+
+	if (compress_timer != TIMER_ID_UNDEF) return;
+
+	delay = get_opt_int("document.cache.memory.compress_delay", NULL);
+	if (delay <= 0) return;
+
+	install_timer(&compress_timer, (milliseconds_T) delay * 1000,
+		      compress_cache_entries_later, NULL);
+}
+#endif
+
 static void
 done_cache_entry(struct cache_entry *cached)
 {
@@ -693,9 +1063,19 @@ normalize_cache_entry(struct cache_entry *cached, off_t truncate_length)
 		return;
 
 	truncate_entry(cached, truncate_length, 1);
+
+	/* Appending may have grown the last fragment well ahead of the
+	 * data. */
+	if (!list_empty(cached->frag))
+		shrink_fragment(cached->frag.prev);
+
 	cached->incomplete = 0;
 	cached->preformatted = 0;
 	cached->seconds = time(NULL);
+#ifdef CONFIG_GZIP
+	cached->access_time = cached->seconds;
+	cached->compress_tried = 0;
+#endif
 }
 
 
@@ -801,6 +1181,14 @@ garbage_collection(int whole)
 	      whole, opt_cache_size,gc_cache_size);
 #endif
 
+#ifdef CONFIG_GZIP
+	/* Compressing resumes with the next lookup in the cache. */
+	if (whole) {
+		kill_timer(&compress_timer);
+		unregister_idle_work(compress_idle_cache_entries, NULL);
+	}
+#endif
+
 	if (!whole && cache_size <= opt_cache_size) return;
 
 
@@ -810,16 +1198,16 @@ garbage_collection(int whole)
 	 * that @cache_size is in sync. */
 
 	foreach (cached, cache_entries) {
-		old_cache_size += cached->data_size;
+		old_cache_size += get_cache_entry_memory_size(cached);
 
 		if (!is_object_used(cached) && !is_entry_used(cached))
 			continue;
 
-		assertm(new_cache_size >= cached->data_size,
+		assertm(new_cache_size >= get_cache_entry_memory_size(cached),
 			"cache_size (%ld) underflow: subtracting %ld from %ld",
-			cache_size, cached->data_size, new_cache_size);
+			cache_size, get_cache_entry_memory_size(cached), new_cache_size);
 
-		new_cache_size -= cached->data_size;
+		new_cache_size -= get_cache_entry_memory_size(cached);
 
 		if_assert_failed { new_cache_size = 0; }
 	}
@@ -854,13 +1242,13 @@ garbage_collection(int whole)
 		 * but that will probably complicate things too much. We'd have
 		 * to sort entries so prioritize removing the oldest entries. */
 
-		assertm(new_cache_size >= cached->data_size,
+		assertm(new_cache_size >= get_cache_entry_memory_size(cached),
 			"cache_size (%ld) underflow: subtracting %ld from %ld",
-			cache_size, cached->data_size, new_cache_size);
+			cache_size, get_cache_entry_memory_size(cached), new_cache_size);
 
 		/* Mark me for destruction, sir. */
 		cached->gc_target = 1;
-		new_cache_size -= cached->data_size;
+		new_cache_size -= get_cache_entry_memory_size(cached);
 
 		if_assert_failed { new_cache_size = 0; }
 	}
@@ -896,7 +1284,7 @@ shrinked_enough:
 		 * situation. */
 
 		for (entry = cached; (void *) entry != &cache_entries; entry = entry->next) {
-			unsigned longlong newer_cache_size = new_cache_size + entry->data_size;
+			unsigned longlong newer_cache_size = new_cache_size + get_cache_entry_memory_size(entry);
 
 			if (newer_cache_size > gc_cache_size)
 				continue;
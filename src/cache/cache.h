@@ -49,12 +49,25 @@ struct cache_entry {
 	off_t length;			/* The expected and complete size */
 	off_t data_size;		/* The actual size of all fragments */
 
+	/* The number of documents reading the data in place while they are
+	 * displayed. The data is not compressed while there are any. */
+	int data_users;
+
+#ifdef CONFIG_GZIP
+	/* The fragments of an idle entry may be replaced by their compressed
+	 * copy. @data_size stays the uncompressed size. */
+	unsigned char *compressed;	/* Compressed data or NULL */
+	off_t compressed_size;		/* The size of @compressed */
+	time_t access_time;		/* When the entry was last looked up */
+#endif
+
 	struct listbox_item *box_item;	/* Dialog data for cache manager */
 #ifdef CONFIG_SCRIPTING_SPIDERMONKEY
 	struct JSObject *jsobject;      /* Instance of cache_entry_class */
 #endif
 
 	timeval_T max_age;		/* Expiration time */
+	long stale_while_revalidate;	/* Seconds it may be used after that */
 
 	unsigned int expire:1;		/* Whether to honour max_age */
 	unsigned int preformatted:1;	/* Has content been preformatted? */
@@ -67,6 +80,9 @@ struct cache_entry {
 	 * an entry with this set to 1 in wild nature ;-). */
 	unsigned int gc_target:1;	/* The GC touch of death */
 	unsigned int cgi:1;		/* Is a CGI output? */
+#ifdef CONFIG_GZIP
+	unsigned int compress_tried:1;	/* Compressing did not pay off */
+#endif
 
 	enum cache_mode cache_mode;	/* Reload condition */
 };
@@ -93,6 +109,11 @@ struct cache_entry *get_cache_entry(struct uri *uri);
  * usable. Returns NULL if the @cache_mode suggests to reload it again. */
 struct cache_entry *get_validated_cache_entry(struct uri *uri, enum cache_mode cache_mode);
 
+/* Checks if the entry has expired or has not been revalidated for too long.
+ * get_validated_cache_entry() only returns such entries when they may be
+ * used while they are revalidated in the background. */
+int cache_entry_is_stale(struct cache_entry *cached);
+
 /* Checks if a dangling cache entry pointer is still valid. */
 int cache_entry_is_valid(struct cache_entry *cached);
 
@@ -117,6 +138,24 @@ int add_fragment(struct cache_entry *cached, off_t offset,
  * validation of the fragments fails. */
 struct fragment *get_cache_fragment(struct cache_entry *cached);
 
+/* Replaces the @length bytes at @offset of the data of @cached with the
+ * @datalen bytes from @data, moving the rest of the data as needed. The
+ * data is edited in place so scripts can patch big documents without
+ * copying them. All of the data must already be in the cache entry.
+ * Returns 0 on success and -1 on error. */
+int replace_cache_range(struct cache_entry *cached, off_t offset,
+			off_t length, const unsigned char *data,
+			ssize_t datalen);
+
+/* Puts the fragments of @cached back if they were compressed while the entry
+ * was idle. Code looking at the fragments directly instead of through
+ * find_in_cache() or get_cache_fragment() should call this first. */
+#ifdef CONFIG_GZIP
+void uncompress_cache_entry(struct cache_entry *cached);
+#else
+#define uncompress_cache_entry(cached)
+#endif
+
 /* Should be called when creation of a new cache has been completed. Most
  * importantly, it will updates cached->incomplete. */
 void normalize_cache_entry(struct cache_entry *cached, off_t length);
@@ -148,5 +187,6 @@ unsigned longlong get_cache_size(void);
 int get_cache_entry_count(void);
 int get_cache_entry_used_count(void);
 int get_cache_entry_loading_count(void);
+int get_cache_entry_compressed_count(void);
 
 #endif
@@ -86,6 +86,13 @@ get_cache_entry_info(struct listbox_item *item, struct terminal *term)
 			     (off_print_T) cached->length);
 	add_format_to_string(&msg, "\n%s: %" OFF_PRINT_FORMAT, _("Loaded size", term),
 			     (off_print_T) cached->data_size);
+#ifdef CONFIG_GZIP
+	if (cached->compressed) {
+		add_format_to_string(&msg, "\n%s: %" OFF_PRINT_FORMAT,
+				     _("Compressed size", term),
+				     (off_print_T) cached->compressed_size);
+	}
+#endif
 	if (cached->content_type) {
 		add_format_to_string(&msg, "\n%s: %s", _("Content type", term),
 				     cached->content_type);
@@ -0,0 +1,766 @@
+/* Disk cache */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h> /* OS/2 needs this after sys/types.h */
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "elinks.h"
+
+#include "cache/cache.h"
+#include "cache/disk.h"
+#include "config/home.h"
+#include "config/options.h"
+#include "intl/gettext/libintl.h"
+#include "main/event.h"
+#include "main/module.h"
+#include "protocol/header.h"
+#include "protocol/protocol.h"
+#include "protocol/proxy.h"
+#include "protocol/uri.h"
+#include "util/conv.h"
+#include "util/file.h"
+#include "util/hash.h"
+#include "util/lists.h"
+#include "util/md5.h"
+#include "util/memory.h"
+#include "util/string.h"
+#include "util/time.h"
+
+#define DISK_CACHE_DIRNAME	"cache/"
+#define DISK_CACHE_INDEX	"index"
+
+/* Files that are not in the index are deleted when they have not been
+ * touched for this many seconds. Younger ones may belong to another
+ * instance which has not saved its index yet. */
+#define DISK_CACHE_ORPHAN_AGE	(60 * 60)
+
+/* One document saved in the disk cache. Its file holds the protocol header
+ * followed by the document body, so the body starts at @head_length. */
+struct disk_cache_item {
+	LIST_HEAD(struct disk_cache_item);
+
+	unsigned char *uri;		/* The URI_BASE string of the document */
+	unsigned char name[MD5_HEX_DIGEST_LENGTH + 1]; /* File name */
+
+	off_t head_length;
+	off_t length;
+
+	time_t seconds;			/* When the document was last validated */
+	time_t max_age;			/* Expiration time or 0 if not expiring */
+	unsigned char *etag;
+	unsigned char *last_modified;
+
+	/* The id of the memory cache entry last saved or loaded, so that
+	 * revalidating it does not rewrite an unchanged body. */
+	unsigned int cache_id;
+};
+
+enum disk_cache_options {
+	DISK_CACHE_TREE,
+
+	DISK_CACHE_ENABLE,
+	DISK_CACHE_SIZE,
+
+	DISK_CACHE_OPTIONS,
+};
+
+static union option_info disk_cache_options[] = {
+	INIT_OPT_TREE("document.cache", N_("Disk cache"),
+		"disk", 0,
+		N_("Disk cache options. Documents received over HTTP are "
+		"kept in the cache/ directory of the ELinks home directory "
+		"and are reused by later sessions. Documents which have not "
+		"expired yet are used without asking the server, the others "
+		"are revalidated with conditional requests. Expiration times "
+		"sent by servers are only known when Cache-Control headers "
+		"are not ignored, otherwise the revalidation interval "
+		"decides.")),
+
+	INIT_OPT_BOOL("document.cache.disk", N_("Enable"),
+		"enable", 0, 0,
+		N_("Whether to keep documents in the disk cache.")),
+
+	INIT_OPT_LONG("document.cache.disk", N_("Size"),
+		"size", 0, 0, LONG_MAX, 20 * 1024 * 1024,
+		N_("Disk cache size (in bytes). Documents larger than "
+		"a quarter of this size are not saved.")),
+
+	NULL_OPTION_INFO,
+};
+
+#define get_opt_disk_cache(which)	disk_cache_options[(which)].option.value
+#define get_disk_cache_enable()		get_opt_disk_cache(DISK_CACHE_ENABLE).number
+#define get_disk_cache_size()		get_opt_disk_cache(DISK_CACHE_SIZE).big_number
+
+/* Most recently used items are at the top. */
+static INIT_LIST_OF(struct disk_cache_item, disk_cache_items);
+static struct hash *disk_cache_hash = NULL;
+static off_t disk_cache_size = 0;
+static int disk_cache_dirty = 0;
+static unsigned char *disk_cache_dir = NULL;
+
+
+static int
+disk_cache_is_enabled(void)
+{
+	return get_disk_cache_enable() && disk_cache_dir && disk_cache_hash;
+}
+
+static unsigned char *
+get_disk_cache_filename(unsigned char *name)
+{
+	return straconcat(disk_cache_dir, name, (unsigned char *) NULL);
+}
+
+static struct disk_cache_item *
+find_disk_cache_item(unsigned char *uri)
+{
+	struct hash_item *item = get_hash_item(disk_cache_hash, uri, strlen(uri));
+
+	return item ? item->value : NULL;
+}
+
+static void
+done_disk_cache_item(struct disk_cache_item *item)
+{
+	mem_free(item->uri);
+	mem_free_if(item->etag);
+	mem_free_if(item->last_modified);
+	mem_free(item);
+}
+
+static void
+delete_disk_cache_item(struct disk_cache_item *item, int unlink_file)
+{
+	struct hash_item *hash_item;
+
+	hash_item = get_hash_item(disk_cache_hash, item->uri, strlen(item->uri));
+	if (hash_item) del_hash_item(disk_cache_hash, hash_item);
+
+	if (unlink_file) {
+		unsigned char *filename = get_disk_cache_filename(item->name);
+
+		if (filename) {
+			unlink(filename);
+			mem_free(filename);
+		}
+	}
+
+	disk_cache_size -= item->head_length + item->length;
+	disk_cache_dirty = 1;
+
+	del_from_list(item);
+	done_disk_cache_item(item);
+}
+
+static struct disk_cache_item *
+add_disk_cache_item(unsigned char *uri)
+{
+	struct disk_cache_item *item = mem_calloc(1, sizeof(*item));
+	md5_digest_bin_T digest;
+	int i;
+
+	if (!item) return NULL;
+
+	item->uri = stracpy(uri);
+	if (!item->uri) {
+		mem_free(item);
+		return NULL;
+	}
+
+	MD5((const unsigned char *) uri, strlen(uri), digest);
+	for (i = 0; i < MD5_DIGEST_LENGTH; i++) {
+		item->name[i * 2] = hx(digest[i] >> 4);
+		item->name[i * 2 + 1] = hx(digest[i] & 15);
+	}
+
+	if (!add_hash_item(disk_cache_hash, item->uri, strlen(item->uri), item)) {
+		done_disk_cache_item(item);
+		return NULL;
+	}
+
+	add_to_list(disk_cache_items, item);
+
+	return item;
+}
+
+/* Evicts the least recently used documents until @needed more bytes fit. */
+static void
+shrink_disk_cache(off_t needed)
+{
+	while (!list_empty(disk_cache_items)
+	       && disk_cache_size + needed > get_disk_cache_size())
+		delete_disk_cache_item(disk_cache_items.prev, 1);
+}
+
+/* Opens a temporary file in the cache directory. It is renamed to its final
+ * name by close_disk_cache_file(), so other ELinks instances never see it
+ * half written. Because of that the cache, unlike the other files in the
+ * home directory, is written even with -no-connect. */
+static FILE *
+open_disk_cache_file(unsigned char **tmp_name)
+{
+	FILE *fp;
+	int fd;
+
+	*tmp_name = get_disk_cache_filename("tmp.XXXXXX");
+	if (!*tmp_name) return NULL;
+
+	fd = safe_mkstemp(*tmp_name);
+	if (fd >= 0) {
+		fp = fdopen(fd, "wb");
+		if (fp) return fp;
+
+		close(fd);
+		unlink(*tmp_name);
+	}
+
+	mem_free_set(tmp_name, NULL);
+	return NULL;
+}
+
+/* Closes @fp and renames the temporary file to @name unless writing it
+ * failed. Returns 0 on success. */
+static int
+close_disk_cache_file(FILE *fp, unsigned char *tmp_name, unsigned char *name)
+{
+	unsigned char *filename = get_disk_cache_filename(name);
+	int ret = ferror(fp);
+
+	if (fclose(fp) || !filename || rename(tmp_name, filename) < 0)
+		ret = -1;
+
+	if (ret) unlink(tmp_name);
+	mem_free_if(filename);
+	mem_free(tmp_name);
+
+	return ret;
+}
+
+/* Reads the next line of @f into @line, which grows to fit URIs of any
+ * length. Returns 0 at the end of the file or when out of memory. */
+static int
+read_disk_cache_index_line(struct string *line, FILE *f)
+{
+	unsigned char buffer[MAX_STR_LEN];
+
+	line->length = 0;
+	line->source[0] = '\0';
+
+	while (fgets(buffer, sizeof(buffer), f)) {
+		if (!add_to_string(line, buffer))
+			return 0;
+
+		if (line->source[line->length - 1] == '\n')
+			return 1;
+	}
+
+	return line->length > 0;
+}
+
+/* The index is a text file with one line per document:
+ * name, head length, length, validation time, expiration time, ETag,
+ * Last-Modified and the URI, separated by tabs. Empty validators are
+ * saved as "-". */
+static void
+read_disk_cache_index(void)
+{
+	struct string line;
+	unsigned char *filename = get_disk_cache_filename(DISK_CACHE_INDEX);
+	FILE *f;
+
+	if (!filename) return;
+
+	f = fopen(filename, "rb");
+	mem_free(filename);
+	if (!f) return;
+
+	if (!init_string(&line)) {
+		fclose(f);
+		return;
+	}
+
+	while (read_disk_cache_index_line(&line, f)) {
+		unsigned char *fields[8];
+		unsigned char *pos = line.source;
+		struct disk_cache_item *item;
+		struct stat st;
+		int i;
+
+		for (i = 0; i < 8; i++) {
+			fields[i] = pos;
+			pos += strcspn(pos, "\t\n");
+			if (*pos != '\t') break;
+			*pos++ = '\0';
+		}
+		if (i != 7 || *pos != '\n') continue;
+		*pos = '\0'; /* Drop ending '\n'. */
+
+		if (strlen(fields[0]) != MD5_HEX_DIGEST_LENGTH
+		    || find_disk_cache_item(fields[7]))
+			continue;
+
+		filename = get_disk_cache_filename(fields[0]);
+		if (!filename) break;
+		i = stat(filename, &st);
+		mem_free(filename);
+		if (i < 0) continue;
+
+		item = add_disk_cache_item(fields[7]);
+		if (!item) break;
+
+		/* Lines are written most recently used first. */
+		del_from_list(item);
+		add_to_list_end(disk_cache_items, item);
+
+		item->head_length = atol(fields[1]);
+		item->length = atol(fields[2]);
+		item->seconds = str_to_time_t(fields[3]);
+		item->max_age = str_to_time_t(fields[4]);
+		if (strcmp(fields[5], "-"))
+			item->etag = stracpy(fields[5]);
+		if (strcmp(fields[6], "-"))
+			item->last_modified = stracpy(fields[6]);
+
+		disk_cache_size += item->head_length + item->length;
+
+		if (strcmp(item->name, fields[0])
+		    || st.st_size != item->head_length + item->length)
+			delete_disk_cache_item(item, 0);
+	}
+
+	done_string(&line);
+	fclose(f);
+}
+
+/* Whether @name is the name of a document or temporary file. */
+static int
+is_disk_cache_filename(unsigned char *name)
+{
+	int i;
+
+	if (!strncmp(name, "tmp.", 4))
+		return 1;
+
+	for (i = 0; i < MD5_HEX_DIGEST_LENGTH; i++)
+		if (!isxdigit(name[i]))
+			return 0;
+
+	return !name[i];
+}
+
+/* Deletes the old files which the index does not know about, such as
+ * documents whose index line was lost when ELinks was killed and
+ * temporary files left behind. Nothing would ever evict them. */
+static void
+sweep_disk_cache_dir(void)
+{
+	struct hash *names = init_hash8();
+	struct disk_cache_item *item;
+	struct dirent *entry;
+	time_t now = time(NULL);
+	DIR *dir;
+
+	if (!names) return;
+
+	foreach (item, disk_cache_items)
+		if (!add_hash_item(names, item->name, MD5_HEX_DIGEST_LENGTH,
+				   item))
+			goto free_names;
+
+	dir = opendir(disk_cache_dir);
+	if (!dir) goto free_names;
+
+	while ((entry = readdir(dir))) {
+		unsigned char *filename;
+		struct stat st;
+
+		if (!is_disk_cache_filename(entry->d_name)
+		    || get_hash_item(names, entry->d_name,
+				     strlen(entry->d_name)))
+			continue;
+
+		filename = get_disk_cache_filename(entry->d_name);
+		if (!filename) break;
+
+		if (!stat(filename, &st) && S_ISREG(st.st_mode)
+		    && st.st_mtime + DISK_CACHE_ORPHAN_AGE < now)
+			unlink(filename);
+		mem_free(filename);
+	}
+
+	closedir(dir);
+
+free_names:
+	free_hash(&names);
+}
+
+static void
+write_disk_cache_index(void)
+{
+	struct disk_cache_item *item;
+	unsigned char *tmp_name;
+	FILE *fp;
+
+	if (!disk_cache_dirty || !disk_cache_dir || !disk_cache_hash)
+		return;
+
+	/* Keep the documents other instances have saved meanwhile. */
+	read_disk_cache_index();
+	shrink_disk_cache(0);
+
+	fp = open_disk_cache_file(&tmp_name);
+	if (!fp) return;
+
+	foreach (item, disk_cache_items) {
+		if (fprintf(fp, "%s\t%"OFF_PRINT_FORMAT"\t%"OFF_PRINT_FORMAT
+			    "\t%"TIME_PRINT_FORMAT"\t%"TIME_PRINT_FORMAT
+			    "\t%s\t%s\t%s\n",
+			    item->name,
+			    (off_print_T) item->head_length,
+			    (off_print_T) item->length,
+			    (time_print_T) item->seconds,
+			    (time_print_T) item->max_age,
+			    item->etag ? item->etag : (unsigned char *) "-",
+			    item->last_modified ? item->last_modified
+			    : (unsigned char *) "-",
+			    item->uri) < 0)
+			break;
+	}
+
+	if (!close_disk_cache_file(fp, tmp_name, DISK_CACHE_INDEX))
+		disk_cache_dirty = 0;
+}
+
+/* Whether @string can be saved as an index field. */
+static int
+is_index_field(unsigned char *string)
+{
+	return !string || (*string && strcmp(string, "-")
+			   && !string[strcspn(string, "\t\r\n")]);
+}
+
+static void
+update_disk_cache_item(struct disk_cache_item *item, struct cache_entry *cached)
+{
+	mem_free_set(&item->etag, null_or_stracpy(cached->etag));
+	mem_free_set(&item->last_modified, null_or_stracpy(cached->last_modified));
+	item->seconds = cached->seconds;
+	item->max_age = cached->expire ? timeval_to_seconds(&cached->max_age) : 0;
+	item->cache_id = cached->cache_id;
+	disk_cache_dirty = 1;
+}
+
+/* Whether @item can be used without revalidating it, either because it has
+ * not expired yet or because the revalidation interval has not elapsed. */
+static int
+is_disk_cache_item_fresh(struct disk_cache_item *item)
+{
+	int interval = get_opt_int("document.cache.revalidation_interval", NULL);
+	time_t now = time(NULL);
+
+	if (item->max_age)
+		return item->max_age > now;
+
+	return interval >= 0 && item->seconds + interval >= now;
+}
+
+/* Reads the whole file of @item, mapping it if possible. */
+static unsigned char *
+read_disk_cache_file(struct disk_cache_item *item, off_t size, int *mapped)
+{
+	unsigned char *filename = get_disk_cache_filename(item->name);
+	unsigned char *data = NULL;
+	struct stat st;
+	int fd;
+
+	*mapped = 0;
+	if (!filename) return NULL;
+
+	fd = open(filename, O_RDONLY);
+	mem_free(filename);
+	if (fd < 0) return NULL;
+
+	if (fstat(fd, &st) < 0 || st.st_size != size) {
+		close(fd);
+		return NULL;
+	}
+
+#ifdef HAVE_MMAP
+	data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data != MAP_FAILED) {
+		*mapped = 1;
+		close(fd);
+		return data;
+	}
+#endif
+
+	data = mem_alloc(size);
+	if (data && safe_read(fd, data, size) != size) {
+		mem_free(data);
+		data = NULL;
+	}
+
+	close(fd);
+	return data;
+}
+
+struct cache_entry *
+load_disk_cache_entry(struct uri *uri, int fresh_only)
+{
+	struct disk_cache_item *item;
+	struct cache_entry *cached;
+	struct uri *proxied_uri;
+	unsigned char *string;
+	unsigned char *data;
+	off_t size;
+	int mapped;
+
+	if (!disk_cache_is_enabled() || uri->post)
+		return NULL;
+
+	/* Someone else is already filling the memory cache entry. */
+	if (find_in_cache(uri))
+		return NULL;
+
+	proxied_uri = get_proxied_uri(uri);
+	if (!proxied_uri) return NULL;
+
+	string = get_uri_string(proxied_uri, URI_BASE);
+	done_uri(proxied_uri);
+	if (!string) return NULL;
+
+	item = find_disk_cache_item(string);
+	mem_free(string);
+	if (!item) return NULL;
+
+	if (fresh_only && !is_disk_cache_item_fresh(item))
+		return NULL;
+
+	size = item->head_length + item->length;
+	data = read_disk_cache_file(item, size, &mapped);
+	if (!data) {
+		delete_disk_cache_item(item, 1);
+		return NULL;
+	}
+
+	cached = get_cache_entry(uri);
+	if (cached) {
+		mem_free_set(&cached->head, memacpy(data, item->head_length));
+		if (!cached->head
+		    || add_fragment(cached, 0, data + item->head_length,
+				    item->length) < 0) {
+			delete_cache_entry(cached);
+			cached = NULL;
+		}
+	}
+
+#ifdef HAVE_MMAP
+	if (mapped)
+		munmap(data, size);
+	else
+#endif
+		mem_free(data);
+
+	if (!cached) return NULL;
+
+	normalize_cache_entry(cached, item->length);
+	mem_free_set(&cached->etag, null_or_stracpy(item->etag));
+	mem_free_set(&cached->last_modified, null_or_stracpy(item->last_modified));
+	cached->seconds = item->seconds;
+	if (item->max_age) {
+		timeval_from_seconds(&cached->max_age, item->max_age);
+		cached->expire = 1;
+	}
+
+	item->cache_id = cached->cache_id;
+	move_to_top_of_list(disk_cache_items, item);
+	disk_cache_dirty = 1;
+
+	return cached;
+}
+
+/* Whether the server allows keeping the document around. */
+static int
+is_disk_cacheable(struct cache_entry *cached)
+{
+	unsigned char *control;
+	int cacheable = 1;
+
+	if (cached->incomplete || cached->redirect || !cached->head
+	    || cached->cache_mode == CACHE_MODE_NEVER
+	    || cached->uri->post)
+		return 0;
+
+	if (cached->uri->protocol != PROTOCOL_HTTP
+	    && cached->uri->protocol != PROTOCOL_HTTPS)
+		return 0;
+
+	/* Without a validator or an expiration time the document would have
+	 * to be downloaded again anyway. */
+	if (!cached->expire && !cached->etag && !cached->last_modified)
+		return 0;
+
+	if (!is_index_field(cached->etag)
+	    || !is_index_field(cached->last_modified))
+		return 0;
+
+	control = parse_header(cached->head, "Cache-Control", NULL);
+	if (control) {
+		if (strstr(control, "no-store") || strstr(control, "private"))
+			cacheable = 0;
+		mem_free(control);
+	}
+
+	return cacheable;
+}
+
+void
+save_disk_cache_entry(struct cache_entry *cached)
+{
+	struct disk_cache_item *item;
+	struct fragment *fragment;
+	unsigned char *string;
+	unsigned char *tmp_name;
+	off_t head_length;
+	FILE *fp;
+
+	if (!disk_cache_is_enabled() || !is_disk_cacheable(cached))
+		return;
+
+	string = get_uri_string(cached->uri, URI_BASE);
+	if (!string || string[strcspn(string, "\t\r\n")]) {
+		mem_free_if(string);
+		return;
+	}
+
+	item = find_disk_cache_item(string);
+	if (item && item->cache_id == cached->cache_id) {
+		/* Revalidated, the body on the disk is still the same. */
+		mem_free(string);
+		update_disk_cache_item(item, cached);
+		item->seconds = time(NULL);
+		move_to_top_of_list(disk_cache_items, item);
+		return;
+	}
+
+	/* Admit only documents which leave room for a few others. */
+	head_length = strlen(cached->head);
+	fragment = get_cache_fragment(cached);
+	if (head_length + cached->length > get_disk_cache_size() / 4
+	    || (cached->length
+		&& (!fragment || fragment->length != cached->length))) {
+		if (item) delete_disk_cache_item(item, 1);
+		mem_free(string);
+		return;
+	}
+
+	/* The new file replaces the old one, it has the same name. */
+	if (item) delete_disk_cache_item(item, 0);
+
+	shrink_disk_cache(head_length + cached->length);
+
+	item = add_disk_cache_item(string);
+	mem_free(string);
+	if (!item) return;
+
+	fp = open_disk_cache_file(&tmp_name);
+	if (!fp) {
+		delete_disk_cache_item(item, 1);
+		return;
+	}
+
+	fwrite(cached->head, 1, head_length, fp);
+	if (cached->length)
+		fwrite(fragment->data, 1, cached->length, fp);
+
+	if (close_disk_cache_file(fp, tmp_name, item->name)) {
+		delete_disk_cache_item(item, 1);
+		return;
+	}
+
+	item->head_length = head_length;
+	item->length = cached->length;
+	disk_cache_size += head_length + cached->length;
+	update_disk_cache_item(item, cached);
+}
+
+static enum evhook_status
+disk_cache_write_hook(va_list ap, void *data)
+{
+	write_disk_cache_index();
+	return EVENT_HOOK_STATUS_NEXT;
+}
+
+static struct event_hook_info disk_cache_hooks[] = {
+	{ "periodic-saving", 0, disk_cache_write_hook, NULL },
+
+	NULL_EVENT_HOOK_INFO,
+};
+
+static void
+init_disk_cache(struct module *module)
+{
+	if (!elinks_home || get_cmd_opt_bool("anonymous"))
+		return;
+
+	disk_cache_dir = straconcat(elinks_home, DISK_CACHE_DIRNAME,
+				    (unsigned char *) NULL);
+	if (!disk_cache_dir) return;
+
+	if (mkalldirs(disk_cache_dir) < 0) {
+		mem_free_set(&disk_cache_dir, NULL);
+		return;
+	}
+
+	disk_cache_hash = init_hash8();
+	if (!disk_cache_hash) return;
+
+	read_disk_cache_index();
+	shrink_disk_cache(0);
+	sweep_disk_cache_dir();
+}
+
+static void
+done_disk_cache(struct module *module)
+{
+	write_disk_cache_index();
+
+	while (!list_empty(disk_cache_items)) {
+		struct disk_cache_item *item = disk_cache_items.next;
+
+		del_from_list(item);
+		done_disk_cache_item(item);
+	}
+
+	if (disk_cache_hash) free_hash(&disk_cache_hash);
+	mem_free_set(&disk_cache_dir, NULL);
+	disk_cache_size = 0;
+	disk_cache_dirty = 0;
+}
+
+struct module disk_cache_module = struct_module(
+	/* name: */		N_("Disk Cache"),
+	/* options: */		disk_cache_options,
+	/* events: */		disk_cache_hooks,
+	/* submodules: */	NULL,
+	/* data: */		NULL,
+	/* init: */		init_disk_cache,
+	/* done: */		done_disk_cache
+);
@@ -0,0 +1,20 @@
+#ifndef EL__CACHE_DISK_H
+#define EL__CACHE_DISK_H
+
+struct cache_entry;
+struct module;
+struct uri;
+
+extern struct module disk_cache_module;
+
+/* Loads the document saved for @uri in the disk cache into the memory cache
+ * and returns its cache entry. If @fresh_only is non-zero, only documents
+ * which have not yet expired are loaded, others are left for the caller to
+ * revalidate. Returns NULL if nothing usable was found. */
+struct cache_entry *load_disk_cache_entry(struct uri *uri, int fresh_only);
+
+/* Saves the complete @cached entry to the disk cache if it is cacheable.
+ * If the document is already saved, only its validation info is updated. */
+void save_disk_cache_entry(struct cache_entry *cached);
+
+#endif
@@ -0,0 +1,234 @@
+/* Tool for testing and benchmarking the cache entry fragments */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "elinks.h"
+
+#include "cache/cache.h"
+#include "util/lists.h"
+#include "util/memory.h"
+#include "util/test.h"
+
+static struct cache_entry *
+init_test_entry(void)
+{
+	struct cache_entry *cached = mem_calloc(1, sizeof(*cached));
+
+	if (!cached) die("Out of memory");
+
+	init_list(cached->frag);
+	cached->incomplete = 1;
+
+	return cached;
+}
+
+static void
+done_test_entry(struct cache_entry *cached)
+{
+	delete_entry_content(cached);
+	mem_free(cached);
+
+	if (get_cache_size())
+		die("FAIL: %llu bytes left in the cache", get_cache_size());
+}
+
+static void
+add_test_fragment(struct cache_entry *cached, unsigned char *document,
+		  off_t offset, ssize_t length)
+{
+	if (add_fragment(cached, offset, document + offset, length) < 0)
+		die("Out of memory");
+
+	if (cached->length < offset + length)
+		die("FAIL: adding %ld bytes at %ld left the entry %ld bytes long",
+		    (long) length, (long) offset, (long) cached->length);
+}
+
+/* Replace random ranges of the data of @cached with random bytes of
+ * random length @edits times, doing the same to the @size bytes of
+ * @document, and check that the entry keeps matching the document. */
+static void
+edit_test_entry(struct cache_entry *cached, unsigned char *document,
+		off_t size, int edits)
+{
+	unsigned char *data;
+	int i;
+
+	for (i = 0; i < edits; i++) {
+		off_t offset = rand() % (size + 1);
+		off_t length = rand() % (size - offset + 1);
+		ssize_t datalen = rand() % (2 * length + 100);
+		struct fragment *frag;
+		off_t j;
+
+		data = mem_alloc(datalen + 1);
+		document = mem_realloc(document, size + datalen + 1);
+		if (!data || !document) die("Out of memory");
+
+		for (j = 0; j < datalen; j++)
+			data[j] = rand();
+
+		if (replace_cache_range(cached, offset, length, data, datalen))
+			die("FAIL: replacing %ld bytes at %ld failed",
+			    (long) length, (long) offset);
+
+		memmove(document + offset + datalen, document + offset + length,
+			size - offset - length);
+		memcpy(document + offset, data, datalen);
+		size += datalen - length;
+		mem_free(data);
+
+		frag = get_cache_fragment(cached);
+		if (cached->length != size
+		    || (size && (!frag || frag->length != size
+				 || memcmp(frag->data, document, size))))
+			die("FAIL: edit %d left the entry different from the document", i);
+
+		if (cached->data_size != size || get_cache_size() != size)
+			die("FAIL: cache size %ld does not match the document size %ld",
+			    (long) cached->data_size, (long) size);
+	}
+
+	mem_free(document);
+}
+
+/* Add the document to the cache entry in random chunks of at most @chunk
+ * bytes, going back about every @rewinds-th chunk to some earlier offset
+ * the way a restarted download does, and check that the fragments put the
+ * document together. */
+static void
+simulate_download(off_t size, int chunk, int rewinds, int edits)
+{
+	struct cache_entry *cached = init_test_entry();
+	unsigned char *document = mem_alloc(size);
+	struct fragment *frag;
+	off_t offset;
+
+	if (!document) die("Out of memory");
+
+	for (offset = 0; offset < size; offset++)
+		document[offset] = rand();
+
+	for (offset = 0; offset < size; ) {
+		ssize_t length = 1 + rand() % chunk;
+
+		if (rewinds && offset && !(rand() % rewinds))
+			offset = rand() % offset;
+
+		if (length > size - offset)
+			length = size - offset;
+
+		/* Adding data before the end truncates the entry. */
+		add_test_fragment(cached, document, offset, length);
+		offset += length;
+	}
+
+	frag = get_cache_fragment(cached);
+	if (!frag || frag->offset || frag->length != size
+	    || memcmp(frag->data, document, size))
+		die("FAIL: fragments do not match the document");
+
+	if (cached->data_size != size || get_cache_size() != size)
+		die("FAIL: cache size %ld does not match the document size %ld",
+		    (long) cached->data_size, (long) size);
+
+	normalize_cache_entry(cached, size);
+	frag = cached->frag.next;
+	if (!list_is_singleton(cached->frag) || frag->real_length != size)
+		die("FAIL: the fragment was not shrunk to the document size");
+
+	/* This takes over @document. */
+	edit_test_entry(cached, document, size, edits);
+
+	done_test_entry(cached);
+}
+
+/* Time appending @appends chunks of @chunk bytes to a cache entry, the
+ * way line by line producers such as directory listings fill it. */
+static void
+benchmark_appends(int appends, int chunk)
+{
+	struct cache_entry *cached = init_test_entry();
+	unsigned char *data = mem_calloc(1, chunk);
+	clock_t start;
+	double seconds;
+	int fragments;
+	int i;
+
+	if (!data) die("Out of memory");
+
+	start = clock();
+	for (i = 0; i < appends; i++)
+		if (add_fragment(cached, (off_t) i * chunk, data, chunk) < 0)
+			die("Out of memory");
+	seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+	fragments = list_size(&cached->frag);
+
+	printf("%d appends of %d bytes: %.3fs, %d fragments\n",
+	       appends, chunk, seconds, fragments);
+
+	done_test_entry(cached);
+	mem_free(data);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int size = 100000;
+	int chunk = 80;
+	int rewinds = 0;
+	int edits = 0;
+	int benchmark = 0;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		char *arg = argv[i];
+
+		if (strncmp(arg, "--", 2))
+			break;
+
+		arg += 2;
+
+		if (get_test_opt(&arg, "size", &i, argc, argv, "a number")) {
+			size = atoi(arg);
+
+		} else if (get_test_opt(&arg, "chunk", &i, argc, argv, "a number")) {
+			chunk = atoi(arg);
+
+		} else if (get_test_opt(&arg, "rewinds", &i, argc, argv, "a number")) {
+			rewinds = atoi(arg);
+
+		} else if (get_test_opt(&arg, "edits", &i, argc, argv, "a number")) {
+			edits = atoi(arg);
+
+		} else if (get_test_opt(&arg, "seed", &i, argc, argv, "a number")) {
+			srand(atoi(arg));
+
+		} else if (get_test_opt(&arg, "benchmark", &i, argc, argv, "a number")) {
+			benchmark = atoi(arg);
+
+		} else {
+			die("Unknown argument '%s'", arg - 2);
+		}
+	}
+
+	if (size <= 0 || chunk <= 0 || rewinds < 0 || edits < 0)
+		die("Usage: %s [--size N] [--chunk N] [--rewinds N] [--edits N] [--seed N] [--benchmark APPENDS]",
+		    argv[0]);
+
+	if (benchmark)
+		benchmark_appends(benchmark, chunk);
+	else
+		simulate_download(size, chunk, rewinds, edits);
+
+	return 0;
+}
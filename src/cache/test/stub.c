@@ -0,0 +1,178 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elinks.h"
+
+#include "bfu/hierbox.h"
+#include "cache/cache.h"
+#include "cache/dialogs.h"
+#include "cache/disk.h"
+#include "config/options.h"
+#include "main/main.h"
+#include "main/select.h"
+#include "main/timer.h"
+#include "network/connection.h"
+#include "protocol/proxy.h"
+#include "protocol/uri.h"
+#include "util/test.h"
+
+static void
+stub_called(const unsigned char *fun)
+{
+	die("FAIL: stub %s\n", fun);
+}
+
+struct hierbox_browser cache_browser;
+struct option *config_options;
+
+/* declared in "bfu/hierbox.h" */
+struct listbox_item *
+add_listbox_item(struct hierbox_browser *browser, struct listbox_item *root,
+		 enum listbox_item_type type, void *data, int add_position)
+{
+	stub_called("add_listbox_item");
+	return NULL;
+}
+
+/* declared in "bfu/hierbox.h" */
+void
+done_listbox_item(struct hierbox_browser *browser, struct listbox_item *item)
+{
+	stub_called("done_listbox_item");
+}
+
+/* declared in "config/options.h" */
+union option_value *
+#ifdef CONFIG_DEBUG
+get_opt_(unsigned char *file, int line, enum option_type option_type,
+	 struct option *tree, unsigned char *name, struct session *ses)
+#else
+get_opt_(struct option *tree, unsigned char *name, struct session *ses)
+#endif
+{
+	stub_called("get_opt_");
+	return NULL;
+}
+
+/* declared in "main/main.h" */
+void
+shrink_memory_when_idle(void)
+{
+	stub_called("shrink_memory_when_idle");
+}
+
+/* declared in "network/connection.h" */
+int
+is_entry_used(struct cache_entry *cached)
+{
+	stub_called("is_entry_used");
+	return 0;
+}
+
+/* declared in "protocol/proxy.h" */
+struct uri *
+get_proxy_uri(struct uri *uri, struct connection_state *connection_state)
+{
+	stub_called("get_proxy_uri");
+	return NULL;
+}
+
+/* declared in "protocol/proxy.h" */
+struct uri *
+get_proxied_uri(struct uri *uri)
+{
+	stub_called("get_proxied_uri");
+	return NULL;
+}
+
+/* declared in "protocol/uri.h" */
+struct uri *
+get_uri(unsigned char *string, enum uri_component components)
+{
+	stub_called("get_uri");
+	return NULL;
+}
+
+/* declared in "protocol/uri.h" */
+void
+done_uri(struct uri *uri)
+{
+	stub_called("done_uri");
+}
+
+/* declared in "protocol/uri.h" */
+int
+compare_uri(const struct uri *uri1, const struct uri *uri2,
+	    enum uri_component components)
+{
+	stub_called("compare_uri");
+	return 0;
+}
+
+/* declared in "protocol/uri.h" */
+unsigned char *
+get_uri_string(const struct uri *uri, enum uri_component components)
+{
+	stub_called("get_uri_string");
+	return NULL;
+}
+
+/* declared in "protocol/uri.h" */
+unsigned char *
+join_urls(struct uri *base, unsigned char *relative)
+{
+	stub_called("join_urls");
+	return NULL;
+}
+
+/* declared in "cache/disk.h" */
+struct cache_entry *
+load_disk_cache_entry(struct uri *uri, int fresh_only)
+{
+	stub_called("load_disk_cache_entry");
+	return NULL;
+}
+
+/* declared in "main/select.h" */
+int
+register_idle_work_do(idle_handler_T work_handler, void *data)
+{
+	stub_called("register_idle_work_do");
+	return 0;
+}
+
+/* declared in "main/select.h" */
+void
+unregister_idle_work_do(idle_handler_T work_handler, void *data)
+{
+	stub_called("unregister_idle_work_do");
+}
+
+/* declared in "main/select.h" */
+int
+idle_work_should_yield(void)
+{
+	stub_called("idle_work_should_yield");
+	return 0;
+}
+
+/* declared in "main/timer.h" */
+void
+install_timer(timer_id_T *id, milliseconds_T delay, void (*func)(void *),
+	      void *data)
+{
+	stub_called("install_timer");
+}
+
+/* declared in "main/timer.h" */
+void
+kill_timer(timer_id_T *id)
+{
+	stub_called("kill_timer");
+}
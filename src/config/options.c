@@ -1042,6 +1042,15 @@ change_hook_active_link(struct session *ses, struct option *current, struct opti
 	return 0;
 }
 
+static int
+change_hook_links(struct session *ses, struct option *current, struct option *changed)
+{
+	/* Let the cached documents know whether to draw link numbers over
+	 * them. */
+	update_cached_document_options(ses);
+	return 0;
+}
+
 static int
 change_hook_terminal(struct session *ses, struct option *current, struct option *changed)
 {
@@ -1103,6 +1112,7 @@ update_options_visibility(void)
 {
 	update_visibility(config_options->value.tree,
 			  get_opt_bool("config.show_template", NULL));
+	update_hierbox_browser(&option_browser);
 }
 
 void
@@ -1121,6 +1131,7 @@ static int
 change_hook_stemplate(struct session *ses, struct option *current, struct option *changed)
 {
 	update_visibility(config_options->value.tree, changed->value.number);
+	update_hierbox_browser(&option_browser);
 	return 0;
 }
 
@@ -1141,6 +1152,10 @@ static const struct change_hook_info change_hooks[] = {
 					change_hook_insert_mode },
 	{ "document.browse.links.active_link",
 					change_hook_active_link },
+	{ "document.browse.links.numbering",
+					change_hook_links },
+	{ "document.browse.links.numbering_overlay",
+					change_hook_links },
 	{ "document.cache",		change_hook_cache },
 	{ "document.codepage",		change_hook_html },
 	{ "document.colors",		change_hook_html },
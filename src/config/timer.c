@@ -11,6 +11,7 @@
 #include "intl/gettext/libintl.h"
 #include "main/event.h"
 #include "main/module.h"
+#include "main/select.h"
 #include "main/timer.h"
 #include "util/time.h"
 
@@ -18,12 +19,22 @@
 /* Timer for periodically saving configuration files to disk */
 static timer_id_T periodic_save_timer = TIMER_ID_UNDEF;
 
+static int periodic_save_event_id = EVENT_NONE;
+
+/* The files are written when the select loop is idle so that the saving
+ * does not get in the way of the user.  */
+static int
+periodic_save_idle(void *xxx)
+{
+	trigger_event(periodic_save_event_id);
+	return 0;
+}
+
 /* Timer callback for @periodic_save_timer.  As explained in @install_timer,
  * this function must erase the expired timer ID from all variables.  */
 static void
 periodic_save_handler(void *xxx)
 {
-	static int periodic_save_event_id = EVENT_NONE;
 	milliseconds_T interval;
 
 	if (get_cmd_opt_bool("anonymous")) return;
@@ -32,7 +43,7 @@ periodic_save_handler(void *xxx)
 	if (periodic_save_event_id == EVENT_NONE)
 		set_event_id(periodic_save_event_id, "periodic-saving");
 	else
-		trigger_event(periodic_save_event_id);
+		register_idle_work(periodic_save_idle, NULL);
 
 	interval = sec_to_ms(get_opt_int("infofiles.save_interval", NULL));
 	if (!interval) {
@@ -76,6 +87,7 @@ static void
 done_timer(struct module *module)
 {
 	kill_timer(&periodic_save_timer);
+	unregister_idle_work(periodic_save_idle, NULL);
 }
 
 struct module periodic_saving_module = struct_module(
@@ -9,9 +9,15 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h> /* OS/2 needs this after sys/types.h */
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h> /* OS/2 needs this after sys/types.h */
+#endif
 #ifdef HAVE_TIME_H
 #include <time.h>
 #endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
 
 #include "elinks.h"
 
@@ -41,12 +47,18 @@
 #include "util/error.h"
 #endif
 #include "util/file.h"
+#include "util/hash.h"
 #include "util/memory.h"
 #include "util/secsave.h"
 #include "util/string.h"
 #include "util/time.h"
 
 #define COOKIES_FILENAME		"cookies"
+#define COOKIES_JOURNAL_FILENAME	"cookies.journal"
+
+/* The journal is compacted into the cookies file once it grows beyond
+ * this size and the size of the cookies file. */
+#define COOKIES_JOURNAL_MIN_SIZE	(64 * 1024)
 
 
 static int cookies_nosave = 0;
@@ -69,9 +81,17 @@ static INIT_LIST_OF(struct c_domain, c_domains);
 /* List of servers for which there are cookies.  */
 static INIT_LIST_OF(struct cookie_server, cookie_servers);
 
-/* Only @set_cookies_dirty may make this nonzero.  */
+/* Only @set_cookies_dirty may make this nonzero.  It means that the
+ * cookies file has to be rewritten as a whole.  */
 static int cookies_dirty = 0;
 
+/* Journal records of the changes not yet appended to the journal.  */
+static struct string cookies_journal = NULL_STRING;
+
+/* The sizes of the cookies file and the journal on the disk.  */
+static off_t cookies_file_size;
+static off_t cookies_journal_size;
+
 enum cookies_option {
 	COOKIES_TREE,
 
@@ -506,12 +526,12 @@ accept_cookie(struct cookie *cookie)
 				continue;
 
 			delete_cookie(c);
-			/* @set_cookies_dirty will be called below.  */
+			/* The journal record below replaces it.  */
 		}
 	}
 
 	add_to_list(cookies, cookie);
-	set_cookies_dirty();
+	journal_cookie(cookie, 0);
 
 	/* XXX: This crunches CPU too. --pasky */
 	foreach (cd, c_domains)
@@ -651,9 +671,8 @@ send_cookies(struct uri *uri)
 			DBG("Cookie %s=%s (exp %"TIME_PRINT_FORMAT") expired.",
 			    c->name, c->value, (time_print_T) c->expires);
 #endif
+			journal_cookie(c, 1);
 			delete_cookie(c);
-
-			set_cookies_dirty();
 			continue;
 		}
 
@@ -685,6 +704,194 @@ send_cookies(struct uri *uri)
 static void done_cookies(struct module *module);
 
 
+/* Parses a line in the cookies file format into a new cookie, which has
+ * to be either accepted or freed with done_cookie().  Returns NULL if the
+ * line is not valid.  */
+static struct cookie *
+parse_cookie_line(unsigned char *line)
+{
+	struct cookie *cookie;
+	unsigned char *p, *q = line;
+	enum { NAME = 0, VALUE, SERVER, PATH, DOMAIN, EXPIRES, SECURE, MEMBERS } member;
+	struct {
+		unsigned char *pos;
+		int len;
+	} members[MEMBERS];
+
+	/* First find all members. */
+	for (member = NAME; member < MEMBERS; member++, q = ++p) {
+		p = strchr(q, '\t');
+		if (!p) {
+			if (member + 1 != MEMBERS) break; /* last field ? */
+			p = strchr(q, '\n');
+			if (!p) break;
+		}
+
+		members[member].pos = q;
+		members[member].len = p - q;
+	}
+
+	if (member != MEMBERS) return NULL;	/* Invalid line. */
+
+	/* Prepare cookie if all members and fields was read. */
+	cookie = mem_calloc(1, sizeof(*cookie));
+	if (!cookie) return NULL;
+
+	cookie->server  = get_cookie_server(members[SERVER].pos, members[SERVER].len);
+	cookie->name	= memacpy(members[NAME].pos, members[NAME].len);
+	cookie->value	= memacpy(members[VALUE].pos, members[VALUE].len);
+	cookie->path	= memacpy(members[PATH].pos, members[PATH].len);
+	cookie->domain	= memacpy(members[DOMAIN].pos, members[DOMAIN].len);
+
+	/* Check whether all fields were correctly allocated. */
+	if (!cookie->server || !cookie->name || !cookie->value
+	    || !cookie->path || !cookie->domain) {
+		done_cookie(cookie);
+		return NULL;
+	}
+
+	cookie->expires = str_to_time_t(members[EXPIRES].pos);
+	cookie->secure  = !!atoi(members[SECURE].pos);
+
+	return cookie;
+}
+
+/* Puts the case insensitive key identifying the cookie with @name and
+ * @domain to @key, which the caller has to free.  */
+static struct string *
+get_cookie_key(struct string *key, unsigned char *name, int namelen,
+	       unsigned char *domain, int domainlen)
+{
+	int i;
+
+	if (!init_string(key)
+	    || !add_bytes_to_string(key, name, namelen)
+	    || !add_char_to_string(key, '\t')
+	    || !add_bytes_to_string(key, domain, domainlen)) {
+		done_string(key);
+		return NULL;
+	}
+
+	for (i = 0; i < key->length; i++)
+		key->source[i] = c_tolower(key->source[i]);
+
+	return key;
+}
+
+static void
+done_cookie_keys(struct hash *keys)
+{
+	struct hash_item *item;
+	int i;
+
+	foreach_hash_item (item, *keys, i)
+		mem_free(item->key);
+
+	free_hash(&keys);
+}
+
+/* Applies the records of the journal to the cookies loaded from the
+ * cookies file.  */
+static void
+replay_cookies_journal(unsigned char *journal, time_t now)
+{
+	unsigned char in_buffer[6 * MAX_STR_LEN];
+	struct hash *keys;
+	struct cookie *c;
+	FILE *fp;
+
+	fp = fopen(journal, "rb");
+	if (!fp) return;
+
+	keys = init_hash8();
+	if (!keys) {
+		fclose(fp);
+		return;
+	}
+
+	foreach (c, cookies) {
+		struct string key;
+
+		if (!get_cookie_key(&key, c->name, strlen(c->name),
+				    c->domain, strlen(c->domain)))
+			continue;
+
+		if (get_hash_item(keys, key.source, key.length)
+		    || !add_hash_item(keys, key.source, key.length, c))
+			done_string(&key);
+	}
+
+	cookies_nosave = 1;
+
+	while (fgets(in_buffer, sizeof(in_buffer), fp)) {
+		struct cookie *cookie = NULL;
+		struct hash_item *item;
+		struct string key;
+		unsigned char *domain;
+
+		if (!strchr(in_buffer, '\n')) {
+			/* A record cut short when ELinks crashed while
+			 * appending it.  Have the journal compacted so that
+			 * no records get appended to the broken one. */
+			if (feof(fp)) {
+				set_cookies_dirty();
+				break;
+			}
+
+			/* Skip the rest of a record too long to read. */
+			while (fgets(in_buffer, sizeof(in_buffer), fp)
+			       && !strchr(in_buffer, '\n'));
+			continue;
+		}
+
+		switch (in_buffer[0]) {
+		case '+':
+			cookie = parse_cookie_line(in_buffer + 1);
+			if (!cookie) continue;
+
+			if (!get_cookie_key(&key, cookie->name, strlen(cookie->name),
+					    cookie->domain, strlen(cookie->domain))) {
+				done_cookie(cookie);
+				continue;
+			}
+			break;
+
+		case '-':
+			domain = strchr(in_buffer + 1, '\t');
+			if (!domain
+			    || !get_cookie_key(&key, in_buffer + 1, domain - in_buffer - 1,
+					       domain + 1, strcspn(domain + 1, "\n")))
+				continue;
+			break;
+
+		default:
+			continue;
+		}
+
+		item = get_hash_item(keys, key.source, key.length);
+		if (item) {
+			delete_cookie(item->value);
+			mem_free(item->key);
+			del_hash_item(keys, item);
+		}
+
+		/* Expired cookies only delete the previous ones. */
+		if (cookie && cookie->expires && cookie->expires > now
+		    && add_hash_item(keys, key.source, key.length, cookie)) {
+			accept_cookie(cookie);
+			continue;
+		}
+
+		if (cookie) done_cookie(cookie);
+		done_string(&key);
+	}
+
+	cookies_nosave = 0;
+	cookies_journal_size = ftell(fp);
+	fclose(fp);
+	done_cookie_keys(keys);
+}
+
 void
 load_cookies(void) {
 	/* Buffer size is set to be enough to read long lines that
@@ -706,97 +913,171 @@ load_cookies(void) {
 	cookies_nosave = 1;
 	done_cookies(&cookies_module);
 	cookies_nosave = 0;
+	cookies_file_size = cookies_journal_size = 0;
 
 	fp = fopen(cookfile, "rb");
 	if (elinks_home) mem_free(cookfile);
-	if (!fp) return;
-
-	/* XXX: We don't want to overwrite the cookies file
-	 * periodically to our death. */
-	cookies_nosave = 1;
 
 	now = time(NULL);
-	while (fgets(in_buffer, 6 * MAX_STR_LEN, fp)) {
-		struct cookie *cookie;
-		unsigned char *p, *q = in_buffer;
-		enum { NAME = 0, VALUE, SERVER, PATH, DOMAIN, EXPIRES, SECURE, MEMBERS } member;
-		struct {
-			unsigned char *pos;
-			int len;
-		} members[MEMBERS];
-		time_t expires;
 
-		/* First find all members. */
-		for (member = NAME; member < MEMBERS; member++, q = ++p) {
-			p = strchr(q, '\t');
-			if (!p) {
-				if (member + 1 != MEMBERS) break; /* last field ? */
-				p = strchr(q, '\n');
-				if (!p) break;
+	if (fp) {
+		/* XXX: We don't want to overwrite the cookies file
+		 * periodically to our death. */
+		cookies_nosave = 1;
+
+		while (fgets(in_buffer, 6 * MAX_STR_LEN, fp)) {
+			struct cookie *cookie = parse_cookie_line(in_buffer);
+
+			if (!cookie) continue;
+
+			/* Skip expired cookies if any. */
+			if (!cookie->expires || cookie->expires <= now) {
+				done_cookie(cookie);
+				set_cookies_dirty();
+				continue;
 			}
 
-			members[member].pos = q;
-			members[member].len = p - q;
+			accept_cookie(cookie);
 		}
 
-		if (member != MEMBERS) continue;	/* Invalid line. */
+		cookies_nosave = 0;
+		cookies_file_size = ftell(fp);
+		fclose(fp);
+	}
 
-		/* Skip expired cookies if any. */
-		expires = str_to_time_t(members[EXPIRES].pos);
-		if (!expires || expires <= now) {
-			set_cookies_dirty();
-			continue;
+	if (elinks_home) {
+		unsigned char *journal = straconcat(elinks_home,
+						    COOKIES_JOURNAL_FILENAME,
+						    (unsigned char *) NULL);
+
+		if (journal) {
+			replay_cookies_journal(journal, now);
+			mem_free(journal);
 		}
+	}
+}
 
-		/* Prepare cookie if all members and fields was read. */
-		cookie = mem_calloc(1, sizeof(*cookie));
-		if (!cookie) continue;
+/* Appends the pending journal records to the journal.  If that fails, the
+ * cookies file is rewritten as a whole instead.  */
+static void
+append_cookies_journal(void)
+{
+	unsigned char *journal;
+	size_t pos = 0;
+	int fd;
 
-		cookie->server  = get_cookie_server(members[SERVER].pos, members[SERVER].len);
-		cookie->name	= memacpy(members[NAME].pos, members[NAME].len);
-		cookie->value	= memacpy(members[VALUE].pos, members[VALUE].len);
-		cookie->path	= memacpy(members[PATH].pos, members[PATH].len);
-		cookie->domain	= memacpy(members[DOMAIN].pos, members[DOMAIN].len);
+	if (!elinks_home || get_cmd_opt_bool("anonymous"))
+		return;
 
-		/* Check whether all fields were correctly allocated. */
-		if (!cookie->server || !cookie->name || !cookie->value
-		    || !cookie->path || !cookie->domain) {
-			done_cookie(cookie);
-			continue;
-		}
+	journal = straconcat(elinks_home, COOKIES_JOURNAL_FILENAME,
+			     (unsigned char *) NULL);
+	if (!journal) {
+		set_cookies_dirty();
+		return;
+	}
 
-		cookie->expires = expires;
-		cookie->secure  = !!atoi(members[SECURE].pos);
+	fd = open(journal, O_WRONLY | O_APPEND | O_CREAT, 0600);
+	mem_free(journal);
+	if (fd < 0) {
+		set_cookies_dirty();
+		return;
+	}
+
+	while (pos < cookies_journal.length) {
+		ssize_t written = safe_write(fd, cookies_journal.source + pos,
+					     cookies_journal.length - pos);
 
-		accept_cookie(cookie);
+		if (written <= 0) break;
+		pos += written;
 	}
 
-	cookies_nosave = 0;
-	fclose(fp);
+	if (pos == cookies_journal.length
+	    && get_opt_bool("infofiles.secure_save_fsync", NULL)
+	    && fsync(fd))
+		pos = 0;
+
+	if (close(fd) || pos != cookies_journal.length) {
+		/* The journal may end with a partial record now.  */
+		set_cookies_dirty();
+		return;
+	}
+
+	cookies_journal_size += pos;
+	cookies_journal.length = 0;
 }
 
-static void
-resave_cookies_bottom_half(void *always_null)
+static int
+resave_cookies_idle(void *always_null)
 {
-	if (get_cookies_save() && get_cookies_resave())
-		save_cookies(NULL); /* checks cookies_dirty */
+	if (!get_cookies_save() || !get_cookies_resave())
+		return 0;
+
+	if (cookies_dirty
+	    || cookies_journal_size + cookies_journal.length
+	       > int_max(COOKIES_JOURNAL_MIN_SIZE, cookies_file_size))
+		save_cookies(NULL); /* compacts the journal */
+	else if (cookies_journal.length)
+		append_cookies_journal();
+
+	return 0;
 }
 
-/* Note that the cookies have been modified, and register a bottom
- * half for saving them if appropriate.  We use a bottom half so that
- * if something makes multiple changes and calls this for each change,
- * the cookies get saved only once at the end.  */
+/* Note that the cookies have been modified, and queue idle work for
+ * saving them if appropriate.  We use idle work so that if something
+ * makes multiple changes and calls this for each change, the cookies
+ * get saved only once at the end, and the file is not written while
+ * the user is waiting for a document.  */
 void
 set_cookies_dirty(void)
 {
 	/* Do not check @cookies_dirty here.  If the previous attempt
 	 * to save cookies failed, @cookies_dirty can still be nonzero
-	 * even though @resave_cookies_bottom_half is no longer in the
+	 * even though @resave_cookies_idle is no longer in the
 	 * queue.  */
 	cookies_dirty = 1;
-	/* If @resave_cookies_bottom_half is already in the queue,
-	 * @register_bottom_half does nothing.  */
-	register_bottom_half(resave_cookies_bottom_half, NULL);
+	/* If @resave_cookies_idle is already in the queue,
+	 * @register_idle_work does nothing.  */
+	register_idle_work(resave_cookies_idle, NULL);
+}
+
+void
+journal_cookie(struct cookie *cookie, int deleted)
+{
+	if (cookies_nosave)
+		return;
+
+	/* Without resaving the cookies are only saved as a whole.  */
+	if (!get_cookies_save() || !get_cookies_resave() || cookies_dirty) {
+		set_cookies_dirty();
+		return;
+	}
+
+	if (!cookies_journal.source && !init_string(&cookies_journal)) {
+		set_cookies_dirty();
+		return;
+	}
+
+	if (deleted) {
+		if (!add_format_to_string(&cookies_journal, "-%s\t%s\n",
+					  cookie->name,
+					  empty_string_or_(cookie->domain))) {
+			set_cookies_dirty();
+			return;
+		}
+
+	} else if (!add_format_to_string(&cookies_journal,
+					 "+%s\t%s\t%s\t%s\t%s\t%"TIME_PRINT_FORMAT"\t%d\n",
+					 cookie->name, cookie->value,
+					 cookie->server->host,
+					 empty_string_or_(cookie->path),
+					 empty_string_or_(cookie->domain),
+					 (time_print_T) cookie->expires,
+					 cookie->secure)) {
+		set_cookies_dirty();
+		return;
+	}
+
+	register_idle_work(resave_cookies_idle, NULL);
 }
 
 /* @term is non-NULL if the user told ELinks to save cookies, or NULL
@@ -809,6 +1090,7 @@ save_cookies(struct terminal *term) {
 	struct cookie *c;
 	unsigned char *cookfile;
 	struct secure_save_info *ssi;
+	off_t size = 0;
 	time_t now;
 
 #ifdef CONFIG_SMALL
@@ -831,7 +1113,8 @@ save_cookies(struct terminal *term) {
 		CANNOT_SAVE_COOKIES(0, N_("ELinks was started without a home directory."));
 		return;
 	}
-	if (!cookies_dirty && !term)
+	if (!cookies_dirty && !cookies_journal.length
+	    && !cookies_journal_size && !term)
 		return;
 	if (get_cmd_opt_bool("anonymous")) {
 		CANNOT_SAVE_COOKIES(0, N_("ELinks was started with the -anonymous option."));
@@ -855,19 +1138,39 @@ save_cookies(struct terminal *term) {
 
 	now = time(NULL);
 	foreach (c, cookies) {
+		int written;
+
 		if (!c->expires || c->expires <= now) continue;
-		if (secure_fprintf(ssi, "%s\t%s\t%s\t%s\t%s\t%"TIME_PRINT_FORMAT"\t%d\n",
-				   c->name, c->value,
-				   c->server->host,
-				   empty_string_or_(c->path),
-				   empty_string_or_(c->domain),
-				   (time_print_T) c->expires, c->secure) < 0)
+		written = secure_fprintf(ssi, "%s\t%s\t%s\t%s\t%s\t%"TIME_PRINT_FORMAT"\t%d\n",
+					 c->name, c->value,
+					 c->server->host,
+					 empty_string_or_(c->path),
+					 empty_string_or_(c->domain),
+					 (time_print_T) c->expires, c->secure);
+		if (written < 0)
 			break;
+		size += written;
 	}
 
 	secsave_errno = SS_ERR_OTHER; /* @secure_close doesn't always set it */
-	if (!secure_close(ssi)) cookies_dirty = 0;
-	else {
+	if (!secure_close(ssi)) {
+		unsigned char *journal = straconcat(elinks_home,
+						    COOKIES_JOURNAL_FILENAME,
+						    (unsigned char *) NULL);
+
+		/* The cookies file now has all the changes recorded in
+		 * the journal.  If it cannot be removed, replaying it
+		 * again does no harm.  */
+		if (journal) {
+			unlink(journal);
+			mem_free(journal);
+		}
+
+		cookies_dirty = 0;
+		cookies_journal.length = 0;
+		cookies_journal_size = 0;
+		cookies_file_size = size;
+	} else {
 		CANNOT_SAVE_COOKIES(MSGBOX_NO_TEXT_INTL,
 				    secsave_strerror(secsave_errno, term));
 	}
@@ -904,10 +1207,11 @@ done_cookies(struct module *module)
 	free_cookies_list(&cookies);
 	free_cookies_list(&cookie_queries);
 	/* If @save_cookies failed above, @cookies_dirty can still be
-	 * nonzero.  Now if @resave_cookies_bottom_half were in the
-	 * queue, it could save the empty @cookies list to the file.
+	 * nonzero.  Now if @resave_cookies_idle were in the queue,
+	 * it could save the empty @cookies list to the file.
 	 * Prevent that.  */
 	cookies_dirty = 0;
+	done_string(&cookies_journal);
 }
 
 struct module cookies_module = struct_module(
@@ -8,6 +8,12 @@
  * \n is a newline
  * EXPIRES is the number of seconds since 1970-01-01 00:00:00 UTC.
  * SECURE is 0 for http and 1 for https.
+ *
+ * Changes made since the cookies file was last written are appended to
+ * the cookies journal, which is replayed on top of the file when loading:
+ * +NAME\tVALUE\tSERVER\tPATH\tDOMAIN\tEXPIRES\tSECURE\n sets the cookie,
+ * replacing any cookie with the same NAME and DOMAIN, and
+ * -NAME\tDOMAIN\n deletes it.
  */
 
 #include "main/module.h"
@@ -57,6 +63,10 @@ void load_cookies(void);
 void save_cookies(struct terminal *);
 void set_cookies_dirty(void);
 
+/* Records that the @cookie in the cookies list was set, or is about to be
+ * deleted if @deleted is non-zero, and queues saving the change. */
+void journal_cookie(struct cookie *cookie, int deleted);
+
 /* Note that the returned value points to a static structure and thus the
  * string will be overwritten at the next call time. The string source
  * itself is dynamically allocated, though. */
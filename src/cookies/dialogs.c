@@ -199,8 +199,8 @@ delete_cookie_item(struct listbox_item *item, int last)
 	} else {
 		assert(!is_object_used(cookie));
 
+		journal_cookie(cookie, 1);
 		delete_cookie(cookie);
-		set_cookies_dirty();
 	}
 }
 
@@ -135,6 +135,40 @@ link_info_dialog(struct session *ses)
 }
 
 
+/* Says which parts of the document were rendered in a simpler way. */
+static void
+add_render_limits_to_string(struct string *msg, struct document *document,
+			    struct terminal *term)
+{
+	static const struct {
+		enum render_limit limit;
+		unsigned char *text;
+	} limits[] = {
+		{ RENDER_LIMIT_TABLE_DEPTH, N_("tables nested too deeply") },
+		{ RENDER_LIMIT_TABLE_CELLS, N_("tables with too many cells") },
+		{ RENDER_LIMIT_LAYOUT_WORK, N_("tables too costly to lay out") },
+		{ RENDER_LIMIT_LINE_WIDTH, N_("lines too long to wrap") },
+	};
+	unsigned char *separator = " (";
+	int i;
+
+	if (!document->render_limits) return;
+
+	add_format_to_string(msg, "\n%s: %s", _("Rendering", term),
+			     _("simplified", term));
+
+	for (i = 0; i < sizeof_array(limits); i++) {
+		if (!(document->render_limits & limits[i].limit))
+			continue;
+
+		add_to_string(msg, separator);
+		add_to_string(msg, _(limits[i].text, term));
+		separator = ", ";
+	}
+
+	add_char_to_string(msg, ')');
+}
+
 /* Location info. message box. */
 void
 document_info_dialog(struct session *ses)
@@ -190,6 +224,9 @@ document_info_dialog(struct session *ses)
 				add_format_to_string(&msg, " (%s)",
 						_("ignoring server setting", term));
 			}
+
+			add_render_limits_to_string(&msg, doc_view->document,
+						    term);
 		}
 
 		a = parse_header(cached->head, "Server", NULL);
@@ -215,6 +215,12 @@ get_resource_info(struct terminal *term, void *data)
 
 	val = get_cache_entry_loading_count();
 	val_add(n_("%ld loading", "%ld loading", val, term));
+#ifdef CONFIG_GZIP
+	add_to_string(&info, ", ");
+
+	val = get_cache_entry_compressed_count();
+	val_add(n_("%ld compressed", "%ld compressed", val, term));
+#endif
 	add_to_string(&info, ".\n");
 
 	add_to_string(&info, _("Document cache", term));
@@ -0,0 +1,311 @@
+/** Compact storage of rendered document lines
+ * @file
+ *
+ * Most neighbouring cells of a rendered line share their attributes and
+ * colors, which take most of the space of struct screen_char. A compacted
+ * line stores runs of cells with the same style, each referring to an
+ * entry of a per document style table, followed by the character values
+ * of the cells as bytes, or as unicode values if some do not fit in a
+ * byte. The screen chars are decoded again when the line is needed. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "elinks.h"
+
+#include "document/compact.h"
+#include "document/document.h"
+#include "terminal/draw.h"
+#include "util/error.h"
+#include "util/memory.h"
+
+
+/* How many decoded lines are kept around. This should cover a screenful
+ * of lines a few times over. */
+#define COMPACT_LINES_KEPT	512
+
+/* The longest run and the biggest style table the runs can refer to. */
+#define COMPACT_RUN_MAX		0xFFFF
+#define COMPACT_STYLES_MAX	0xFFFF
+
+#define COMPACT_HASH_SIZE	1024
+#define COMPACT_STYLES_GRANULARITY	0x3F
+
+struct compact_run {
+	unsigned short length;
+	unsigned short style;
+};
+
+struct compact_line {
+	/* The runs followed by the character values. */
+	unsigned char *data;
+	int runs;
+
+	/* Whether the character values are unicode_val_T and not bytes. */
+	unsigned int wide:1;
+};
+
+struct compact_style {
+	/* The attributes and colors. The data member is not used. */
+	struct screen_char schar;
+
+	/* The next style with the same hash or -1. */
+	int next;
+};
+
+struct compact_lines {
+	struct compact_style *styles;
+	int nstyles;
+	int hash[COMPACT_HASH_SIZE];
+
+	/* One item per compacted line of the document. Lines without any
+	 * data kept their screen chars. */
+	struct compact_line *lines;
+	int height;
+
+	/* Ring of the lines whose screen chars are currently decoded. */
+	int kept[COMPACT_LINES_KEPT];
+	int kept_pos;
+};
+
+
+static inline int
+same_compact_style(struct screen_char *a, struct screen_char *b)
+{
+	return a->attr == b->attr && !memcmp(&a->c, &b->c, sizeof(a->c));
+}
+
+static inline int
+hash_compact_style(struct screen_char *schar)
+{
+	unsigned char *c = (unsigned char *) &schar->c;
+	unsigned int hash = schar->attr;
+	int i;
+
+	for (i = 0; i < sizeof(schar->c); i++)
+		hash = hash * 31 + c[i];
+
+	return hash % COMPACT_HASH_SIZE;
+}
+
+/* Returns the index of the style of @schar in the style table or -1 if
+ * the table is full or could not be grown. */
+static int
+get_compact_style(struct compact_lines *compact, struct screen_char *schar)
+{
+	int hash = hash_compact_style(schar);
+	struct compact_style *style;
+	int i;
+
+	for (i = compact->hash[hash]; i >= 0; i = compact->styles[i].next)
+		if (same_compact_style(&compact->styles[i].schar, schar))
+			return i;
+
+	if (compact->nstyles >= COMPACT_STYLES_MAX
+	    || !mem_align_alloc(&compact->styles, compact->nstyles,
+				compact->nstyles + 1,
+				COMPACT_STYLES_GRANULARITY))
+		return -1;
+
+	i = compact->nstyles++;
+	style = &compact->styles[i];
+	copy_struct(&style->schar, schar);
+	style->schar.data = 0;
+	style->next = compact->hash[hash];
+	compact->hash[hash] = i;
+
+	return i;
+}
+
+/* Returns zero if the line could not be compacted. */
+static int
+compact_document_line(struct compact_lines *compact, struct line *line,
+		      struct compact_line *cline)
+{
+	struct screen_char *chars = line->chars;
+	int length = line->length;
+	struct compact_run *run = NULL;
+	unsigned char *values;
+	int runs = 0, wide = 0;
+	int run_length = 0;
+	int x;
+
+	for (x = 0; x < length; x++) {
+#ifdef CONFIG_UTF8
+		if (chars[x].data > 0xFF)
+			wide = 1;
+#endif
+		if (x && run_length < COMPACT_RUN_MAX
+		    && same_compact_style(&chars[x], &chars[x - 1])) {
+			run_length++;
+			continue;
+		}
+
+		runs++;
+		run_length = 1;
+	}
+
+	cline->data = mem_alloc(runs * sizeof(*run)
+				+ length * (wide ? sizeof(unicode_val_T) : 1));
+	if (!cline->data) return 0;
+
+	cline->runs = runs;
+	cline->wide = wide;
+	values = (unsigned char *) ((struct compact_run *) cline->data + runs);
+
+	for (x = 0; x < length; x++) {
+		if (!run || run->length >= COMPACT_RUN_MAX
+		    || !same_compact_style(&chars[x], &chars[x - 1])) {
+			int style = get_compact_style(compact, &chars[x]);
+
+			if (style < 0) {
+				mem_free_set(&cline->data, NULL);
+				return 0;
+			}
+
+			run = run ? run + 1 : (struct compact_run *) cline->data;
+			run->length = 0;
+			run->style = style;
+		}
+
+		run->length++;
+
+#ifdef CONFIG_UTF8
+		if (wide)
+			((unicode_val_T *) values)[x] = chars[x].data;
+		else
+#endif
+			values[x] = chars[x].data;
+	}
+
+	return 1;
+}
+
+void
+compact_document_lines(struct document *document)
+{
+	struct compact_lines *compact;
+	int i, y;
+
+	assert(document);
+	if_assert_failed return;
+
+	/* Lazily formatted lines are already small enough. */
+	if (document->lazy_lines || document->compact_lines
+	    || !document->height)
+		return;
+
+	compact = mem_calloc(1, sizeof(*compact));
+	if (!compact) return;
+
+	compact->lines = mem_calloc(document->height, sizeof(*compact->lines));
+	if (!compact->lines) {
+		mem_free(compact);
+		return;
+	}
+
+	compact->height = document->height;
+
+	for (i = 0; i < COMPACT_HASH_SIZE; i++)
+		compact->hash[i] = -1;
+
+	for (i = 0; i < COMPACT_LINES_KEPT; i++)
+		compact->kept[i] = -1;
+
+	for (y = 0; y < document->height; y++) {
+		struct line *line = &document->data[y];
+
+		if (!line->chars || !line->length)
+			continue;
+
+		/* Lines which cannot be compacted keep their screen
+		 * chars. */
+		if (compact_document_line(compact, line, &compact->lines[y]))
+			mem_free_set(&line->chars, NULL);
+	}
+
+	document->compact_lines = compact;
+}
+
+/* Returns zero on allocation failure. */
+static int
+decode_compact_line(struct compact_lines *compact, struct compact_line *cline,
+		    struct line *line)
+{
+	struct compact_run *runs = (struct compact_run *) cline->data;
+	unsigned char *values = (unsigned char *) (runs + cline->runs);
+	struct screen_char *chars;
+	int i, x = 0;
+
+	chars = mem_alloc(line->length * sizeof(*chars));
+	if (!chars) return 0;
+
+	for (i = 0; i < cline->runs; i++) {
+		struct screen_char *style = &compact->styles[runs[i].style].schar;
+		int end = x + runs[i].length;
+
+		for (; x < end; x++) {
+			copy_struct(&chars[x], style);
+#ifdef CONFIG_UTF8
+			if (cline->wide)
+				chars[x].data = ((unicode_val_T *) values)[x];
+			else
+#endif
+				chars[x].data = values[x];
+		}
+	}
+
+	assert(x == line->length);
+	line->chars = chars;
+
+	return 1;
+}
+
+struct line *
+get_compact_document_line(struct document *document, int y)
+{
+	struct compact_lines *compact = document->compact_lines;
+	struct line *line = &document->data[y];
+	int *kept;
+
+	assert(y >= 0 && y < document->height);
+
+	if (!compact || y >= compact->height || line->chars || !line->length)
+		return line;
+
+	if (!compact->lines[y].data
+	    || !decode_compact_line(compact, &compact->lines[y], line))
+		return &empty_document_line;
+
+	/* Drop the screen chars of the line decoded the longest time
+	 * ago. */
+	kept = &compact->kept[compact->kept_pos];
+	if (*kept >= 0 && *kept != y)
+		mem_free_set(&document->data[*kept].chars, NULL);
+
+	*kept = y;
+	compact->kept_pos = (compact->kept_pos + 1) % COMPACT_LINES_KEPT;
+
+	return line;
+}
+
+void
+done_compact_document_lines(struct document *document)
+{
+	struct compact_lines *compact = document->compact_lines;
+	int y;
+
+	if (!compact) return;
+
+	for (y = 0; y < compact->height; y++)
+		mem_free_if(compact->lines[y].data);
+
+	mem_free(compact->lines);
+	mem_free_if(compact->styles);
+	mem_free(compact);
+	document->compact_lines = NULL;
+}
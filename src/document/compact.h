@@ -0,0 +1,19 @@
+#ifndef EL__DOCUMENT_COMPACT_H
+#define EL__DOCUMENT_COMPACT_H
+
+struct document;
+struct line;
+
+/** Replace the screen chars of the rendered lines of the document with
+ * runs of indexes into a table of the attributes and colors used in the
+ * document followed by the bare character values. */
+void compact_document_lines(struct document *document);
+
+/** Decode the line @a y of a compacted document. Use get_document_line()
+ * instead of calling this directly. */
+struct line *get_compact_document_line(struct document *document, int y);
+
+/** Free the compacted lines of the document. */
+void done_compact_document_lines(struct document *document);
+
+#endif
@@ -47,13 +47,14 @@
 
 #include "cache/cache.h"
 #include "config/options.h"
+#include "document/compact.h"
 #include "document/document.h"
 #include "document/forms.h"
 #include "document/html/frames.h"
 #include "document/html/parser.h"
 #include "document/html/parser/parse.h"
-#include "document/html/renderer.h"
 #include "document/options.h"
+#include "document/plain/renderer.h"
 #include "document/refresh.h"
 #include "main/module.h"
 #include "main/object.h"
@@ -69,6 +70,8 @@
 
 static INIT_LIST_OF(struct document, format_cache);
 
+struct line empty_document_line;
+
 #ifdef HAVE_INET_NTOP
 /* DNS callback. */
 static void
@@ -202,6 +205,7 @@ done_document(struct document *document)
 	mem_free_if(document->title);
 	if (document->frame_desc) free_frameset_desc(document->frame_desc);
 	if (document->refresh) done_document_refresh(document->refresh);
+	if (document->next_uri) done_uri(document->next_uri);
 
 	if (document->links) {
 		int pos;
@@ -212,6 +216,9 @@ done_document(struct document *document)
 		mem_free(document->links);
 	}
 
+	done_plain_lazy_lines(document);
+	done_compact_document_lines(document);
+
 	if (document->data) {
 		int pos;
 
@@ -308,6 +315,7 @@ update_cached_document_options(struct session *ses)
 {
 	struct document *document;
 	struct active_link_options active_link;
+	int links_numbering_overlay;
 
 	memset(&active_link, 0, sizeof(active_link));	/* Safer. */
 	active_link.color.foreground = get_opt_color("document.browse.links.active_link.colors.text", ses);
@@ -317,8 +325,16 @@ update_cached_document_options(struct session *ses)
 	active_link.underline = get_opt_bool("document.browse.links.active_link.underline", ses);
 	active_link.bold = get_opt_bool("document.browse.links.active_link.bold", ses);
 
+	links_numbering_overlay = get_opt_bool("document.browse.links.numbering", ses)
+				  && get_opt_bool("document.browse.links.numbering_overlay", ses);
+
 	foreach (document, format_cache) {
 		copy_struct(&document->options.active_link, &active_link);
+
+		/* Documents formatted with the numbers in them keep them. */
+		document->options.links_numbering_overlay
+			= links_numbering_overlay
+			  && !document->options.links_numbering;
 	}
 }
 
@@ -432,7 +448,6 @@ static void
 done_documents(struct module *module)
 {
 	free_tags_lookup();
-	free_table_cache();
 }
 
 struct module document_module = struct_module(
@@ -1,7 +1,9 @@
 #ifndef EL__DOCUMENT_DOCUMENT_H
 #define EL__DOCUMENT_DOCUMENT_H
 
+#include "document/compact.h"
 #include "document/options.h"
+#include "document/plain/renderer.h"
 #include "intl/charsets.h" /* unicode_val_T */
 #include "main/object.h"
 #include "main/timer.h"
@@ -11,11 +13,13 @@
 #include "util/box.h"
 
 struct cache_entry;
+struct compact_lines;
 struct document_refresh;
 struct form_control;
 struct frame_desc;
 struct frameset_desc;
 struct module;
+struct plain_lazy_lines;
 struct screen_char;
 
 /** Nodes are used for marking areas of text on the document canvas as
@@ -43,6 +47,15 @@ enum cp_status {
 };
 
 
+/** Rendering limits that were reached, see document.html.limits */
+enum render_limit {
+	RENDER_LIMIT_TABLE_DEPTH = 1,
+	RENDER_LIMIT_TABLE_CELLS = 2,
+	RENDER_LIMIT_LAYOUT_WORK = 4,
+	RENDER_LIMIT_LINE_WIDTH = 8,
+};
+
+
 struct point {
 	int x, y;
 };
@@ -222,9 +235,22 @@ struct document {
 	struct frame_desc *frame;
 	struct frameset_desc *frame_desc; /**< @todo RENAME ME */
 	struct document_refresh *refresh;
+	/** The document linked with <link rel="next">, which is likely
+	 * to be visited next. */
+	struct uri *next_uri;
 
 	struct line *data;
 
+	/** The source and line index of a plain text document formatted
+	 * lazily. If set, the chars of the lines in #data may be NULL even
+	 * though the length is valid, so the lines must be accessed using
+	 * get_document_line(). */
+	struct plain_lazy_lines *lazy_lines;
+
+	/** The compacted lines of a rendered document. The chars of the
+	 * lines in #data are decoded from them by get_document_line(). */
+	struct compact_lines *compact_lines;
+
 	struct link *links;
 	/** @name Arrays with one item per rendered document's line.
 	 * @{ */
@@ -260,11 +286,36 @@ struct document {
 	} color;
 
 	enum cp_status cp_status;
+	/** The parts of the document that were rendered in a simpler way
+	 * because they were too costly to render properly. */
+	enum render_limit render_limits;
 	unsigned int links_sorted:1; /**< whether links are already sorted */
 };
 
 #define document_has_frames(document_) ((document_) && (document_)->frame_desc)
 
+/** A line without any chars returned when a line of a lazily formatted
+ * or compacted document could not be formatted or decoded. */
+extern struct line empty_document_line;
+
+/** Get the line @a y of the document, which must be less than the height.
+ * The chars of lazily formatted or compacted lines are dropped again after
+ * many other lines have been fetched so do not hold on to the pointer.
+ * @relates document */
+static inline struct line *
+get_document_line(struct document *document, int y)
+{
+	struct line *line = &document->data[y];
+
+	if (line->chars || !line->length)
+		return line;
+
+	if (document->compact_lines)
+		return get_compact_document_line(document, y);
+
+	return get_lazy_document_line(document, y);
+}
+
 /** Initializes a document and its canvas.
  * @returns NULL on allocation failure.
  * @relates document */
@@ -15,7 +15,6 @@
 #include "document/dom/source.h"
 #include "document/dom/util.h"
 #include "document/renderer.h"
-#include "dom/configuration.h"
 #include "dom/scanner.h"
 #include "dom/sgml/parser.h"
 #include "dom/sgml/html/html.h"
@@ -83,7 +82,6 @@ render_dom_document(struct cache_entry *cached, struct document *document,
 {
 	unsigned char *head = empty_string_or_(cached->head);
 	struct dom_renderer renderer;
-	struct dom_config config;
 	struct conv_table *convert_table;
 	struct sgml_parser *parser;
  	enum sgml_parser_type parser_type;
@@ -99,18 +97,20 @@ render_dom_document(struct cache_entry *cached, struct document *document,
 
 	init_dom_renderer(&renderer, document, buffer, convert_table);
 
+	get_doctype(&renderer, cached);
+
 	document->color.background = document->options.default_style.color.background;
 #ifdef CONFIG_UTF8
 	document->options.utf8 = is_cp_utf8(document->options.cp);
 #endif /* CONFIG_UTF8 */
 
-	if (document->options.plain)
+	/* The source and RSS renderers consume the nodes as they are
+	 * pushed and popped so there is no need to keep the tree around. */
+	if (document->options.plain || renderer.doctype == SGML_DOCTYPE_RSS)
 		parser_type = SGML_PARSER_STREAM;
 	else
 		parser_type = SGML_PARSER_TREE;
 
-	get_doctype(&renderer, cached);
-
 	parser = init_sgml_parser(parser_type, renderer.doctype, &uri, 0);
 	if (!parser) return;
 
@@ -121,7 +121,6 @@ render_dom_document(struct cache_entry *cached, struct document *document,
 	} else if (renderer.doctype == SGML_DOCTYPE_RSS) {
 		add_dom_stack_context(&parser->stack, &renderer,
 				      &dom_rss_renderer_context_info);
-		add_dom_config_normalizer(&parser->stack, &config, RSS_CONFIG_FLAGS);
 	}
 
 	/* FIXME: When rendering this way we don't really care about the code.
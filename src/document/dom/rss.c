@@ -4,6 +4,8 @@
 #include "config.h"
 #endif
 
+#include <ctype.h>
+
 #include "elinks.h"
 
 #include "document/css/css.h"
@@ -15,6 +17,7 @@
 #include "dom/sgml/rss/rss.h"
 #include "dom/node.h"
 #include "dom/stack.h"
+#include "dom/string.h"
 #include "intl/charsets.h"
 #include "util/error.h"
 #include "util/memory.h"
@@ -28,43 +31,114 @@ enum rss_style {
 	RSS_STYLES,
 };
 
+enum rss_text {
+	RSS_TEXT_TITLE,
+	RSS_TEXT_LINK,
+	RSS_TEXT_AUTHOR,
+	RSS_TEXT_DATE,
+	RSS_TEXTS,
+};
+
 struct rss_renderer {
 	/* The current item being processed; can be either a channel or
 	 * item element. */
 	struct dom_node *item;
 
+	/* The text of the child elements of the current item. The parser
+	 * frees the elements as soon as they are popped so their text is
+	 * collected here until the item is rendered. */
+	struct dom_string texts[RSS_TEXTS];
+
+	/* One bit per text which has been completed by the end of its
+	 * element. Only the first element of each kind is used. */
+	unsigned int complete;
+
 	/* One style per node type. */
 	struct screen_char styles[RSS_STYLES];
 };
 
 
+/* Returns which of the collected texts the @element belongs to or -1 if it
+ * is not a child of the current item holding any. */
+static int
+get_rss_text_index(struct rss_renderer *rss, struct dom_node *element)
+{
+	if (!rss->item || !element
+	    || element->type != DOM_NODE_ELEMENT
+	    || element->parent != rss->item)
+		return -1;
+
+	switch (element->data.element.type) {
+	case RSS_ELEMENT_TITLE:		return RSS_TEXT_TITLE;
+	case RSS_ELEMENT_LINK:		return RSS_TEXT_LINK;
+	case RSS_ELEMENT_AUTHOR:	return RSS_TEXT_AUTHOR;
+	case RSS_ELEMENT_PUBDATE:	return RSS_TEXT_DATE;
+	default:			return -1;
+	}
+}
+
 static struct dom_string *
-get_rss_text(struct dom_node *node, enum rss_element_type type)
+get_rss_text(struct rss_renderer *rss, enum rss_text index)
+{
+	struct dom_string *text = &rss->texts[index];
+
+	/* Drop the space left by whitespace at the end of the text. */
+	if (text->length && text->string[text->length - 1] == ' ')
+		text->length--;
+
+	return is_dom_string_set(text) ? text : NULL;
+}
+
+/* Appends @string to @text collapsing whitespace the way the DOM
+ * normalizer does for merged text nodes. */
+static enum dom_code
+add_rss_text(struct dom_string *text, struct dom_string *string)
 {
-	node = get_dom_node_child(node, DOM_NODE_ELEMENT, type);
+	unsigned char buf[256];
+	size_t i = 0;
+
+	while (i < string->length) {
+		int j;
+
+		for (j = 0; j < sizeof(buf) && i < string->length; i++) {
+			unsigned char data = string->string[i];
+
+			if (isspace(data)) {
+				unsigned char *last = j ? &buf[j - 1]
+					: text->length ? &text->string[text->length - 1]
+					: NULL;
 
-	if (!node) return NULL;
+				if (!last || *last == ' ')
+					continue;
 
-	node = get_dom_node_child(node, DOM_NODE_TEXT, 0);
+				data = ' ';
+			}
 
-	return node ? &node->string: NULL;
+			buf[j++] = data;
+		}
+
+		if (j && !add_to_dom_string(text, buf, j))
+			return DOM_CODE_ALLOC_ERR;
+	}
+
+	return DOM_CODE_OK;
 }
 
 static void
 render_rss_item(struct dom_renderer *renderer, struct dom_node *item)
 {
 	struct rss_renderer *rss = renderer->data;
-	struct dom_string *title  = get_rss_text(item, RSS_ELEMENT_TITLE);
-	struct dom_string *link   = get_rss_text(item, RSS_ELEMENT_LINK);
-	struct dom_string *author = get_rss_text(item, RSS_ELEMENT_AUTHOR);
-	struct dom_string *date   = get_rss_text(item, RSS_ELEMENT_PUBDATE);
+	struct dom_string *title  = get_rss_text(rss, RSS_TEXT_TITLE);
+	struct dom_string *link   = get_rss_text(rss, RSS_TEXT_LINK);
+	struct dom_string *author = get_rss_text(rss, RSS_TEXT_AUTHOR);
+	struct dom_string *date   = get_rss_text(rss, RSS_TEXT_DATE);
 
 	if (item->data.element.type == RSS_ELEMENT_ITEM) {
 		Y(renderer)++;
 		X(renderer) = 0;
 	}
 
-	if (title && is_dom_string_set(title)) {
+	if (title) {
 		if (item->data.element.type == RSS_ELEMENT_CHANNEL) {
 			unsigned char *str;
 
@@ -79,7 +153,7 @@ render_rss_item(struct dom_renderer *renderer, struct dom_node *item)
 				title->string, title->length);
 	}
 
-	if (link && is_dom_string_set(link)) {
+	if (link) {
 		X(renderer)++;
 		add_dom_link(renderer, "[link]", 6, link->string, link->length);
 	}
@@ -88,13 +162,13 @@ render_rss_item(struct dom_renderer *renderer, struct dom_node *item)
 	Y(renderer)++;
 	X(renderer) = 0;
 
-	if (author && is_dom_string_set(author)) {
+	if (author) {
 		render_dom_text(renderer, &rss->styles[RSS_STYLE_AUTHOR],
 				author->string, author->length);
 	}
 
-	if (date && is_dom_string_set(date)) {
-		if (author && is_dom_string_set(author)) {
+	if (date) {
+		if (author) {
 			render_dom_text(renderer, &rss->styles[RSS_STYLE_AUTHOR_DATE_SEP],
 					" - ", 3);
 		}
@@ -103,14 +177,23 @@ render_rss_item(struct dom_renderer *renderer, struct dom_node *item)
 				date->string, date->length);
 	}
 
-	if ((author && is_dom_string_set(author))
-	    || (date && is_dom_string_set(date))) {
+	if (author || date) {
 		/* New line, and indent */
 		Y(renderer)++;
 		X(renderer) = 0;
 	}
 }
 
+static void
+done_rss_texts(struct rss_renderer *rss)
+{
+	enum rss_text index;
+
+	for (index = 0; index < RSS_TEXTS; index++)
+		done_dom_string(&rss->texts[index]);
+	rss->complete = 0;
+}
+
 static void
 flush_rss_item(struct dom_renderer *renderer, struct rss_renderer *rss)
 {
@@ -118,6 +201,8 @@ flush_rss_item(struct dom_renderer *renderer, struct rss_renderer *rss)
 		render_rss_item(renderer, rss->item);
 		rss->item = NULL;
 	}
+
+	done_rss_texts(rss);
 }
 
 
@@ -149,18 +234,52 @@ dom_rss_pop_element(struct dom_stack *stack, struct dom_node *node, void *xxx)
 {
 	struct dom_renderer *renderer = stack->current->data;
 	struct rss_renderer *rss = renderer->data;
+	int index;
 
 	assert(node && node->parent && renderer && renderer->document);
 
 	switch (node->data.element.type) {
 	case RSS_ELEMENT_CHANNEL:
-		flush_rss_item(renderer, rss);
+	case RSS_ELEMENT_ITEM:
+		/* The item is freed right after this so render it now. */
+		if (node == rss->item)
+			flush_rss_item(renderer, rss);
 		break;
+
+	default:
+		index = get_rss_text_index(rss, node);
+		if (index >= 0 && is_dom_string_set(&rss->texts[index]))
+			rss->complete |= 1 << index;
 	}
 
 	return DOM_CODE_OK;
 }
 
+static enum dom_code
+dom_rss_pop_text(struct dom_stack *stack, struct dom_node *node, void *xxx)
+{
+	struct dom_renderer *renderer = stack->current->data;
+	struct rss_renderer *rss = renderer->data;
+	int index = get_rss_text_index(rss, node->parent);
+	struct dom_string *text;
+
+	if (index < 0 || (rss->complete & (1 << index)))
+		return DOM_CODE_OK;
+
+	text = &rss->texts[index];
+
+	if (node->type != DOM_NODE_ENTITY_REFERENCE)
+		return add_rss_text(text, &node->string);
+
+	/* Leave the entity reference for convert_string() to expand. */
+	if (!add_to_dom_string(text, "&", 1)
+	    || !add_to_dom_string(text, node->string.string, node->string.length)
+	    || !add_to_dom_string(text, ";", 1))
+		return DOM_CODE_ALLOC_ERR;
+
+	return DOM_CODE_OK;
+}
+
 
 static enum dom_code
 dom_rss_push_document(struct dom_stack *stack, struct dom_node *root, void *xxx)
@@ -218,12 +337,12 @@ dom_rss_pop_document(struct dom_stack *stack, struct dom_node *root, void *xxx)
 	struct dom_renderer *renderer = stack->current->data;
 	struct rss_renderer *rss = renderer->data;
 
+	done_rss_texts(rss);
 	mem_free(rss);
 
 	/* ELinks does not provide any sort of DOM access to the RSS
 	 * document after it has been rendered.  Tell the caller to
-	 * free the document node and all of its children.  Otherwise,
-	 * they would leak.  */
+	 * free the document node in case anything is left of it. */
 	return DOM_CODE_FREE_NODE;
 }
 
@@ -251,9 +370,9 @@ struct dom_stack_context_info dom_rss_renderer_context_info = {
 		/*				*/ NULL,
 		/* DOM_NODE_ELEMENT		*/ dom_rss_pop_element,
 		/* DOM_NODE_ATTRIBUTE		*/ NULL,
-		/* DOM_NODE_TEXT		*/ NULL,
-		/* DOM_NODE_CDATA_SECTION	*/ NULL,
-		/* DOM_NODE_ENTITY_REFERENCE	*/ NULL,
+		/* DOM_NODE_TEXT		*/ dom_rss_pop_text,
+		/* DOM_NODE_CDATA_SECTION	*/ dom_rss_pop_text,
+		/* DOM_NODE_ENTITY_REFERENCE	*/ dom_rss_pop_text,
 		/* DOM_NODE_ENTITY		*/ NULL,
 		/* DOM_NODE_PROC_INSTRUCTION	*/ NULL,
 		/* DOM_NODE_COMMENT		*/ NULL,
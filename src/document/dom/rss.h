@@ -5,9 +5,6 @@
 #include "dom/stack.h"
 
 
-#define RSS_CONFIG_FLAGS \
-	(DOM_CONFIG_NORMALIZE_WHITESPACE | DOM_CONFIG_NORMALIZE_CHARACTERS)
-
 extern struct dom_stack_context_info dom_rss_renderer_context_info;
 
 #endif
@@ -3,10 +3,13 @@
 #define EL__DOCUMENT_HTML_INTERNAL_H
 
 #include "document/css/stylesheet.h"
+#include "document/document.h"
 #include "document/html/parser.h"
 #include "util/lists.h"
 
 struct document_options;
+struct hash;
+struct renderer_context;
 struct uri;
 
 /* For parser/parse.c: */
@@ -61,6 +64,13 @@ struct html_context {
 	 * html/parser.c */
 	LIST_OF(struct html_element) stack;
 
+	/* For each element known to the parser, how many elements of that
+	 * kind are on the stack.  If there are none, the stack need not be
+	 * searched for one.  For:
+	 * html/parser/parse.c
+	 * html/parser/stack.c */
+	int *open_elements;
+
 	/* For parser/parse.c: */
 	unsigned char *eoff; /* For parser/forms.c too */
 	int line_breax; /* This is for ln_break. */
@@ -93,6 +103,22 @@ struct html_context {
 	 * html/tables.c */
 	int table_level;
 
+	/* For html/tables.c: */
+	/* The layout work spent on the tables so far, see
+	 * document.html.limits.layout_work. */
+	int layout_work;
+	/* Whether each table was laid out or flattened, keyed by where it
+	 * starts in the source, see charge_table_layout_work(). */
+	struct hash *table_layouts;
+
+	/* For:
+	 * html/parser/general.c
+	 * html/parser/table.c
+	 * html/renderer.c
+	 * html/tables.c */
+	/* The rendering limits that were reached. */
+	enum render_limit render_limits;
+
 	/* For:
 	 * html/parser/forms.c
 	 * html/parser/link.c
@@ -123,6 +149,9 @@ struct html_context {
 	 * html/parser/parse.c
 	 * html/parser.c */
 	void *(*special_f)(struct html_context *, enum html_special_type, ...);
+
+	/* For html/renderer.c */
+	struct renderer_context *renderer;
 };
 
 #define html_top	((struct html_element *) html_context->stack.next)
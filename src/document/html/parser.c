@@ -28,6 +28,7 @@
 #include "document/html/parser/parse.h"
 #include "document/html/parser.h"
 #include "document/html/renderer.h"
+#include "document/html/tables.h"
 #include "document/options.h"
 #include "document/renderer.h"
 #include "intl/charsets.h"
@@ -758,6 +759,13 @@ init_html_parser(struct uri *uri, struct document_options *options,
 	html_context = mem_calloc(1, sizeof(*html_context));
 	if (!html_context) return NULL;
 
+	html_context->open_elements = mem_calloc(get_html_elements_count(),
+						 sizeof(*html_context->open_elements));
+	if (!html_context->open_elements) {
+		mem_free(html_context);
+		return NULL;
+	}
+
 #ifdef CONFIG_CSS
 	html_context->css_styles.import = import_css_stylesheet;
 	init_css_selector_set(&html_context->css_styles.selectors);
@@ -814,6 +822,7 @@ init_html_parser(struct uri *uri, struct document_options *options,
 	html_top->invisible = 0;
 	html_top->name = NULL;
    	html_top->namelen = 0;
+	html_top->element_id = -1;
 	html_top->options = NULL;
 	html_top->linebreak = 1;
 	html_top->type = ELEMENT_DONT_KILL;
@@ -849,5 +858,7 @@ done_html_parser(struct html_context *html_context)
 		"html stack not empty after operation");
 	if_assert_failed init_list(html_context->stack);
 
+	done_table_layouts(html_context);
+	mem_free(html_context->open_elements);
 	mem_free(html_context);
 }
@@ -141,6 +141,12 @@ struct html_element {
 	unsigned char *name;
 	int namelen;
 
+	/* The index of the element in the table of known elements (see
+	 * get_html_element_id()), or -1 if the element has no name.  It is
+	 * counted in html_context.open_elements while the element is on
+	 * the stack. */
+	int element_id;
+
 	unsigned char *options;
 	/* See document/html/parser/parse.c's element_info.linebreak
 	 * description. */
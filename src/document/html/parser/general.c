@@ -662,12 +662,15 @@ void
 html_table(struct html_context *html_context, unsigned char *attr,
            unsigned char *html, unsigned char *eof, unsigned char **end)
 {
-	if (html_context->options->tables
-	    && html_context->table_level < HTML_MAX_TABLE_LEVEL) {
-		format_table(attr, html, eof, end, html_context);
-		ln_break(html_context, 2);
+	if (html_context->options->tables) {
+		if (html_context->table_level >= html_context->options->max_table_depth) {
+			html_context->render_limits |= RENDER_LIMIT_TABLE_DEPTH;
 
-		return;
+		} else if (!format_table(attr, html, eof, end, html_context)) {
+			ln_break(html_context, 2);
+
+			return;
+		}
 	}
 
 	par_format.leftmargin = par_format.rightmargin = html_context->margin;
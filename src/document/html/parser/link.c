@@ -826,6 +826,24 @@ html_link_parse(struct html_context *html_context, unsigned char *a,
 	return 1;
 }
 
+/* Remember the document likely to be visited next so it can be loaded
+ * in advance. */
+static void
+html_link_next(struct html_context *html_context, unsigned char *href)
+{
+	unsigned char *url = join_urls(html_context->base_href, href);
+	struct uri *uri;
+
+	if (!url) return;
+
+	uri = get_uri(url, 0);
+	mem_free(url);
+	if (!uri) return;
+
+	html_context->special_f(html_context, SP_NEXT_DOCUMENT, uri);
+	done_uri(uri);
+}
+
 void
 html_link(struct html_context *html_context, unsigned char *a,
           unsigned char *xxx3, unsigned char *xxx4, unsigned char **xxx5)
@@ -837,12 +855,12 @@ html_link(struct html_context *html_context, unsigned char *a,
 	int name_neq_title = 0;
 	int first = 1;
 
-#ifndef CONFIG_CSS
-	if (!link_display) return;
-#endif
 	if (!html_link_parse(html_context, a, &link)) return;
 	if (!link.href) goto free_and_return;
 
+	if (link.type == LT_NEXT && link.direction == LD_REL)
+		html_link_next(html_context, link.href);
+
 #ifdef CONFIG_CSS
 	if (link.type == LT_STYLESHEET
 	    && supports_html_media_attr(link.media)) {
@@ -851,9 +869,9 @@ html_link(struct html_context *html_context, unsigned char *a,
 		import_css_stylesheet(&html_context->css_styles,
 				      html_context->base_href, link.href, len);
 	}
+#endif
 
 	if (!link_display) goto free_and_return;
-#endif
 
 	/* Ignore few annoying links.. */
 	if (link_display < 5 &&
@@ -566,6 +566,46 @@ free_tags_lookup(void)
 #endif
 }
 
+static struct element_info *
+get_element_info(unsigned char *name, int namelen)
+{
+	struct element_info *ei;
+
+#ifndef USE_FASTFIND
+	{
+		struct element_info elem;
+		unsigned char tmp;
+
+		/* The name may be a string literal, which is already
+		 * terminated and must not be written to. */
+		tmp = name[namelen];
+		if (tmp) name[namelen] = '\0';
+
+		elem.name = name;
+		ei = bsearch(&elem, elements, NUMBER_OF_TAGS, sizeof(elem), compar);
+		if (tmp) name[namelen] = tmp;
+	}
+#else
+	ei = (struct element_info *) fastfind_search(&ff_tags_index, name, namelen);
+#endif
+
+	return ei;
+}
+
+int
+get_html_element_id(unsigned char *name, int namelen)
+{
+	struct element_info *ei = get_element_info(name, namelen);
+
+	return ei ? ei - elements : -1;
+}
+
+int
+get_html_elements_count(void)
+{
+	return NUMBER_OF_TAGS;
+}
+
 
 static unsigned char *process_element(unsigned char *name, int namelen, int endingtag,
                 unsigned char *html, unsigned char *prev_html,
@@ -898,8 +938,13 @@ start_element(struct element_info *ei,
 	 * The effect is to close automatically any <hN>, <p>, or <li> tag that
 	 * encloses the current tag if it is of the same element, ignoring any
 	 * intervening inline elements.
+	 *
+	 * Nothing can be found if no element of this kind is open, and then
+	 * the search is skipped, as walking through thousands of unclosed
+	 * inline elements for every <p> makes some broken pages quadratic.
 	 */
-	if (ei->type == ET_NON_NESTABLE || ei->type == ET_LI) {
+	if ((ei->type == ET_NON_NESTABLE || ei->type == ET_LI)
+	    && html_context->open_elements[ei - elements]) {
 		struct html_element *e;
 
 		if (ei->type == ET_NON_NESTABLE) {
@@ -930,6 +975,8 @@ start_element(struct element_info *ei,
 	html_top->namelen = namelen;
 	html_top->options = attr;
 	html_top->linebreak = ei->linebreak;
+	html_top->element_id = ei - elements;
+	html_context->open_elements[html_top->element_id]++;
 
 	/* If the element has an onClick handler for scripts, make it
 	 * clickable. */
@@ -1085,7 +1132,13 @@ end_element(struct element_info *ei,
 	 * place an opening double-quotation mark before the text and no closing
 	 * mark.  "he said." will be rendered normally.  "So do I," will be
 	 * rendered using single-quotation marks (as for a quotation within a
-	 * quotation).  "she said." will be rendered normally.  */
+	 * quotation).  "she said." will be rendered normally.
+	 *
+	 * If no element of this kind is open at all, the search cannot find
+	 * anything and is skipped.  */
+	if (!html_context->open_elements[ei - elements])
+		return html;
+
 	foreach (e, html_context->stack) {
 		if (is_block_element(e) && is_inline_element(ei)) kill = 1;
 		if (c_strlcasecmp(e->name, e->namelen, name, namelen)) {
@@ -1130,23 +1183,8 @@ process_element(unsigned char *name, int namelen, int endingtag,
                 struct html_context *html_context)
 
 {
-	struct element_info *ei;
+	struct element_info *ei = get_element_info(name, namelen);
 
-#ifndef USE_FASTFIND
-	{
-		struct element_info elem;
-		unsigned char tmp;
-
-		tmp = name[namelen];
-		name[namelen] = '\0';
-
-		elem.name = name;
-		ei = bsearch(&elem, elements, NUMBER_OF_TAGS, sizeof(elem), compar);
-		name[namelen] = tmp;
-	}
-#else
-	ei = (struct element_info *) fastfind_search(&ff_tags_index, name, namelen);
-#endif
 	if (html_context->was_xmp || html_context->was_style) {
 		if (!ei || (ei->open != html_xmp && ei->open != html_style) || !endingtag) {
 			put_chrs(html_context, "<", 1);
@@ -71,6 +71,16 @@ void scan_http_equiv(unsigned char *s, unsigned char *eof, struct string *head,
 int supports_html_media_attr(const unsigned char *media);
 
 
+/* Interface for the stack handling */
+
+/* Returns the index of the element called @name in the table of elements
+ * known to the parser, or -1 if the element is not known. */
+int get_html_element_id(unsigned char *name, int namelen);
+
+/* Returns the number of elements known to the parser. */
+int get_html_elements_count(void);
+
+
 /* Lifecycle functions for the tags fastfind cache, if being in use. */
 
 void free_tags_lookup(void);
@@ -51,10 +51,15 @@ search_html_stack(struct html_context *html_context, unsigned char *name)
 {
 	struct html_element *element;
 	int namelen;
+	int id;
 
 	assert(name && *name);
 	namelen = strlen(name);
 
+	id = get_html_element_id(name, namelen);
+	if (id >= 0 && !html_context->open_elements[id])
+		return NULL;
+
 #if 0	/* Debug code. Please keep. */
 	dump_html_stack(html_context);
 #endif
@@ -120,6 +125,9 @@ kill_html_stack_item(struct html_context *html_context, struct html_element *e)
 	mem_free_if(e->attr.onmouseout);
 	mem_free_if(e->attr.onblur);
 
+	if (e->element_id >= 0)
+		html_context->open_elements[e->element_id]--;
+
 	del_from_list(e);
 	mem_free(e);
 #if 0
@@ -171,6 +179,7 @@ html_stack_dup(struct html_context *html_context, enum html_element_mortality_ty
 
 	e->name = e->options = NULL;
 	e->namelen = 0;
+	e->element_id = -1;
 	e->type = type;
 
 	add_to_list(html_context->stack, e);
@@ -194,16 +203,41 @@ kill_element(struct html_context *html_context, int ls, struct html_element *e)
 	ln_break(html_context, l);
 }
 
+/* Returns whether an element called like one of the names in @arg may
+ * be on the stack. */
+static int
+may_be_on_html_stack(struct html_context *html_context, va_list arg)
+{
+	while (1) {
+		unsigned char *s = va_arg(arg, unsigned char *);
+		int id;
+
+		if (!s) return 0;
+		if (!*s) continue;
+
+		id = get_html_element_id(s, strlen(s));
+		if (id < 0 || html_context->open_elements[id])
+			return 1;
+	}
+}
+
 void
 kill_html_stack_until(struct html_context *html_context, int ls, ...)
 {
 	struct html_element *e = html_top;
+	va_list arg;
+	int found;
+
+	/* Don't walk the stack if there is nothing to find there. */
+	va_start(arg, ls);
+	found = may_be_on_html_stack(html_context, arg);
+	va_end(arg);
+	if (!found) return;
 
 	if (ls) e = e->next;
 
 	while ((void *) e != &html_context->stack) {
 		int sk = 0;
-		va_list arg;
 
 		va_start(arg, ls);
 		while (1) {
@@ -397,6 +397,13 @@ new_cell(struct table *table, int dest_col, int dest_row)
 	if (dest_col < table->cols && dest_row < table->rows)
 		return CELL(table, dest_col, dest_row);
 
+	if (table->max_cells
+	    && int_max(dest_col + 1, table->cols)
+	       > table->max_cells / int_max(dest_row + 1, table->rows)) {
+		table->too_many_cells = 1;
+		return NULL;
+	}
+
 	while (1) {
 		struct table new;
 		int limit;
@@ -566,6 +573,7 @@ parse_table(unsigned char *html, unsigned char *eof, unsigned char **end,
 	table = new_table();
 	if (!table) return NULL;
 
+	table->max_cells = html_context->options->max_table_cells;
 	parse_table_attributes(table, attr, sh, html_context);
 	last_bgcolor = table->color.background;
 
@@ -898,6 +906,8 @@ see:
 	goto see;
 
 scan_done:
+	if (table->too_many_cells) goto abort;
+
 	*end = html;
 
 	mem_free_if(l_fragment_id);
@@ -927,7 +937,10 @@ scan_done:
 	return table;
 
 abort:
-	*end = eof;
+	if (table->too_many_cells)
+		html_context->render_limits |= RENDER_LIMIT_TABLE_CELLS;
+	else
+		*end = eof;
 	free_table(table);
 	return NULL;
 }
@@ -106,7 +106,11 @@ struct table {
 
 	int link_num;
 
+	/* See document.html.limits.table_cells, 0 for no limit. */
+	int max_cells;
+
 	unsigned int full_width:1;
+	unsigned int too_many_cells:1;
 
 	struct html_start_end caption;
 	int caption_height;
@@ -116,6 +120,8 @@ struct table {
 
 #define CELL(table, col, row) (&(table)->cells[(row) * (table)->real_cols + (col)])
 
+/* Returns NULL and leaves *@end at @html if the table has more cells than
+ * document.html.limits.table_cells allows. */
 struct table *
 parse_table(unsigned char *html, unsigned char *eof, unsigned char **end,
 	    unsigned char *attr, int sh, struct html_context *html_context);
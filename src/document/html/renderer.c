@@ -89,11 +89,10 @@ struct table_cache_entry {
 /* Max. entries in table cache used for nested tables. */
 #define MAX_TABLE_CACHE_ENTRIES 16384
 
-/* Global variables */
-static int table_cache_entries;
-static struct hash *table_cache;
-
 
+/* The state of rendering one document. It is kept apart from the state of
+ * the rendering of any other document so that nothing is carried over from
+ * one document to the next. */
 struct renderer_context {
 	int last_link_to_move;
 	struct tag *last_tag_to_move;
@@ -121,9 +120,14 @@ struct renderer_context {
 	unsigned int nobreak:1;
 	unsigned int nosearchable:1;
 	unsigned int nowrap:1; /* Activated/deactivated by SP_NOWRAP. */
+	unsigned int hard_wrap:1; /* Set by split_line() until line_break(). */
+
+	/* Parts of the nested tables rendered so far. */
+	struct hash *table_cache;
+	int table_cache_entries;
 };
 
-static struct renderer_context renderer_context;
+#define renderer_context	(*html_context->renderer)
 
 
 /* Prototypes */
@@ -957,8 +961,11 @@ del_chars(struct html_context *html_context, int x, int y)
 #endif
 #define overlap(x) int_max(overlap_width(x) - (x).rightmargin, 0)
 
+/* Splits the line at @width.  The character there is normally the space
+ * at which the line is wrapped, and it is dropped.  If @hard is set, or
+ * the character is double-width, it goes to the new line instead. */
 static int inline
-split_line_at(struct html_context *html_context, int width)
+split_line_at(struct html_context *html_context, int width, int hard)
 {
 	struct part *part;
 	int tmp;
@@ -972,6 +979,12 @@ split_line_at(struct html_context *html_context, int width)
 	assert(part);
 	if_assert_failed return 0;
 
+#ifdef CONFIG_UTF8
+	if (html_context->options->utf8
+	    && width < part->spaces_len && part->char_width[width] == 2)
+		hard = 1;
+#endif
+
 	/* Make sure that we count the right margin to the total
 	 * actual box width. */
 	int_lower_bound(&part->box.width, new_width);
@@ -979,14 +992,11 @@ split_line_at(struct html_context *html_context, int width)
 	if (part->document) {
 		assert(part->document->data);
 		if_assert_failed return 0;
-#ifdef CONFIG_UTF8
-		if (html_context->options->utf8
-		    && width < part->spaces_len && part->char_width[width] == 2) {
+
+		if (hard) {
 			move_chars(html_context, width, part->cy, par_format.leftmargin, part->cy + 1);
 			del_chars(html_context, width, part->cy);
-		} else
-#endif
-		{
+		} else {
 			assertm(POS(width, part->cy).data == ' ',
 					"bad split: %c", POS(width, part->cy).data);
 			move_chars(html_context, width + 1, part->cy, par_format.leftmargin, part->cy + 1);
@@ -995,11 +1005,7 @@ split_line_at(struct html_context *html_context, int width)
 		}
 	}
 
-#ifdef CONFIG_UTF8
-	if (!(html_context->options->utf8
-	      && width < part->spaces_len
-	      && part->char_width[width] == 2))
-#endif
+	if (!hard)
 		width++; /* Since we were using (x + 1) only later... */
 
 	tmp = part->spaces_len - width;
@@ -1073,7 +1079,7 @@ split_line(struct html_context *html_context)
 				 * double-width characters we print two
 				 * double-width characters. */
 				&& x != par_format.leftmargin)))
-				return split_line_at(html_context, x);
+				return split_line_at(html_context, x, 0);
 		}
 
 		for (x = par_format.leftmargin; x < part->cx ; x++) {
@@ -1082,18 +1088,44 @@ split_line(struct html_context *html_context)
 				/* We want to break line after _second_
 				 * double-width character. */
 				&& x > par_format.leftmargin)))
-				return split_line_at(html_context, x);
+				return split_line_at(html_context, x, 0);
 		}
 	} else
 #endif
 	{
 		for (x = overlap(par_format); x >= par_format.leftmargin; x--)
 			if (x < part->spaces_len && part->spaces[x])
-				return split_line_at(html_context, x);
+				return split_line_at(html_context, x, 0);
 
 		for (x = par_format.leftmargin; x < part->cx ; x++)
 			if (x < part->spaces_len && part->spaces[x])
-				return split_line_at(html_context, x);
+				return split_line_at(html_context, x, 0);
+	}
+
+	/* There is no space to wrap the line at.  Once the line gets longer
+	 * than document.html.limits.line_width, it and the rest of the
+	 * paragraph are broken at the paragraph width, because searching
+	 * an ever longer line for spaces after every chunk of text takes
+	 * quadratic time. */
+	if (!renderer_context.hard_wrap
+	    && html_context->options->max_line_width
+	    && part->cx > html_context->options->max_line_width) {
+		renderer_context.hard_wrap = 1;
+		html_context->render_limits |= RENDER_LIMIT_LINE_WIDTH;
+	}
+
+	if (renderer_context.hard_wrap) {
+		x = int_max(overlap(par_format), par_format.leftmargin + 1);
+#ifdef CONFIG_UTF8
+		/* Don't break a double-width character in two. */
+		if (html_context->options->utf8
+		    && x - 1 > par_format.leftmargin
+		    && x - 1 < part->spaces_len
+		    && part->char_width[x - 1] == 2)
+			x--;
+#endif
+		if (x < part->cx)
+			return split_line_at(html_context, x, 1);
 	}
 
 	/* Make sure that we count the right margin to the total
@@ -1453,7 +1485,8 @@ new_link(struct html_context *html_context, unsigned char *name, int namelen)
 }
 
 static void
-html_special_tag(struct document *document, unsigned char *t, int x, int y)
+html_special_tag(struct html_context *html_context, struct document *document,
+		 unsigned char *t, int x, int y)
 {
 	struct tag *tag;
 	int tag_len;
@@ -1539,7 +1572,8 @@ put_link_number(struct html_context *html_context)
 	assertm(!(old), "Old link value [%s]. New value [%s]", old, new);
 
 static inline void
-init_link_state_info(unsigned char *link, unsigned char *target,
+init_link_state_info(struct html_context *html_context,
+		     unsigned char *link, unsigned char *target,
 		     unsigned char *image, struct form_control *form)
 {
 	assert_link_variable(renderer_context.link_state_info.image, image);
@@ -1553,7 +1587,7 @@ init_link_state_info(unsigned char *link, unsigned char *target,
 }
 
 static inline void
-done_link_state_info(void)
+done_link_state_info(struct html_context *html_context)
 {
 	mem_free_if(renderer_context.link_state_info.link);
 	mem_free_if(renderer_context.link_state_info.target);
@@ -1612,7 +1646,7 @@ process_link(struct html_context *html_context, enum link_state link_state,
 	case LINK_STATE_NEW:
 		part->link_num++;
 
-		init_link_state_info(format.link, format.target,
+		init_link_state_info(html_context, format.link, format.target,
 				     format.image, format.form);
 		if (!part->document) return;
 
@@ -1688,7 +1722,7 @@ get_link_state(struct html_context *html_context)
 		state = LINK_STATE_NEW;
 	}
 
-	done_link_state_info();
+	done_link_state_info(html_context);
 
 	return state;
 }
@@ -1845,6 +1879,8 @@ line_break(struct html_context *html_context)
 
 	int_lower_bound(&part->box.width, part->cx + par_format.rightmargin);
 
+	renderer_context.hard_wrap = 0;
+
 	if (renderer_context.nobreak) {
 		renderer_context.nobreak = 0;
 		part->cx = -1;
@@ -1954,7 +1990,8 @@ html_special_form(struct part *part, struct form *form)
 }
 
 static void
-html_special_form_control(struct part *part, struct form_control *fc)
+html_special_form_control(struct html_context *html_context,
+			  struct part *part, struct form_control *fc)
 {
 	struct form *form;
 
@@ -2128,7 +2165,8 @@ html_special(struct html_context *html_context, enum html_special_type c, ...)
 			if (document) {
 				unsigned char *t = va_arg(l, unsigned char *);
 
-				html_special_tag(document, t, X(part->cx), Y(part->cy));
+				html_special_tag(html_context, document, t,
+						 X(part->cx), Y(part->cy));
 			}
 			break;
 		case SP_FORM:
@@ -2142,7 +2180,7 @@ html_special(struct html_context *html_context, enum html_special_type c, ...)
 		{
 			struct form_control *fc = va_arg(l, struct form_control *);
 
-			html_special_form_control(part, fc);
+			html_special_form_control(html_context, part, fc);
 			break;
 		}
 		case SP_TABLE:
@@ -2232,6 +2270,13 @@ html_special(struct html_context *html_context, enum html_special_type c, ...)
 			}
 #endif
 			break;
+		case SP_NEXT_DOCUMENT:
+			if (document && !document->next_uri) {
+				struct uri *uri = va_arg(l, struct uri *);
+
+				document->next_uri = get_uri_reference(uri);
+			}
+			break;
 	}
 
 	va_end(l);
@@ -2240,19 +2285,19 @@ html_special(struct html_context *html_context, enum html_special_type c, ...)
 }
 
 void
-free_table_cache(void)
+free_table_cache(struct html_context *html_context)
 {
-	if (table_cache) {
+	if (renderer_context.table_cache) {
 		struct hash_item *item;
 		int i;
 
 		/* We do not free key here. */
-		foreach_hash_item (item, *table_cache, i) {
+		foreach_hash_item (item, *renderer_context.table_cache, i) {
 			mem_free_if(item->value);
 		}
 
-		free_hash(&table_cache);
-		table_cache_entries = 0;
+		free_hash(&renderer_context.table_cache);
+		renderer_context.table_cache_entries = 0;
 	}
 }
 
@@ -2271,8 +2316,8 @@ format_html_part(struct html_context *html_context,
 	int saved_last_link_to_move = renderer_context.last_link_to_move;
 
 	/* Hash creation if needed. */
-	if (!table_cache) {
-		table_cache = init_hash8();
+	if (!renderer_context.table_cache) {
+		renderer_context.table_cache = init_hash8();
 	} else if (!document) {
 		/* Search for cached entry. */
 		struct table_cache_entry_key key;
@@ -2290,7 +2335,7 @@ format_html_part(struct html_context *html_context,
 		key.x = x;
 		key.link_num = link_num;
 
-		item = get_hash_item(table_cache,
+		item = get_hash_item(renderer_context.table_cache,
 				     (unsigned char *) &key,
 				     sizeof(key));
 		if (item) { /* We found it in cache, so just copy and return. */
@@ -2328,7 +2373,7 @@ format_html_part(struct html_context *html_context,
 	html_context->margin = margin;
 	renderer_context.empty_format = !document;
 
-	done_link_state_info();
+	done_link_state_info(html_context);
 	renderer_context.nobreak = 1;
 
 	part = mem_calloc(1, sizeof(*part));
@@ -2351,7 +2396,7 @@ format_html_part(struct html_context *html_context,
 
 	renderer_context.nobreak = 0;
 
-	done_link_state_info();
+	done_link_state_info(html_context);
 	mem_free_if(part->spaces);
 #ifdef CONFIG_UTF8
 	mem_free_if(part->char_width);
@@ -2371,8 +2416,8 @@ ret:
 	html_context->margin = saved_margin;
 
 	if (html_context->table_level > 1 && !document
-	    && table_cache
-	    && table_cache_entries < MAX_TABLE_CACHE_ENTRIES) {
+	    && renderer_context.table_cache
+	    && renderer_context.table_cache_entries < MAX_TABLE_CACHE_ENTRIES) {
 		/* Create a new entry. */
 		/* Clear memory to prevent bad key comparaison due to alignment
 		 * of key fields. */
@@ -2388,12 +2433,12 @@ ret:
 			tce->key.link_num = link_num;
 			copy_struct(&tce->part, part);
 
-			if (!add_hash_item(table_cache,
+			if (!add_hash_item(renderer_context.table_cache,
 					   (unsigned char *) &tce->key,
 					   sizeof(tce->key), tce)) {
 				mem_free(tce);
 			} else {
-				table_cache_entries++;
+				renderer_context.table_cache_entries++;
 			}
 		}
 	}
@@ -2428,7 +2473,14 @@ render_html_document(struct cache_entry *cached, struct document *document,
 	                                html_special);
 	if (!html_context) return;
 
-	renderer_context.g_ctrl_num = 0;
+	html_context->renderer = mem_calloc(1, sizeof(*html_context->renderer));
+	if (!html_context->renderer) {
+		done_html_parser(html_context);
+		done_string(&head);
+		done_string(&title);
+		return;
+	}
+
 	renderer_context.cached = cached;
 	renderer_context.convert_table = get_convert_table(head.source,
 							   document->options.cp,
@@ -2481,7 +2533,11 @@ render_html_document(struct cache_entry *cached, struct document *document,
 #endif
 
 	document->color.background = par_format.color.background;
+	document->render_limits = html_context->render_limits;
 
+	done_link_state_info(html_context);
+	free_table_cache(html_context);
+	mem_free(html_context->renderer);
 	done_html_parser(html_context);
 
 	/* Drop forms which has been serving as a placeholder for form items
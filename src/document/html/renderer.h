@@ -30,6 +30,7 @@ enum html_special_type {
 	SP_STYLESHEET,
 	SP_COLOR_LINK_LINES,
 	SP_SCRIPT,
+	SP_NEXT_DOCUMENT,
 };
 
 
@@ -64,7 +65,7 @@ void check_html_form_hierarchy(struct part *part);
 void draw_frame_hchars(struct part *, int, int, int, unsigned char data, color_T bgcolor, color_T fgcolor, struct html_context *html_context);
 void draw_frame_vchars(struct part *, int, int, int, unsigned char data, color_T bgcolor, color_T fgcolor, struct html_context *html_context);
 
-void free_table_cache(void);
+void free_table_cache(struct html_context *html_context);
 
 struct part *format_html_part(struct html_context *html_context, unsigned char *, unsigned char *, int, int, int, struct document *, int, int, unsigned char *, int);
 
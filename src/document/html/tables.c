@@ -19,6 +19,7 @@
 #include "util/color.h"
 #include "util/conv.h"
 #include "util/error.h"
+#include "util/hash.h"
 #include "util/memory.h"
 #include "util/string.h"
 
@@ -1269,7 +1270,131 @@ distribute_table_widths(struct table *table)
 	distribute_widths(table, width);
 }
 
+/* Returns how many different colspan and rowspan values the cells of
+ * @table have, or -1 on error.  Laying out the table goes through all
+ * of its cells once for each of these values, see get_column_widths(),
+ * check_table_widths() and get_table_heights(). */
+static int
+count_table_spans(struct table *table)
+{
+	unsigned char *colspans, *rowspans;
+	int col, row;
+	int spans = 0;
+
+	colspans = mem_calloc(table->cols + 1, sizeof(*colspans));
+	if (!colspans) return -1;
+
+	rowspans = mem_calloc(table->rows + 1, sizeof(*rowspans));
+	if (!rowspans) {
+		mem_free(colspans);
+		return -1;
+	}
+
+	for (col = 0; col < table->cols; col++) for (row = 0; row < table->rows; row++) {
+		struct table_cell *cell = CELL(table, col, row);
+
+		if (cell->is_spanned || !cell->is_used) continue;
+
+		if (cell->colspan > 0 && cell->colspan <= table->cols
+		    && !colspans[cell->colspan]) {
+			colspans[cell->colspan] = 1;
+			spans++;
+		}
+
+		if (cell->rowspan > 0 && cell->rowspan <= table->rows
+		    && !rowspans[cell->rowspan]) {
+			rowspans[cell->rowspan] = 1;
+			spans++;
+		}
+	}
+
+	mem_free(rowspans);
+	mem_free(colspans);
+
+	return spans;
+}
+
+/* Whether the table starting at @html is laid out or flattened. */
+struct table_layout {
+	unsigned char *html;
+	unsigned int flatten:1;
+};
+
+/* Charges the work of laying out @table, which starts at @html, to the
+ * document, see document.html.limits.layout_work.  Returns 0 if there is
+ * not enough left for it.
+ *
+ * A nested table is formatted again in every pass over the table it is
+ * in.  The decision is made the first time and kept, because the passes
+ * measuring the outer table and the one drawing it have to agree. */
+static int
+charge_table_layout_work(struct html_context *html_context,
+			 struct table *table, unsigned char *html)
+{
+	struct document_options *options = html_context->options;
+	struct table_layout *layout;
+	struct hash_item *item;
+	int cells = table->cols * table->rows;
+	int passes, work_left;
+
+	if (!options->max_layout_work) return 1;
+
+	if (!html_context->table_layouts) {
+		html_context->table_layouts = init_hash8();
+		if (!html_context->table_layouts) return 0;
+	}
+
+	item = get_hash_item(html_context->table_layouts,
+			     (unsigned char *) &html, sizeof(html));
+	if (item) {
+		layout = item->value;
+		return !layout->flatten;
+	}
+
+	passes = count_table_spans(table);
+	if (passes < 0) return 0;
+	passes++; /* For the passes that do not depend on the spans. */
+
+	layout = mem_alloc(sizeof(*layout));
+	if (!layout) return 0;
+
+	layout->html = html;
+	if (!add_hash_item(html_context->table_layouts,
+			   (unsigned char *) &layout->html,
+			   sizeof(layout->html), layout)) {
+		mem_free(layout);
+		return 0;
+	}
+
+	work_left = options->max_layout_work - html_context->layout_work;
+	layout->flatten = cells > work_left / passes;
+	if (layout->flatten) {
+		html_context->render_limits |= RENDER_LIMIT_LAYOUT_WORK;
+		return 0;
+	}
+
+	html_context->layout_work += cells * passes;
+	return 1;
+}
+
 void
+done_table_layouts(struct html_context *html_context)
+{
+	struct hash_item *item;
+	int i;
+
+	if (!html_context->table_layouts) return;
+
+	foreach_hash_item (item, *html_context->table_layouts, i)
+		mem_free(item->value);
+
+	free_hash(&html_context->table_layouts);
+}
+
+/* Returns 0 if the table was formatted and -1 if it was too costly to lay
+ * out.  In the latter case, *@end is left at @html and the caller should
+ * render the contents of the table as if tables were disabled. */
+int
 format_table(unsigned char *attr, unsigned char *html, unsigned char *eof,
 	     unsigned char **end, struct html_context *html_context)
 {
@@ -1278,12 +1403,24 @@ format_table(unsigned char *attr, unsigned char *html, unsigned char *eof,
 	struct node *node, *new_node;
 	struct html_element *state;
 	int indent, margins;
+	int ret = 0;
 
 	html_context->table_level++;
 
 	table = parse_table(html, eof, end, attr, (part->document || part->box.x),
 	                    html_context);
-	if (!table) goto ret0;
+	if (!table) {
+		/* The table has too many cells, see parse_table(). */
+		if (*end == html) ret = -1;
+		goto ret0;
+	}
+
+	if (!charge_table_layout_work(html_context, table, html)) {
+		free_table(table);
+		*end = html;
+		ret = -1;
+		goto ret0;
+	}
 
 	table->part = part;
 
@@ -1354,5 +1491,7 @@ ret2:
 
 ret0:
 	html_context->table_level--;
-	if (!html_context->table_level) free_table_cache();
+	if (!html_context->table_level) free_table_cache(html_context);
+
+	return ret;
 }
@@ -4,6 +4,7 @@
 
 struct html_context;
 
-void format_table(unsigned char *, unsigned char *, unsigned char *, unsigned char **, struct html_context *);
+int format_table(unsigned char *, unsigned char *, unsigned char *, unsigned char **, struct html_context *);
+void done_table_layouts(struct html_context *);
 
 #endif
@@ -64,10 +64,19 @@ init_document_options(struct session *ses, struct document_options *doo)
 
 	doo->plain_display_links = get_opt_bool("document.plain.display_links", ses);
 	doo->plain_compress_empty_lines = get_opt_bool("document.plain.compress_empty_lines", ses);
+	doo->plain_lazy_size = get_opt_int("document.plain.lazy_size", ses);
+	doo->max_table_depth = get_opt_int("document.html.limits.table_depth", ses);
+	doo->max_table_cells = get_opt_int("document.html.limits.table_cells", ses);
+	doo->max_layout_work = get_opt_int("document.html.limits.layout_work", ses);
+	doo->max_line_width = get_opt_int("document.html.limits.line_width", ses);
 	doo->underline_links = get_opt_bool("document.html.underline_links", ses);
 	doo->wrap_nbsp = get_opt_bool("document.html.wrap_nbsp", ses);
 	doo->use_tabindex = get_opt_bool("document.browse.links.use_tabindex", ses);
 	doo->links_numbering = get_opt_bool("document.browse.links.numbering", ses);
+	if (get_opt_bool("document.browse.links.numbering_overlay", ses)) {
+		doo->links_numbering_overlay = doo->links_numbering;
+		doo->links_numbering = 0;
+	}
 
 	doo->active_link.enable_color = get_opt_bool("document.browse.links.active_link.enable_color", ses);
 	doo->active_link.invert = get_opt_bool("document.browse.links.active_link.invert", ses);
@@ -97,8 +106,6 @@ compare_opt(struct document_options *o1, struct document_options *o2)
 {
 	return memcmp(o1, o2, offsetof(struct document_options, framename))
 		|| c_strcasecmp(o1->framename, o2->framename)
-		|| (o1->box.x != o2->box.x)
-		|| (o1->box.y != o2->box.y)
 		|| ((o1->needs_height || o2->needs_height)
 		    && o1->box.height != o2->box.height)
 		|| ((o1->needs_width || o2->needs_width)
@@ -55,6 +55,16 @@ struct document_options {
 	int use_document_colors;
 	int meta_link_display;
 	int default_form_input_size;
+	int plain_lazy_size;
+
+	/** @name Rendering limits
+	 * See document.html.limits.  0 means no limit.
+	 * @{ */
+	int max_table_depth;
+	int max_table_cells;
+	int max_layout_work;
+	int max_line_width;
+	/** @} */
 
 	/** @name The default (fallback) colors.
 	 * @{ */
@@ -136,6 +146,11 @@ struct document_options {
 	unsigned int no_cache:1;
 	unsigned int gradual_rerendering:1;
 
+	/** Link numbers are drawn over the document instead of being put
+	 * into it by the renderer. Like #active_link it does not affect the
+	 * formatting and is updated in the cached documents. */
+	unsigned int links_numbering_overlay:1;
+
 #ifdef CONFIG_UTF8
 	unsigned int utf8:1;
 #endif /* CONFIG_UTF8 */
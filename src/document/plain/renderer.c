@@ -54,6 +54,47 @@ struct plain_renderer {
 
 	/* Are we doing line compression */
 	unsigned int compress:1;
+
+	/* Are we formatting the lines lazily */
+	unsigned int lazy:1;
+
+	/* Are we formatting a line again after the document was rendered */
+	unsigned int reformat:1;
+};
+
+/* Plain text documents bigger than document.plain.lazy_size only keep where
+ * each line starts in their source. The screen chars of a line are
+ * formatted when it is fetched with get_document_line() and only the most
+ * recently formatted lines are kept in memory. */
+struct plain_lazy_line {
+	/* The part of the source making up the line */
+	int offset;
+	int length;
+
+	/* The text style at the start of the line */
+	struct screen_char template;
+};
+
+/* The number of formatted lines to keep. It should be bigger than any
+ * terminal since pointers to the lines are used while drawing. */
+#define PLAIN_LAZY_LINES_KEPT	1024
+
+struct plain_lazy_lines {
+	/* The source is normally the data of the cache entry of the
+	 * document, which the document keeps locked and uncompressed. Only
+	 * a source decoded from the cache data is copied here. */
+	unsigned char *source;
+	int length;
+
+	struct conv_table *convert_table;
+
+	/* One entry for each document line */
+	struct plain_lazy_line *lines;
+	int size;
+
+	/* The recently formatted lines in the order they were formatted */
+	int kept[PLAIN_LAZY_LINES_KEPT];
+	int kept_pos;
 };
 
 #define realloc_document_links(doc, size) \
@@ -174,6 +215,30 @@ get_uri_length(unsigned char *line, int length)
 	return uri_end;
 }
 
+/* Find the link detected at the given position when the document was
+ * rendered. */
+static struct link *
+get_plain_document_link(struct document *document, int x, int y)
+{
+	struct link *link = document->links;
+	struct link *end = document->links + document->nlinks;
+
+	if (document->lines1 && y < document->height) {
+		if (!document->lines1[y]) return NULL;
+		link = document->lines1[y];
+		end = document->lines2[y] + 1;
+	}
+
+	for (; link < end; link++) {
+		if (link->npoints
+		    && link->points[0].x == x
+		    && link->points[0].y == y)
+			return link;
+	}
+
+	return NULL;
+}
+
 static int
 print_document_link(struct plain_renderer *renderer, int lineno,
 		    unsigned char *line, int line_pos, int width,
@@ -192,6 +257,15 @@ print_document_link(struct plain_renderer *renderer, int lineno,
 
 	if (!len) return 0;
 
+	if (renderer->reformat) {
+		/* The links were already added and colored. */
+		new_link = get_plain_document_link(document, screen_column,
+						   lineno);
+		if (!new_link) return 0;
+
+		goto print_link;
+	}
+
 	new_link = check_link_word(document, start, len, screen_column,
 				   lineno);
 
@@ -217,6 +291,7 @@ print_document_link(struct plain_renderer *renderer, int lineno,
 
 	new_link->color.background = doc_opts->default_style.color.background;
 
+print_link:
 	set_term_color(&template, &new_link->color,
 		       doc_opts->color_flags, doc_opts->color_mode);
 
@@ -591,6 +666,178 @@ add_node(struct plain_renderer *renderer, int x, int width, int height)
 	return node;
 }
 
+static struct plain_lazy_lines *
+init_plain_lazy_lines(struct plain_renderer *renderer,
+		      struct cache_entry *cached)
+{
+	struct plain_lazy_lines *lazy = mem_calloc(1, sizeof(*lazy));
+	struct fragment *fragment = get_cache_fragment(cached);
+	int i;
+
+	if (!lazy) return NULL;
+
+	if (!fragment || fragment->data != renderer->source) {
+		lazy->source = memacpy(renderer->source, renderer->length);
+		if (!lazy->source) {
+			mem_free(lazy);
+			return NULL;
+		}
+	} else {
+		/* Formatting a line must not have to uncompress the
+		 * whole entry. */
+		cached->data_users++;
+	}
+
+	lazy->length = renderer->length;
+	lazy->convert_table = renderer->convert_table;
+
+	for (i = 0; i < PLAIN_LAZY_LINES_KEPT; i++)
+		lazy->kept[i] = -1;
+
+	return lazy;
+}
+
+void
+done_plain_lazy_lines(struct document *document)
+{
+	struct plain_lazy_lines *lazy = document->lazy_lines;
+
+	if (!lazy) return;
+
+	if (!lazy->source)
+		document->cached->data_users--;
+
+	mem_free_if(lazy->lines);
+	mem_free_if(lazy->source);
+	mem_free(lazy);
+	document->lazy_lines = NULL;
+}
+
+/* Remember where the line starts in the source and drop its screen chars.
+ * Returns zero if the document has to be formatted eagerly after all. */
+static int
+add_plain_lazy_line(struct plain_renderer *renderer, unsigned char *source,
+		    int length, struct screen_char *template)
+{
+	struct document *document = renderer->document;
+	struct plain_lazy_lines *lazy = document->lazy_lines;
+	struct plain_lazy_line *line;
+	int lineno = renderer->lineno;
+
+	if (lineno >= lazy->size) {
+		int size = int_max(lazy->size * 2, 256);
+		struct plain_lazy_line *lines;
+
+		while (size <= lineno) size *= 2;
+
+		lines = mem_realloc(lazy->lines, size * sizeof(*lines));
+		if (!lines) return 0;
+
+		lazy->lines = lines;
+		lazy->size  = size;
+	}
+
+	line = &lazy->lines[lineno];
+	line->offset = source - renderer->source;
+	line->length = length;
+	copy_struct(&line->template, template);
+
+	if (lineno < document->height)
+		mem_free_set(&document->data[lineno].chars, NULL);
+
+	return 1;
+}
+
+/* Returns the source the lines of the document were indexed in, or NULL
+ * if the cache data changed since. The data is fetched again every time
+ * because the fragment is replaced when the entry is loaded again. */
+static unsigned char *
+get_plain_lazy_source(struct document *document)
+{
+	struct plain_lazy_lines *lazy = document->lazy_lines;
+	struct fragment *fragment;
+
+	if (lazy->source) return lazy->source;
+
+	if (document->cached->cache_id != document->cache_id)
+		return NULL;
+
+	fragment = get_cache_fragment(document->cached);
+	if (!fragment || fragment->length < lazy->length)
+		return NULL;
+
+	return fragment->data;
+}
+
+/* Format the screen chars of the line again. Returns zero on failure. */
+static int
+format_plain_lazy_line(struct document *document, int y)
+{
+	struct plain_lazy_lines *lazy = document->lazy_lines;
+	struct plain_lazy_line *lazy_line = &lazy->lines[y];
+	struct line *line = &document->data[y];
+	struct plain_renderer renderer;
+	unsigned char *source = get_plain_lazy_source(document);
+	unsigned char *xsource;
+	int length = line->length;
+
+	if (!source) return 0;
+
+	memset(&renderer, 0, sizeof(renderer));
+	renderer.document = document;
+	renderer.source = source;
+	renderer.length = lazy->length;
+	renderer.convert_table = lazy->convert_table;
+	renderer.max_width = INT_MAX;
+	renderer.lineno = y;
+	renderer.reformat = 1;
+	copy_struct(&renderer.template, &lazy_line->template);
+
+	xsource = memacpy(&source[lazy_line->offset], lazy_line->length);
+	if (!xsource) return 0;
+
+	/* Let realloc_line() allocate the chars from scratch. */
+	line->length = 0;
+	add_document_line(&renderer, xsource, lazy_line->length);
+	mem_free(xsource);
+
+	/* The line is formatted the same way every time. */
+	if (!line->chars || line->length != length) {
+		mem_free_set(&line->chars, NULL);
+		line->length = length;
+		return 0;
+	}
+
+	return 1;
+}
+
+struct line *
+get_lazy_document_line(struct document *document, int y)
+{
+	struct plain_lazy_lines *lazy = document->lazy_lines;
+	struct line *line = &document->data[y];
+	int *kept;
+
+	assert(y >= 0 && y < document->height);
+
+	if (!lazy || y >= lazy->size || line->chars || !line->length)
+		return line;
+
+	if (!format_plain_lazy_line(document, y))
+		return &empty_document_line;
+
+	/* Drop the screen chars of the line formatted the longest time
+	 * ago. */
+	kept = &lazy->kept[lazy->kept_pos];
+	if (*kept >= 0 && *kept != y)
+		mem_free_set(&document->data[*kept].chars, NULL);
+
+	*kept = y;
+	lazy->kept_pos = (lazy->kept_pos + 1) % PLAIN_LAZY_LINES_KEPT;
+
+	return line;
+}
+
 static void
 add_document_lines(struct plain_renderer *renderer)
 {
@@ -608,6 +855,7 @@ add_document_lines(struct plain_renderer *renderer)
 		int tab_spaces = 0;
 		int step = 0;
  		int cells = 0;
+		struct screen_char template;
 
 		/* End of line detection: We handle \r, \r\n and \n types. */
  		for (width = 0; (width < length) &&
@@ -686,9 +934,18 @@ add_document_lines(struct plain_renderer *renderer)
 		xsource = memacpy(source, width);
 		if (!xsource) continue;
 
+		if (renderer->lazy)
+			copy_struct(&template, &renderer->template);
+
 		added = add_document_line(renderer, xsource, width);
 		mem_free(xsource);
 
+		if (renderer->lazy
+		    && !add_plain_lazy_line(renderer, source, width, &template)) {
+			/* Keep the remaining lines formatted. */
+			renderer->lazy = 0;
+		}
+
 		if (added) {
 			/* Add (search) nodes on a line by line basis */
 			add_node(renderer, 0, added, 1);
@@ -722,6 +979,7 @@ render_plain_document(struct cache_entry *cached, struct document *document,
 
 	renderer.document = document;
 	renderer.lineno = 0;
+	renderer.lazy = 0;
 	renderer.convert_table = convert_table;
 	renderer.compress = document->options.plain_compress_empty_lines;
 	renderer.max_width = document->options.wrap ? document->options.box.width
@@ -736,5 +994,27 @@ render_plain_document(struct cache_entry *cached, struct document *document,
 	/* Setup the style */
 	init_template(&renderer.template, &document->options);
 
+	if (document->options.plain_lazy_size
+	    && buffer->length > document->options.plain_lazy_size) {
+		document->lazy_lines = init_plain_lazy_lines(&renderer, cached);
+		renderer.lazy = !!document->lazy_lines;
+	}
+
 	add_document_lines(&renderer);
+
+	if (document->lazy_lines && !renderer.lazy) {
+		/* The line index could not be completed so format the
+		 * dropped lines and forget about it. */
+		int y;
+
+		for (y = 0; y < document->height; y++) {
+			struct line *line = &document->data[y];
+
+			if (!line->chars && line->length
+			    && !format_plain_lazy_line(document, y))
+				line->length = 0;
+		}
+
+		done_plain_lazy_lines(document);
+	}
 }
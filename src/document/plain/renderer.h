@@ -4,8 +4,16 @@
 
 struct cache_entry;
 struct document;
+struct line;
 struct string;
 
 void render_plain_document(struct cache_entry *cached, struct document *document, struct string *buffer);
 
+/** Format the line @a y of a lazily formatted document. Use
+ * get_document_line() instead of calling this directly. */
+struct line *get_lazy_document_line(struct document *document, int y);
+
+/** Free the lazy formatting state of the document. */
+void done_plain_lazy_lines(struct document *document);
+
 #endif
@@ -14,6 +14,7 @@
 
 #include "cache/cache.h"
 #include "config/options.h"
+#include "document/compact.h"
 #include "document/document.h"
 #include "document/dom/renderer.h"
 #include "document/html/frames.h"
@@ -348,10 +349,12 @@ render_document(struct view_state *vs, struct document_view *doc_view,
 			for (; vs->form_info_len > 0; vs->form_info_len--)
 				done_form_state(&vs->form_info[vs->form_info_len - 1]);
 
-		shrink_memory(0);
+		shrink_memory_when_idle();
 
 		render_encoded_document(cached, document);
 		sort_links(document);
+		if (get_opt_bool("document.cache.format.compact", NULL))
+			compact_document_lines(document);
 		if (!document->title) {
 			enum uri_component components;
 
@@ -421,9 +424,13 @@ render_document(struct view_state *vs, struct document_view *doc_view,
 #endif
 
 	/* If we do not care about the height and width of the document
-	 * just use the setup values. */
+	 * just use the setup values. The document may have been rendered
+	 * for a window at some other position, which makes no difference
+	 * to it, so the position always comes from the setup values. */
 
 	copy_box(&doc_view->box, &document->options.box);
+	doc_view->box.x = options->box.x;
+	doc_view->box.y = options->box.y;
 
 	if (!document->options.needs_width)
 		doc_view->box.width = options->box.width;
@@ -433,6 +440,35 @@ render_document(struct view_state *vs, struct document_view *doc_view,
 }
 
 
+void
+init_session_document_options(struct session *ses,
+			       struct document_options *doc_opts, int no_cache)
+{
+	init_document_options(ses, doc_opts);
+
+	set_box(&doc_opts->box, 0, 0,
+		ses->tab->term->width, ses->tab->term->height);
+
+	if (ses->status.show_title_bar) {
+		doc_opts->box.y++;
+		doc_opts->box.height--;
+	}
+	if (ses->status.show_status_bar) doc_opts->box.height--;
+	if (ses->status.show_tabs_bar) {
+		doc_opts->box.height--;
+		if (ses->status.show_tabs_bar_at_top) doc_opts->box.y++;
+	}
+
+	doc_opts->color_mode = get_opt_int_tree(ses->tab->term->spec, "colors",
+						NULL);
+	if (!get_opt_bool_tree(ses->tab->term->spec, "underline", NULL))
+		doc_opts->color_flags |= COLOR_ENHANCE_UNDERLINE;
+
+	doc_opts->cp = get_terminal_codepage(ses->tab->term);
+	doc_opts->no_cache = no_cache & 1;
+	doc_opts->gradual_rerendering = !!(no_cache & 2);
+}
+
 void
 render_document_frames(struct session *ses, int no_cache)
 {
@@ -450,29 +486,7 @@ render_document_frames(struct session *ses, int no_cache)
 
 	if (have_location(ses)) vs = &cur_loc(ses)->vs;
 
-	init_document_options(ses, &doc_opts);
-
-	set_box(&doc_opts.box, 0, 0,
-		ses->tab->term->width, ses->tab->term->height);
-
-	if (ses->status.show_title_bar) {
-		doc_opts.box.y++;
-		doc_opts.box.height--;
-	}
-	if (ses->status.show_status_bar) doc_opts.box.height--;
-	if (ses->status.show_tabs_bar) {
-		doc_opts.box.height--;
-		if (ses->status.show_tabs_bar_at_top) doc_opts.box.y++;
-	}
-
-	doc_opts.color_mode = get_opt_int_tree(ses->tab->term->spec, "colors",
-	                                       NULL);
-	if (!get_opt_bool_tree(ses->tab->term->spec, "underline", NULL))
-		doc_opts.color_flags |= COLOR_ENHANCE_UNDERLINE;
-
-	doc_opts.cp = get_terminal_codepage(ses->tab->term);
-	doc_opts.no_cache = no_cache & 1;
-	doc_opts.gradual_rerendering = !!(no_cache & 2);
+	init_session_document_options(ses, &doc_opts, no_cache);
 
 	if (vs) {
 		if (vs->plain < 0) vs->plain = 0;
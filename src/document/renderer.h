@@ -12,6 +12,13 @@ struct screen_char;
 
 void render_document(struct view_state *, struct document_view *, struct document_options *);
 void render_document_frames(struct session *ses, int no_cache);
+
+/** Set up @a doc_opts for rendering documents on the screen of the
+ * session the way render_document_frames() does. @a no_cache has the same
+ * meaning as for render_document_frames(). */
+void init_session_document_options(struct session *ses,
+				   struct document_options *doc_opts,
+				   int no_cache);
 struct conv_table *get_convert_table(unsigned char *head, int to_cp, int default_cp, int *from_cp, enum cp_status *cp_status, int ignore_server_cp);
 void sort_links(struct document *document);
 
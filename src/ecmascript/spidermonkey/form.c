@@ -44,6 +44,7 @@
 #include "viewer/text/draw.h"
 #include "viewer/text/form.h"
 #include "viewer/text/link.h"
+#include "viewer/text/textarea.h"
 #include "viewer/text/vs.h"
 
 
@@ -392,6 +393,7 @@ input_set_property(JSContext *ctx, JSObject *obj, jsid id, JSBool strict, jsval
 		if (fc->type == FC_FILE)
 			break; /* A huge security risk otherwise. */
 		mem_free_set(&fs->value, stracpy(jsval_to_string(ctx, vp)));
+		done_textarea_layout(fs);
 		if (fc->type == FC_TEXT || fc->type == FC_PASSWORD)
 			fs->state = strlen(fs->value);
 		break;
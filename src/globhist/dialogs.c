@@ -163,6 +163,8 @@ history_search_do(void *data)
 		box->top = item;
 		box->sel = box->top;
 	}
+
+	update_hierbox_browser(&globhist_browser);
 }
 
 static void
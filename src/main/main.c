@@ -316,6 +316,19 @@ shrink_memory(int whole)
 	garbage_collection(whole);
 }
 
+static int
+shrink_memory_idle(void *data)
+{
+	shrink_memory(0);
+	return 0;
+}
+
+void
+shrink_memory_when_idle(void)
+{
+	register_idle_work(shrink_memory_idle, NULL);
+}
+
 #ifdef CONFIG_NO_ROOT_EXEC
 static void
 check_if_root(void)
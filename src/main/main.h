@@ -22,4 +22,7 @@ extern struct program program;
 
 void shrink_memory(int);
 
+/* Shrink the caches the next time the select loop is idle. */
+void shrink_memory_when_idle(void);
+
 #endif
@@ -14,6 +14,7 @@
 
 #include "bfu/dialog.h"
 #include "bookmarks/bookmarks.h"
+#include "cache/disk.h"
 #include "config/kbdbind.h"
 #include "config/timer.h"
 #include "config/urlhist.h"
@@ -51,6 +52,7 @@ struct module *builtin_modules[] = {
 	&ssl_module,
 #endif
 	&mime_module,
+	&disk_cache_module,
 #ifdef CONFIG_LEDS
 	&leds_module,
 #endif
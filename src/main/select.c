@@ -125,6 +125,128 @@ check_bottom_halves(void)
 	}
 }
 
+struct idle_work {
+	LIST_HEAD(struct idle_work);
+
+	idle_handler_T fn;
+	void *data;
+
+	/* When the work was queued, so that it is not put off forever
+	 * while the select loop never gets idle. */
+	timeval_T since;
+};
+
+static INIT_LIST_OF(struct idle_work, idle_works);
+
+/* How long one slice of idle work may take so that the input arriving
+ * meanwhile is not held up for long. */
+#define IDLE_WORK_SLICE		((milliseconds_T) 20)
+
+/* How long idle work may wait for the select loop to get idle before a
+ * slice of it is done anyway. */
+#define IDLE_WORK_MAX_DELAY	((milliseconds_T) 2000)
+
+/* When the current slice of idle work has to end. */
+static timeval_T idle_work_deadline;
+
+static struct idle_work *
+find_idle_work(idle_handler_T fn, void *data)
+{
+	struct idle_work *work;
+
+	foreach (work, idle_works)
+		if (work->fn == fn && work->data == data)
+			return work;
+
+	return NULL;
+}
+
+int
+register_idle_work_do(idle_handler_T fn, void *data)
+{
+	struct idle_work *work;
+
+	if (find_idle_work(fn, data))
+		return 0;
+
+	work = mem_alloc(sizeof(*work));
+	if (!work) return -1;
+	work->fn = fn;
+	work->data = data;
+	timeval_now(&work->since);
+	add_to_list_end(idle_works, work);
+
+	return 0;
+}
+
+void
+unregister_idle_work_do(idle_handler_T fn, void *data)
+{
+	struct idle_work *work = find_idle_work(fn, data);
+
+	if (!work) return;
+
+	del_from_list(work);
+	mem_free(work);
+}
+
+int
+idle_work_should_yield(void)
+{
+	timeval_T now;
+
+	timeval_now(&now);
+
+	return timeval_cmp(&now, &idle_work_deadline) >= 0;
+}
+
+/* Whether the oldest idle work has waited too long for an idle moment. */
+static int
+is_idle_work_overdue(void)
+{
+	struct idle_work *work = idle_works.next;
+	timeval_T now, age;
+
+	timeval_now(&now);
+	timeval_sub(&age, &work->since, &now);
+
+	return timeval_to_milliseconds(&age) >= IDLE_WORK_MAX_DELAY;
+}
+
+/* Do one slice of the queued idle work, passing the turn around the
+ * queue for as long as the slice lasts. */
+static void
+check_idle_works(void)
+{
+	timeval_T slice;
+
+	timeval_now(&idle_work_deadline);
+	timeval_from_milliseconds(&slice, IDLE_WORK_SLICE);
+	timeval_add_interval(&idle_work_deadline, &slice);
+
+	do {
+		struct idle_work *work = idle_works.next;
+		idle_handler_T fn = work->fn;
+		void *data = work->data;
+		int more;
+
+		/* The work is off the queue while it runs so that it can
+		 * unregister or register itself again safely. */
+		del_from_list(work);
+		more = fn(data);
+		check_bottom_halves();
+
+		if (more && !find_idle_work(fn, data)) {
+			timeval_now(&work->since);
+			add_to_list_end(idle_works, work);
+		} else {
+			mem_free(work);
+		}
+	} while (!list_empty(idle_works)
+		 && !program.terminate
+		 && !idle_work_should_yield());
+}
+
 select_handler_T
 get_handler(int fd, enum select_handler_type tp)
 {
@@ -230,7 +352,7 @@ select_loop(void (*init)(void))
 
 	while (!program.terminate) {
 		struct timeval *timeout = NULL;
-		int n, i, has_timer;
+		int n, i, has_timer, idle;
 		timeval_T t;
 
 		check_signals();
@@ -244,7 +366,7 @@ select_loop(void (*init)(void))
 		if (program.terminate) break;
 
 		has_timer = get_next_timer_time(&t);
-		if (!w_max && !has_timer) break;
+		if (!w_max && !has_timer && list_empty(idle_works)) break;
 		critical_section = 1;
 
 		if (check_signals()) {
@@ -267,7 +389,12 @@ select_loop(void (*init)(void))
 			fflush(stdout);
 		}
 #endif
-		if (has_timer) {
+		if (!list_empty(idle_works)) {
+			/* Only poll so that the idle work gets done right
+			 * away when nothing is ready. */
+			timeval_from_milliseconds(&t, 0);
+			timeout = (struct timeval *) &t;
+		} else if (has_timer) {
 			/* Be sure timeout is not negative. */
 			timeval_limit_to_zero_or_one(&t);
 			timeout = (struct timeval *) &t;
@@ -297,6 +424,7 @@ select_loop(void (*init)(void))
 		check_signals();
 		/*printf("sel: %d\n", n);*/
 		check_timers(&last_time);
+		idle = !n;
 
 		i = -1;
 		while (n > 0 && ++i < w_max) {
@@ -334,6 +462,10 @@ select_loop(void (*init)(void))
 
 			n -= k;
 		}
+
+		if (!list_empty(idle_works)
+		    && (idle || is_idle_work_overdue()))
+			check_idle_works();
 	}
 }
 
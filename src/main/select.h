@@ -20,6 +20,28 @@ int register_bottom_half_do(select_handler_T work_handler, void *data);
 /* Check and run scheduled work. */
 void check_bottom_halves(void);
 
+/* Idle work is done in slices when no descriptor is ready, so that it
+ * does not hold up input and network events. The handler returns
+ * non-zero if it has more work left and wants to be called again. Work
+ * that waits for an idle moment too long gets a slice anyway. */
+typedef int (*idle_handler_T)(void *);
+
+/* Queue work to be done when the select loop is idle. */
+int register_idle_work_do(idle_handler_T work_handler, void *data);
+
+#define register_idle_work(fn, data) \
+	register_idle_work_do((idle_handler_T) (fn), (void *) (data))
+
+/* Drop queued idle work. */
+void unregister_idle_work_do(idle_handler_T work_handler, void *data);
+
+#define unregister_idle_work(fn, data) \
+	unregister_idle_work_do((idle_handler_T) (fn), (void *) (data))
+
+/* Whether the idle work handler that is running has used up its slice
+ * and should return to let the select loop check for events. */
+int idle_work_should_yield(void);
+
 enum select_handler_type {
 	SELECT_HANDLER_READ,
 	SELECT_HANDLER_WRITE,
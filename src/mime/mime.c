@@ -238,6 +238,8 @@ get_fragment_content_type(struct cache_entry *cached)
 	unsigned char *sample;
 	unsigned char *ctype = NULL;
 
+	uncompress_cache_entry(cached);
+
 	if (list_empty(cached->frag))
 		return NULL;
 
@@ -13,6 +13,7 @@
 #include "elinks.h"
 
 #include "cache/cache.h"
+#include "cache/disk.h"
 #include "config/options.h"
 #include "document/document.h"
 #include "encoding/encoding.h"
@@ -364,6 +365,10 @@ set_connection_state(struct connection *conn, struct connection_state state)
 	if (is_in_result_state(conn->state) && is_in_progress_state(state))
 		conn->prev_error = conn->state;
 
+	if (is_in_state(state, S_OK) && !is_in_state(conn->state, S_OK)
+	    && conn->cached)
+		save_disk_cache_entry(conn->cached);
+
 	conn->state = state;
 	if (is_in_state(conn->state, S_TRANS)) {
 		const unsigned int id = conn->id;
@@ -554,11 +559,11 @@ done_keepalive_connection(struct keepalive_connection *keep_conn)
 }
 
 static struct keepalive_connection *
-init_keepalive_connection(struct connection *conn, long timeout_in_seconds,
+init_keepalive_connection(struct uri *uri, struct socket *socket,
+			  long timeout_in_seconds,
 			  void (*done)(struct connection *))
 {
 	struct keepalive_connection *keep_conn;
-	struct uri *uri = conn->uri;
 
 	assert(uri->host);
 	if_assert_failed return NULL;
@@ -568,8 +573,8 @@ init_keepalive_connection(struct connection *conn, long timeout_in_seconds,
 
 	keep_conn->uri = get_uri_reference(uri);
 	keep_conn->done = done;
-	keep_conn->protocol_family = conn->socket->protocol_family;
-	keep_conn->socket = conn->socket->fd;
+	keep_conn->protocol_family = socket->protocol_family;
+	keep_conn->socket = socket->fd;
 	timeval_from_seconds(&keep_conn->timeout, timeout_in_seconds);
 	timeval_now(&keep_conn->creation_time);
 
@@ -577,19 +582,22 @@ init_keepalive_connection(struct connection *conn, long timeout_in_seconds,
 }
 
 static struct keepalive_connection *
-get_keepalive_connection(struct connection *conn)
+get_keepalive_connection_by_uri(struct uri *uri)
 {
 	struct keepalive_connection *keep_conn;
 
-	if (!conn->uri->host) return NULL;
+	if (!uri->host) return NULL;
 
 	foreach (keep_conn, keepalive_connections)
-		if (compare_uri(keep_conn->uri, conn->uri, URI_KEEPALIVE))
+		if (compare_uri(keep_conn->uri, uri, URI_KEEPALIVE))
 			return keep_conn;
 
 	return NULL;
 }
 
+#define get_keepalive_connection(conn) \
+	get_keepalive_connection_by_uri((conn)->uri)
+
 int
 has_keepalive_connection(struct connection *conn)
 {
@@ -618,7 +626,8 @@ add_keepalive_connection(struct connection *conn, long timeout_in_seconds,
 	assertm(conn->socket->fd != -1, "keepalive connection not connected");
 	if_assert_failed goto done;
 
-	keep_conn = init_keepalive_connection(conn, timeout_in_seconds, done);
+	keep_conn = init_keepalive_connection(conn->uri, conn->socket,
+					      timeout_in_seconds, done);
 	if (keep_conn) {
 		/* Make sure that the socket descriptor will not periodically be
 		 * checked or closed by free_connection_data(). */
@@ -697,6 +706,212 @@ abort_all_keepalive_connections(void)
 }
 
 
+/* Preconnection management: */
+/* The host of a link the user is likely to follow can be resolved and
+ * connected to in advance. A connection opened that way is parked with the
+ * keepalive connections, where the connection loading the link picks it up
+ * instead of connecting itself. */
+
+struct preconnection {
+	LIST_HEAD(struct preconnection);
+
+	/* The URI the connection will have, i.e. of the proxy if any. */
+	struct uri *uri;
+
+	/* NULL if only the host name is resolved. */
+	struct socket *socket;
+	void *dnsquery;
+
+	/* Gives up on the host when it takes too long. */
+	timer_id_T timer;
+};
+
+static INIT_LIST_OF(struct preconnection, preconnections);
+
+static void
+free_preconnection(struct preconnection *preconnection)
+{
+	kill_timer(&preconnection->timer);
+
+	if (preconnection->dnsquery)
+		kill_dns_request(&preconnection->dnsquery);
+
+	if (preconnection->socket) {
+		done_socket(preconnection->socket);
+		mem_free(preconnection->socket);
+	}
+
+	done_uri(preconnection->uri);
+	mem_free(preconnection);
+}
+
+static void
+done_preconnection(struct preconnection *preconnection)
+{
+	del_from_list(preconnection);
+	free_preconnection(preconnection);
+}
+
+static void
+preconnection_timeout(struct preconnection *preconnection)
+{
+	preconnection->timer = TIMER_ID_UNDEF;
+	/* The expired timer ID has now been erased.  */
+	done_preconnection(preconnection);
+}
+
+static void
+set_preconnection_socket_state(struct socket *socket, struct connection_state state)
+{
+}
+
+static void
+done_preconnection_socket(struct socket *socket, struct connection_state state)
+{
+	assert(socket);
+	done_preconnection(socket->conn);
+}
+
+static struct socket_operations preconnection_socket_operations = {
+	set_preconnection_socket_state,
+	set_preconnection_socket_state,
+	done_preconnection_socket,
+	done_preconnection_socket,
+};
+
+/* Park the connected socket with the keepalive connections. */
+static void
+preconnected(struct socket *socket)
+{
+	struct preconnection *preconnection = socket->conn;
+	struct keepalive_connection *keep_conn;
+
+	kill_timer(&preconnection->timer);
+
+	keep_conn = init_keepalive_connection(preconnection->uri, socket,
+					      PRECONNECT_TIMEOUT, NULL);
+	if (keep_conn) {
+		clear_handlers(socket->fd);
+		socket->fd = -1;
+		add_to_list(keepalive_connections, keep_conn);
+		register_check_queue();
+	}
+
+	/* complete_connect_socket() still uses the socket, so it is freed
+	 * later. Nobody else may free it meanwhile, such as
+	 * abort_all_preconnections(). */
+	del_from_list(preconnection);
+	register_bottom_half(free_preconnection, preconnection);
+}
+
+static void
+host_resolved(struct preconnection *preconnection,
+	      struct sockaddr_storage *addr, int addrlen)
+{
+	done_preconnection(preconnection);
+}
+
+static int
+is_host_busy(struct uri *uri)
+{
+	int max_conns_to_host = get_opt_int("connection.max_connections_to_host", NULL);
+	struct host_connection *host_conn;
+
+	foreach (host_conn, host_connections)
+		if (compare_uri(host_conn->uri, uri, URI_HOST))
+			return get_object_refcount(host_conn) >= max_conns_to_host;
+
+	return 0;
+}
+
+void
+preconnect_uri(struct uri *uri, int connect)
+{
+	struct uri *proxy_uri = get_proxy_uri(uri, NULL);
+	struct preconnection *preconnection;
+	unsigned char *host;
+	int count = 0;
+
+	if (!proxy_uri) return;
+
+	if (!proxy_uri->host || !proxy_uri->hostlen) {
+		done_uri(proxy_uri);
+		return;
+	}
+
+	/* Only plain HTTP connections are kept alive, not those
+	 * negotiating SSL. */
+	if (proxy_uri->protocol != PROTOCOL_HTTP
+	    && proxy_uri->protocol != PROTOCOL_PROXY)
+		connect = 0;
+
+	foreach (preconnection, preconnections) {
+		if (compare_uri(preconnection->uri, proxy_uri, URI_KEEPALIVE)) {
+			done_uri(proxy_uri);
+			return;
+		}
+		count++;
+	}
+
+	if (count >= MAX_PRECONNECTIONS) {
+		done_uri(proxy_uri);
+		return;
+	}
+
+	/* There is already an idle connection to the host or no more
+	 * connections to it are allowed anyway. */
+	if (connect
+	    && (get_keepalive_connection_by_uri(proxy_uri)
+		|| is_host_busy(proxy_uri)))
+		connect = 0;
+
+	preconnection = mem_calloc(1, sizeof(*preconnection));
+	if (!preconnection) {
+		done_uri(proxy_uri);
+		return;
+	}
+
+	preconnection->uri = proxy_uri;
+	preconnection->timer = TIMER_ID_UNDEF;
+	add_to_list(preconnections, preconnection);
+
+	install_timer(&preconnection->timer, sec_to_ms(PRECONNECT_TIMEOUT),
+		      (void (*)(void *)) preconnection_timeout, preconnection);
+
+	if (connect) {
+		preconnection->socket = init_socket(preconnection,
+						    &preconnection_socket_operations);
+		if (!preconnection->socket) {
+			done_preconnection(preconnection);
+			return;
+		}
+
+		/* This may end the preconnection right away. */
+		make_connection(preconnection->socket, proxy_uri,
+				preconnected, 0);
+		return;
+	}
+
+	host = get_uri_string(proxy_uri, URI_DNS_HOST);
+	if (!host) {
+		done_preconnection(preconnection);
+		return;
+	}
+
+	/* This may call host_resolved() right away. */
+	find_host(host, &preconnection->dnsquery,
+		  (dns_callback_T) host_resolved, preconnection, 0);
+	mem_free(host);
+}
+
+static void
+abort_all_preconnections(void)
+{
+	while (!list_empty(preconnections))
+		done_preconnection(preconnections.next);
+}
+
+
 static void
 sort_queue(void)
 {
@@ -1012,9 +1227,14 @@ load_uri(struct uri *uri, struct uri *referrer, struct download *download,
 		return -1;
 	}
 
-	if (cache_mode < CACHE_MODE_FORCE_RELOAD && cached && !list_empty(cached->frag)
-	    && !((struct fragment *) cached->frag.next)->offset)
-		conn->from = ((struct fragment *) cached->frag.next)->length;
+	if (cache_mode < CACHE_MODE_FORCE_RELOAD && cached) {
+		/* A compressed entry has no fragments to resume from. */
+		uncompress_cache_entry(cached);
+
+		if (!list_empty(cached->frag)
+		    && !((struct fragment *) cached->frag.next)->offset)
+			conn->from = ((struct fragment *) cached->frag.next)->length;
+	}
 
 	if (download) {
 		download->progress = conn->progress;
@@ -1218,6 +1438,7 @@ abort_all_connections(void)
 				 connection_state(S_INTERRUPTED));
 	}
 
+	abort_all_preconnections();
 	abort_all_keepalive_connections();
 }
 
@@ -117,6 +117,12 @@ void shutdown_connection_stream(struct connection *conn);
 int load_uri(struct uri *uri, struct uri *referrer, struct download *download,
 	     enum connection_priority pri, enum cache_mode cache_mode, off_t start);
 
+/* Resolve the host of @uri in advance for a connection that is likely to
+ * follow. If @connect is non-zero, a plain HTTP connection to the host is
+ * also opened and kept for PRECONNECT_TIMEOUT seconds for the connection
+ * loading @uri to use. */
+void preconnect_uri(struct uri *uri, int connect);
+
 int is_entry_used(struct cache_entry *cached);
 
 #endif
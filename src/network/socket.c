@@ -43,6 +43,7 @@
 
 #include "config/options.h"
 #include "main/select.h"
+#include "main/timer.h"
 #include "network/connection.h"
 #include "network/dns.h"
 #include "network/socket.h"
@@ -57,11 +58,22 @@
 #include "util/string.h"
 
 
+/* A connect() in progress to one of the found addresses. */
+struct connect_attempt {
+	struct socket *socket;		 /* The socket being connected. */
+	int fd;				 /* -1 if not in progress. */
+	int protocol_family;		 /* EL_PF_INET, EL_PF_INET6 */
+};
+
 /* Holds information used during the connection establishing phase. */
 struct connect_info {
 	struct sockaddr_storage *addr;	 /* Array of found addresses. */
 	int addrno;			 /* Number of found addresses. */
 	int triedno;			 /* Index of last tried address */
+	struct connect_attempt *attempts;/* One for each address. */
+	int attempting;			 /* Number of attempts in progress. */
+	timer_id_T attempt_timer;	 /* Starts the next attempt. */
+	int dual_stack;			 /* Found both IPv4 and IPv6? */
 	socket_connect_T done;		 /* Callback signaled when connected. */
 	void *dnsquery;			 /* Pointer to DNS query info. */
 	int port;			 /* Which port to bind to. */
@@ -116,11 +128,32 @@ init_connection_info(struct uri *uri, struct socket *socket,
 	connect_info->ip_family = uri->ip_family;
 	connect_info->triedno = -1;
 	connect_info->addr = NULL;
+	connect_info->attempt_timer = TIMER_ID_UNDEF;
 	connect_info->uri = get_uri_reference(uri);
 
 	return connect_info;
 }
 
+/* Abandon all connect() attempts still in progress. */
+static void
+done_connect_attempts(struct connect_info *connect_info)
+{
+	int i;
+
+	kill_timer(&connect_info->attempt_timer);
+
+	for (i = 0; connect_info->attempting && i < connect_info->addrno; i++) {
+		struct connect_attempt *attempt = &connect_info->attempts[i];
+
+		if (attempt->fd == -1) continue;
+
+		clear_handlers(attempt->fd);
+		close(attempt->fd);
+		attempt->fd = -1;
+		connect_info->attempting--;
+	}
+}
+
 static void
 done_connection_info(struct socket *socket)
 {
@@ -130,6 +163,8 @@ done_connection_info(struct socket *socket)
 
 	if (connect_info->dnsquery) kill_dns_request(&connect_info->dnsquery);
 
+	done_connect_attempts(connect_info);
+	mem_free_if(connect_info->attempts);
 	mem_free_if(connect_info->addr);
 	done_uri(connect_info->uri);
 	mem_free_set(&socket->connect_info, NULL);
@@ -218,12 +253,68 @@ timeout_socket(struct socket *socket)
 }
 
 
+/* Copy the found addresses to @connect_info interleaving IPv6 and IPv4 so
+ * that a host with a broken family is not waited on for long (RFC 8305).
+ * The family which won the last race with the host goes first, otherwise
+ * the order of the resolver is kept. */
+static void
+interleave_addresses(struct connect_info *connect_info,
+		     struct sockaddr_storage *addr, int addrno)
+{
+#ifdef CONFIG_IPV6
+	int family = addr[0].ss_family;
+	int first = 0, other = 0;
+	int take_first = 1;
+	int i;
+
+	for (i = 0; i < addrno; i++)
+		if (addr[i].ss_family != family)
+			connect_info->dual_stack = 1;
+
+	if (connect_info->dual_stack
+	    && (get_blacklist_flags(connect_info->uri) & SERVER_BLACKLIST_IPV4))
+		family = AF_INET;
+
+	for (i = 0; i < addrno; i++) {
+		while (first < addrno && addr[first].ss_family != family)
+			first++;
+		while (other < addrno && addr[other].ss_family == family)
+			other++;
+
+		if (other >= addrno || (take_first && first < addrno))
+			connect_info->addr[i] = addr[first++];
+		else
+			connect_info->addr[i] = addr[other++];
+
+		take_first = !take_first;
+	}
+#else
+	memcpy(connect_info->addr, addr, sizeof(*addr) * addrno);
+#endif
+}
+
+/* Remember which family won the race so that the next connection to the
+ * host tries it first. */
+static void
+remember_address_family(struct connect_info *connect_info, int protocol_family)
+{
+#ifdef CONFIG_IPV6
+	if (!connect_info->dual_stack) return;
+
+	if (protocol_family == EL_PF_INET)
+		add_blacklist_entry(connect_info->uri, SERVER_BLACKLIST_IPV4);
+	else
+		del_blacklist_entry(connect_info->uri, SERVER_BLACKLIST_IPV4);
+#endif
+}
+
 /* DNS callback. */
 static void
 dns_found(struct socket *socket, struct sockaddr_storage *addr, int addrlen)
 {
 	struct connect_info *connect_info = socket->connect_info;
 	int size;
+	int i;
 
 	if (!addr) {
 		socket->ops->done(socket, connection_state(S_NO_DNS));
@@ -240,7 +331,18 @@ dns_found(struct socket *socket, struct sockaddr_storage *addr, int addrlen)
 		return;
 	}
 
-	memcpy(connect_info->addr, addr, size);
+	connect_info->attempts = mem_calloc(addrlen, sizeof(*connect_info->attempts));
+	if (!connect_info->attempts) {
+		socket->ops->done(socket, connection_state(S_OUT_OF_MEM));
+		return;
+	}
+
+	for (i = 0; i < addrlen; i++) {
+		connect_info->attempts[i].socket = socket;
+		connect_info->attempts[i].fd = -1;
+	}
+
+	interleave_addresses(connect_info, addr, addrlen);
 	connect_info->addrno = addrlen;
 
 	/* XXX: Passing non-result state here is bad but a lack of alternatives
@@ -493,20 +595,67 @@ complete_connect_socket(struct socket *socket, struct uri *uri,
 	done_connection_info(socket);
 }
 
-/* Select handler which is set for the socket descriptor when connect() has
- * indicated (via errno) that it is in progress. On completion this handler gets
- * called. */
+static void connect_next_address(struct socket *csocket,
+				 struct connection_state state);
+
+/* Use the socket descriptor of the @attempt which connected first for the
+ * connection and close the others. */
+static void
+won_connect_attempt(struct connect_attempt *attempt)
+{
+	struct socket *csocket = attempt->socket;
+	struct connect_info *connect_info = csocket->connect_info;
+
+	clear_handlers(attempt->fd);
+	csocket->fd = attempt->fd;
+	csocket->protocol_family = attempt->protocol_family;
+	attempt->fd = -1;
+	connect_info->attempting--;
+
+	done_connect_attempts(connect_info);
+	remember_address_family(connect_info, csocket->protocol_family);
+
+	complete_connect_socket(csocket, NULL, NULL);
+}
+
+static void
+failed_connect_attempt(struct connect_attempt *attempt,
+		       struct connection_state state)
+{
+	struct socket *csocket = attempt->socket;
+	struct connect_info *connect_info = csocket->connect_info;
+
+	clear_handlers(attempt->fd);
+	close(attempt->fd);
+	attempt->fd = -1;
+	connect_info->attempting--;
+
+	if (!connect_info->attempting) {
+		/* There are maybe still some more candidates. */
+		connect_socket(csocket, state);
+		return;
+	}
+
+	/* Other attempts are still in progress so only start the next one
+	 * without waiting for the attempt delay. */
+	kill_timer(&connect_info->attempt_timer);
+	connect_next_address(csocket, state);
+}
+
+/* Select handler which is set for the socket descriptor of each attempt when
+ * connect() has indicated (via errno) that it is in progress. On completion
+ * this handler gets called. */
 static void
-connected(struct socket *socket)
+connected(struct connect_attempt *attempt)
 {
 	int err = 0;
 	struct connection_state state = connection_state(0);
 	socklen_t len = sizeof(err);
 
-	assertm(socket->connect_info != NULL, "Lost connect_info!");
+	assertm(attempt->socket->connect_info != NULL, "Lost connect_info!");
 	if_assert_failed return;
 
-	if (getsockopt(socket->fd, SOL_SOCKET, SO_ERROR, (void *) &err, &len) == 0) {
+	if (getsockopt(attempt->fd, SOL_SOCKET, SO_ERROR, (void *) &err, &len) == 0) {
 		/* Why does EMX return so large values? */
 		if (err >= 10000) err -= 10000;
 		if (err != 0)
@@ -522,16 +671,45 @@ connected(struct socket *socket)
 	}
 
 	if (!is_in_state(state, 0)) {
-		/* There are maybe still some more candidates. */
-		connect_socket(socket, state);
+		failed_connect_attempt(attempt, state);
 		return;
 	}
 
-	complete_connect_socket(socket, NULL, NULL);
+	won_connect_attempt(attempt);
+}
+
+static void
+connect_attempt_exception(struct connect_attempt *attempt)
+{
+	failed_connect_attempt(attempt, connection_state(S_EXCEPT));
+}
+
+/* Timer handler racing the next address against the attempts which have not
+ * connected within connection.attempt_delay. */
+static void
+start_next_connect_attempt(struct socket *csocket)
+{
+	csocket->connect_info->attempt_timer = TIMER_ID_UNDEF;
+	connect_next_address(csocket, connection_state(S_CONN));
 }
 
 void
 connect_socket(struct socket *csocket, struct connection_state state)
+{
+	csocket->ops->set_state(csocket, state);
+
+	/* Clear handlers, the connection to the previous RR really timed
+	 * out and doesn't interest us anymore. */
+	if (csocket->fd >= 0)
+		close_socket(csocket);
+
+	done_connect_attempts(csocket->connect_info);
+
+	connect_next_address(csocket, state);
+}
+
+static void
+connect_next_address(struct socket *csocket, struct connection_state state)
 {
 	int sock = -1;
 	struct connect_info *connect_info = csocket->connect_info;
@@ -551,13 +729,6 @@ connect_socket(struct socket *csocket, struct connection_state state)
 	 * XXX: Unify with @local_only handling? --pasky */
 	int silent_fail = 0;
 
-	csocket->ops->set_state(csocket, state);
-
-	/* Clear handlers, the connection to the previous RR really timed
-	 * out and doesn't interest us anymore. */
-	if (csocket->fd >= 0)
-		close_socket(csocket);
-
 	for (i = connect_info->triedno + 1; i < connect_info->addrno; i++) {
 #ifdef CONFIG_IPV6
 		struct sockaddr_in6 addr = *((struct sockaddr_in6 *) &connect_info->addr[i]);
@@ -566,8 +737,10 @@ connect_socket(struct socket *csocket, struct connection_state state)
 		struct sockaddr_in addr = *((struct sockaddr_in *) &connect_info->addr[i]);
 		int family = addr.sin_family;
 #endif
+		struct connect_attempt *attempt = &connect_info->attempts[i];
 		int pf;
 		int force_family = connect_info->ip_family;
+		int delay;
 
 		connect_info->triedno++;
 
@@ -620,7 +793,8 @@ connect_socket(struct socket *csocket, struct connection_state state)
 			close(sock);
 			continue;
 		}
-		csocket->fd = sock;
+		attempt->fd = sock;
+		connect_info->attempting++;
 
 #ifdef CONFIG_IPV6
 		addr.sin6_port = htons(connect_info->port);
@@ -628,29 +802,23 @@ connect_socket(struct socket *csocket, struct connection_state state)
 		addr.sin_port = htons(connect_info->port);
 #endif
 
-		/* We can set csocket->protocol_family here even if the connection
-		 * will fail, as we will use it only when it will be successfully
-		 * established. At least I hope that noone else will want to do
-		 * something else ;-). --pasky */
-		/* And in fact we must set it early, because of EINPROGRESS.  */
-
 #ifdef CONFIG_IPV6
 		if (family == AF_INET6) {
-			csocket->protocol_family = EL_PF_INET6;
+			attempt->protocol_family = EL_PF_INET6;
 			if (connect(sock, (struct sockaddr *) &addr,
 					sizeof(struct sockaddr_in6)) == 0) {
 				/* Success */
-				complete_connect_socket(csocket, NULL, NULL);
+				won_connect_attempt(attempt);
 				return;
 			}
 		} else
 #endif
 		{
-			csocket->protocol_family = EL_PF_INET;
+			attempt->protocol_family = EL_PF_INET;
 			if (connect(sock, (struct sockaddr *) &addr,
 					sizeof(struct sockaddr_in)) == 0) {
 				/* Success */
-				complete_connect_socket(csocket, NULL, NULL);
+				won_connect_attempt(attempt);
 				return;
 			}
 		}
@@ -662,18 +830,33 @@ connect_socket(struct socket *csocket, struct connection_state state)
 		    || errno == EINPROGRESS) {
 			/* It will take some more time... */
 			set_handlers(sock, NULL, (select_handler_T) connected,
-				     (select_handler_T) dns_exception, csocket);
+				     (select_handler_T) connect_attempt_exception,
+				     attempt);
 			csocket->ops->set_state(csocket, connection_state(S_CONN));
+
+			/* Race the next address if this one is slow. */
+			delay = get_opt_int("connection.attempt_delay", NULL);
+			if (delay && i + 1 < connect_info->addrno) {
+				kill_timer(&connect_info->attempt_timer);
+				install_timer(&connect_info->attempt_timer, delay,
+					      (void (*)(void *)) start_next_connect_attempt,
+					      csocket);
+			}
 			return;
 		}
 
 		if (errno && !saved_errno) saved_errno = errno;
 
 		close(sock);
+		attempt->fd = -1;
+		connect_info->attempting--;
 	}
 
 	assert(i >= connect_info->addrno);
 
+	/* Wait for the attempts still in progress. */
+	if (connect_info->attempting) return;
+
 	/* Tried everything, but it didn't help :(. */
 
 	if (only_local && !saved_errno && at_least_one_remote_ip) {
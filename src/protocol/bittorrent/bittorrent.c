@@ -146,7 +146,9 @@ static union option_info bittorrent_protocol_options[] = {
 	INIT_OPT_INT("protocol.bittorrent", N_("Maximum piece cache size"),
 		"piece_cache_size", 0, 0, INT_MAX, 1024 * 1024,
 		N_("The maximum amount of memory used to hold recently "
-		"downloaded pieces.\n"
+		"downloaded or uploaded pieces. The memory is shared by "
+		"all torrents and the least recently used pieces are "
+		"dropped first.\n"
 		"\n"
 		"Set to 0 to have unlimited size.")),
 
@@ -418,10 +418,23 @@ get_bittorrent_message(struct download *download, struct terminal *term,
 
 	add_format_to_string(&string, "\n%s: ", _("Statistics", term));
 
-	value = list_size(&bittorrent->cache->queue);
+	value = bittorrent->cache->memory_pieces;
 	add_format_to_string(&string,
 		n_("%u in memory", "%u in memory", value, term), value);
 
+	value = bittorrent->cache->read_hits;
+	if (value || bittorrent->cache->read_misses) {
+		add_to_string(&string, " (");
+		add_format_to_string(&string,
+			n_("%u hit", "%u hits", value, term), value);
+
+		value = bittorrent->cache->read_misses;
+		add_to_string(&string, " / ");
+		add_format_to_string(&string,
+			n_("%u miss", "%u misses", value, term), value);
+		add_to_string(&string, ")");
+	}
+
 	value = bittorrent->cache->locked_pieces;
 	if (value) {
 		add_to_string(&string, ", ");
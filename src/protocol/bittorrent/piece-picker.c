@@ -0,0 +1,301 @@
+/* Tool for testing and benchmarking the BitTorrent piece picker */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "elinks.h"
+
+#include "protocol/bittorrent/rarity.h"
+#include "util/bitfield.h"
+#include "util/memory.h"
+#include "util/test.h"
+
+/* A simulated swarm of neighbouring peers. The pieces and their rarities
+ * are tracked both in a plain array, which is scanned the same way the piece
+ * cache used to, and in the rarity index. */
+struct swarm {
+	uint32_t pieces;
+	int peers;
+	struct bitfield **have;
+	unsigned int *rarity;
+	unsigned char *remaining;
+	struct bittorrent_rarity_index index;
+};
+
+static void
+add_swarm_peer(struct swarm *swarm, int peer)
+{
+	/* Make some peers seeders and the others sparse. */
+	int density = peer % 4 ? 1 + rand() % 60 : 100;
+	uint32_t piece;
+
+	swarm->have[peer] = init_bitfield(swarm->pieces);
+	if (!swarm->have[peer]) die("Out of memory");
+
+	for (piece = 0; piece < swarm->pieces; piece++) {
+		if (rand() % 100 >= density)
+			continue;
+
+		set_bitfield_bit(swarm->have[peer], piece);
+
+		if (swarm->remaining[piece])
+			del_from_bittorrent_rarity_index(&swarm->index, piece,
+							 swarm->rarity[piece]);
+		swarm->rarity[piece]++;
+		if (swarm->remaining[piece]
+		    && !add_to_bittorrent_rarity_index(&swarm->index, piece,
+						       swarm->rarity[piece]))
+			die("Out of memory");
+	}
+}
+
+static void
+remove_swarm_peer(struct swarm *swarm, int peer)
+{
+	uint32_t piece;
+
+	foreach_bitfield_set (piece, swarm->have[peer]) {
+		if (swarm->remaining[piece])
+			del_from_bittorrent_rarity_index(&swarm->index, piece,
+							 swarm->rarity[piece]);
+		swarm->rarity[piece]--;
+		if (swarm->remaining[piece]
+		    && !add_to_bittorrent_rarity_index(&swarm->index, piece,
+						       swarm->rarity[piece]))
+			die("Out of memory");
+	}
+
+	mem_free(swarm->have[peer]);
+	swarm->have[peer] = NULL;
+}
+
+static void
+init_swarm(struct swarm *swarm, uint32_t pieces, int peers)
+{
+	uint32_t piece;
+	int peer;
+
+	swarm->pieces	 = pieces;
+	swarm->peers	 = peers;
+	swarm->have	 = mem_calloc(peers, sizeof(*swarm->have));
+	swarm->rarity	 = mem_calloc(pieces, sizeof(*swarm->rarity));
+	swarm->remaining = mem_calloc(pieces, sizeof(*swarm->remaining));
+
+	if (!swarm->have || !swarm->rarity || !swarm->remaining
+	    || !init_bittorrent_rarity_index(&swarm->index, pieces))
+		die("Out of memory");
+
+	for (piece = 0; piece < pieces; piece++) {
+		swarm->remaining[piece] = 1;
+		add_to_bittorrent_rarity_index(&swarm->index, piece, 0);
+	}
+
+	for (peer = 0; peer < peers; peer++)
+		add_swarm_peer(swarm, peer);
+}
+
+static void
+done_swarm(struct swarm *swarm)
+{
+	int peer;
+
+	for (peer = 0; peer < swarm->peers; peer++)
+		mem_free_if(swarm->have[peer]);
+
+	mem_free(swarm->have);
+	mem_free(swarm->rarity);
+	mem_free(swarm->remaining);
+	done_bittorrent_rarity_index(&swarm->index);
+}
+
+/* Returns the rarity of the rarest remaining piece of the peer by scanning
+ * the peer bitfield. */
+static unsigned int
+scan_rarest_piece(struct swarm *swarm, int peer, uint32_t *rarest)
+{
+	unsigned int rarity = UINT_MAX;
+	uint32_t piece;
+
+	*rarest = BITTORRENT_PIECE_UNDEF;
+
+	foreachback_bitfield_set (piece, swarm->have[peer]) {
+		if (!swarm->remaining[piece] || swarm->rarity[piece] >= rarity)
+			continue;
+
+		rarity = swarm->rarity[piece];
+		*rarest = piece;
+	}
+
+	return rarity;
+}
+
+static void
+check_picked_piece(struct swarm *swarm, int peer, uint32_t piece,
+		   int rarest)
+{
+	uint32_t expected;
+	unsigned int rarity = scan_rarest_piece(swarm, peer, &expected);
+
+	if (expected == BITTORRENT_PIECE_UNDEF) {
+		if (piece != BITTORRENT_PIECE_UNDEF)
+			die("Picked piece %u for peer %d with no remaining pieces",
+			    piece, peer);
+		return;
+	}
+
+	if (piece == BITTORRENT_PIECE_UNDEF)
+		die("No piece picked for peer %d having piece %u",
+		    peer, expected);
+
+	if (!swarm->remaining[piece])
+		die("Picked piece %u which is not remaining", piece);
+
+	if (!test_bitfield_bit(swarm->have[peer], piece))
+		die("Picked piece %u which peer %d does not have", piece, peer);
+
+	if (rarest && swarm->rarity[piece] != rarity)
+		die("Picked piece %u with rarity %u instead of %u",
+		    piece, swarm->rarity[piece], rarity);
+}
+
+static void
+request_piece(struct swarm *swarm, uint32_t piece)
+{
+	del_from_bittorrent_rarity_index(&swarm->index, piece,
+					 swarm->rarity[piece]);
+	swarm->remaining[piece] = 0;
+}
+
+/* Download the whole torrent while peers come and go, checking every
+ * picked piece against the plain scan. */
+static void
+simulate_swarm(struct swarm *swarm)
+{
+	uint32_t left = swarm->pieces;
+	int round;
+
+	for (round = 0; left; round++) {
+		int peer = rand() % swarm->peers;
+		int rarest = round % 8;
+		uint32_t piece;
+
+		if (round % 16 == 15) {
+			remove_swarm_peer(swarm, peer);
+			add_swarm_peer(swarm, peer);
+		}
+
+		piece = rarest
+		      ? find_rarest_in_bittorrent_rarity_index(&swarm->index,
+							       swarm->have[peer])
+		      : find_random_in_bittorrent_rarity_index(&swarm->index,
+							       swarm->have[peer]);
+
+		check_picked_piece(swarm, peer, piece, rarest);
+
+		if (piece != BITTORRENT_PIECE_UNDEF) {
+			request_piece(swarm, piece);
+			left--;
+
+		} else if (round > swarm->pieces * 64) {
+			/* Pieces nobody has cannot be downloaded. */
+			break;
+		}
+	}
+}
+
+static double
+get_seconds(clock_t start)
+{
+	return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Time picking a rarest piece for every peer with half of the pieces
+ * remaining. */
+static void
+benchmark_swarm(struct swarm *swarm, int rounds)
+{
+	uint32_t piece, picked = 0;
+	clock_t start;
+	double scan, index;
+	int round;
+
+	for (piece = 0; piece < swarm->pieces; piece += 2)
+		request_piece(swarm, piece);
+
+	start = clock();
+	for (round = 0; round < rounds; round++) {
+		scan_rarest_piece(swarm, round % swarm->peers, &piece);
+		picked += piece;
+	}
+	scan = get_seconds(start);
+
+	start = clock();
+	for (round = 0; round < rounds; round++) {
+		picked -= find_rarest_in_bittorrent_rarity_index(&swarm->index,
+								 swarm->have[round % swarm->peers]);
+	}
+	index = get_seconds(start);
+
+	/* Printing the sum of the picks keeps the loops from being optimized
+	 * away. */
+	printf("%u pieces, %d peers, %d picks: scan %.3fs, index %.3fs (%u)\n",
+	       swarm->pieces, swarm->peers, rounds, scan, index, picked);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct swarm swarm;
+	int pieces = 1000;
+	int peers = 20;
+	int benchmark = 0;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		char *arg = argv[i];
+
+		if (strncmp(arg, "--", 2))
+			break;
+
+		arg += 2;
+
+		if (get_test_opt(&arg, "pieces", &i, argc, argv, "a number")) {
+			pieces = atoi(arg);
+
+		} else if (get_test_opt(&arg, "peers", &i, argc, argv, "a number")) {
+			peers = atoi(arg);
+
+		} else if (get_test_opt(&arg, "seed", &i, argc, argv, "a number")) {
+			srand(atoi(arg));
+
+		} else if (get_test_opt(&arg, "benchmark", &i, argc, argv, "a number")) {
+			benchmark = atoi(arg);
+
+		} else {
+			die("Unknown argument '%s'", arg - 2);
+		}
+	}
+
+	if (pieces <= 0 || peers <= 0)
+		die("Usage: %s [--pieces N] [--peers N] [--seed N] [--benchmark ROUNDS]",
+		    argv[0]);
+
+	init_swarm(&swarm, pieces, peers);
+
+	if (benchmark)
+		benchmark_swarm(&swarm, benchmark);
+	else
+		simulate_swarm(&swarm);
+
+	done_swarm(&swarm);
+
+	return 0;
+}
@@ -29,6 +29,7 @@
 #include "protocol/bittorrent/dialogs.h"
 #include "protocol/bittorrent/peerwire.h"
 #include "protocol/bittorrent/piececache.h"
+#include "protocol/bittorrent/rarity.h"
 #include "protocol/bittorrent/tracker.h"
 #include "util/bitfield.h"
 #include "util/error.h"
@@ -39,22 +40,64 @@
 #include "util/string.h"
 
 
-/* Used as a 'not defined' value for piece indexes. */
-#define BITTORRENT_PIECE_UNDEF		UINT_MAX
-
 /* Used as a 'not interesting' value for piece rarities. */
 #define BITTORRENT_PIECE_RARITY_UNDEF	USHRT_MAX
 
+/* A list of completed and saved entries of all torrents which has been
+ * loaded into memory. The allocated memory for all these entries is
+ * disposable. The entries are sorted in a LRU-manner and the total size of
+ * their data is kept below the protocol.bittorrent.piece_cache_size. */
+static INIT_LIST_OF(struct bittorrent_piece_cache_entry, bittorrent_piece_queue);
+static off_t bittorrent_piece_queue_size;
+
+/* The piece caches of all torrents. Used for finding the owner of queued
+ * entries. */
+static INIT_LIST_OF(struct bittorrent_piece_cache, bittorrent_piece_caches);
+
 /* A shorthand to reduce long lines. */
 #define find_local_bittorrent_peer_request(peer, request) \
 	get_bittorrent_peer_request(&(peer)->local, (request)->piece, \
 				    (request)->offset, (request)->length)
 
+static void
+drop_bittorrent_piece_cache_rarity_index(struct bittorrent_piece_cache *cache)
+{
+	done_bittorrent_rarity_index(&cache->rarity_index);
+	cache->rarity_indexed = 0;
+}
+
+/* The rarity index only holds remaining pieces and must be updated around
+ * every change of the remaining flag or the rarity of a piece. */
+static inline void
+unindex_bittorrent_piece_cache_entry(struct bittorrent_piece_cache *cache,
+				     uint32_t piece)
+{
+	struct bittorrent_piece_cache_entry *entry = &cache->entries[piece];
+
+	if (cache->rarity_indexed && entry->remaining)
+		del_from_bittorrent_rarity_index(&cache->rarity_index, piece,
+						 entry->rarity);
+}
+
+static inline void
+index_bittorrent_piece_cache_entry(struct bittorrent_piece_cache *cache,
+				   uint32_t piece)
+{
+	struct bittorrent_piece_cache_entry *entry = &cache->entries[piece];
+
+	if (cache->rarity_indexed && entry->remaining
+	    && !add_to_bittorrent_rarity_index(&cache->rarity_index, piece,
+					       entry->rarity))
+		drop_bittorrent_piece_cache_rarity_index(cache);
+}
+
 static inline void
 set_bittorrent_piece_cache_remaining(struct bittorrent_piece_cache *cache,
 				     uint32_t piece, int remaining)
 {
+	unindex_bittorrent_piece_cache_entry(cache, piece);
 	cache->entries[piece].remaining = remaining > 0 ? 1 : 0;
+	index_bittorrent_piece_cache_entry(cache, piece);
 	cache->remaining_pieces += remaining;
 	cache->loading_pieces   += -remaining;
 }
@@ -63,6 +106,7 @@ static inline void
 set_bittorrent_piece_cache_completed(struct bittorrent_piece_cache *cache,
 				     uint32_t piece)
 {
+	unindex_bittorrent_piece_cache_entry(cache, piece);
 	cache->entries[piece].completed = 1;
 	cache->entries[piece].remaining = 0;
 	cache->loading_pieces--;
@@ -70,6 +114,84 @@ set_bittorrent_piece_cache_completed(struct bittorrent_piece_cache *cache,
 	set_bitfield_bit(cache->bitfield, piece);
 }
 
+static void
+queue_bittorrent_piece_cache_entry(struct bittorrent_piece_cache *cache,
+				   struct bittorrent_piece_cache_entry *entry,
+				   uint32_t piece_length)
+{
+	add_to_list(bittorrent_piece_queue, entry);
+	entry->queued = 1;
+	bittorrent_piece_queue_size += piece_length;
+	cache->memory_pieces++;
+}
+
+static void
+unqueue_bittorrent_piece_cache_entry(struct bittorrent_piece_cache *cache,
+				     struct bittorrent_piece_cache_entry *entry,
+				     uint32_t piece_length)
+{
+	del_from_list(entry);
+	entry->queued = 0;
+	bittorrent_piece_queue_size -= piece_length;
+	cache->memory_pieces--;
+}
+
+/* Get the piece cache the queued @entry belongs to. */
+static struct bittorrent_piece_cache *
+get_bittorrent_piece_cache_entry_owner(struct bittorrent_piece_cache_entry *entry)
+{
+	struct bittorrent_piece_cache *cache;
+
+	foreach (cache, bittorrent_piece_caches) {
+		if (entry >= cache->entries
+		    && entry < cache->entries + cache->bittorrent->meta.pieces)
+			return cache;
+	}
+
+	return NULL;
+}
+
+/* The strategy is to keep the most recently accessed pieces of all torrents
+ * in memory up to the configured size. */
+static void
+shrink_bittorrent_piece_queue(void)
+{
+	struct bittorrent_piece_cache_entry *entry, *prev;
+	off_t cache_size = get_opt_int("protocol.bittorrent.piece_cache_size",
+	                               NULL);
+
+	if (!cache_size) return;
+
+	foreachbacksafe (entry, prev, bittorrent_piece_queue) {
+		struct bittorrent_piece_cache *cache;
+		uint32_t piece_length, piece;
+
+		if (bittorrent_piece_queue_size <= cache_size)
+			break;
+
+		/* Allow at least one piece! */
+		if (entry == (void *) bittorrent_piece_queue.next)
+			break;
+
+		if (entry->locked)
+			continue;
+
+		cache = get_bittorrent_piece_cache_entry_owner(entry);
+		assertm(cache != NULL, "Queued piece without a cache");
+		if_assert_failed continue;
+
+		assert(entry->data && entry->completed);
+
+		piece = entry - cache->entries;
+		piece_length = get_bittorrent_piece_length(&cache->bittorrent->meta,
+							   piece);
+
+		unqueue_bittorrent_piece_cache_entry(cache, entry, piece_length);
+		mem_mmap_free(entry->data, piece_length);
+		entry->data = NULL;
+	}
+}
+
 static void
 handle_bittorrent_mode_changes(struct bittorrent_connection *bittorrent)
 {
@@ -168,6 +290,10 @@ find_random_in_bittorrent_piece_cache(struct bittorrent_piece_cache *cache,
 
 	seed_rand_once();
 
+	if (cache->rarity_indexed)
+		return find_random_in_bittorrent_rarity_index(&cache->rarity_index,
+							      peer->bitfield);
+
 	foreachback_bitfield_set (piece, peer->bitfield) {
 		assertm(cache->entries[piece].rarity,
 			"Piece cache out of sync");
@@ -241,6 +367,10 @@ find_rarest_in_bittorrent_piece_cache(struct bittorrent_piece_cache *cache,
 
 	seed_rand_once();
 
+	if (cache->rarity_indexed)
+		return find_rarest_in_bittorrent_rarity_index(&cache->rarity_index,
+							      peer->bitfield);
+
 	/* Try to randomize the piece picking using the strategy from the random
 	 * piece selection. */
 	foreachback_bitfield_set (piece, peer->bitfield) {
@@ -541,9 +671,11 @@ update_bittorrent_piece_cache(struct bittorrent_peer_connection *peer,
 	    && !cache->entries[piece].rarity)
 		cache->unavailable_pieces--;
 
+	unindex_bittorrent_piece_cache_entry(cache, piece);
 	cache->entries[piece].rarity++;
 	assertm(cache->entries[piece].rarity <= list_size(&peer->bittorrent->peers),
 		"Piece rarity overflow");
+	index_bittorrent_piece_cache_entry(cache, piece);
 }
 
 void
@@ -567,9 +699,11 @@ remove_bittorrent_peer_from_piece_cache(struct bittorrent_peer_connection *peer)
 	assert(peer->bitfield);
 
 	foreach_bitfield_set (piece, peer->bitfield) {
+		unindex_bittorrent_piece_cache_entry(cache, piece);
 		cache->entries[piece].rarity--;
 		assertm(cache->entries[piece].rarity <= list_size(&peer->bittorrent->peers),
 			"Piece rarity underflow");
+		index_bittorrent_piece_cache_entry(cache, piece);
 
 		if (!cache->entries[piece].completed
 		    && !cache->entries[piece].rarity)
@@ -646,14 +780,43 @@ enum bittorrent_translation {
 	BITTORRENT_SEEK,
 };
 
+/* The maximum number of files kept open by each piece cache. */
+#define BITTORRENT_FILE_HANDLES		16
+
+/* An open file of the torrent. Pieces are read and written with positional
+ * I/O, so the descriptors can be shared by all pieces mapping to the file. */
+struct bittorrent_file_handle {
+	LIST_HEAD(struct bittorrent_file_handle);
+
+	struct bittorrent_file *file;
+	int fd;
+	unsigned int writable:1;
+};
+
+static void
+close_bittorrent_file_handle(struct bittorrent_file_handle *handle)
+{
+	del_from_list(handle);
+	close(handle->fd);
+	mem_free(handle);
+}
+
+static void
+close_bittorrent_files(struct bittorrent_piece_cache *cache)
+{
+	while (!list_empty(cache->files))
+		close_bittorrent_file_handle(cache->files.next);
+}
+
 static int
 open_bittorrent_file(struct bittorrent_meta *meta, struct bittorrent_file *file,
-		     enum bittorrent_translation trans, off_t offset)
+		     enum bittorrent_translation trans)
 {
 	unsigned char *name = get_bittorrent_file_name(meta, file);
-	off_t seek_result;
 	int fd;
-	int flags = (trans == BITTORRENT_WRITE ? O_WRONLY : O_RDONLY);
+	/* Files are opened for both reading and writing when writing so the
+	 * descriptor can be used for serving the written pieces to peers. */
+	int flags = (trans == BITTORRENT_WRITE ? O_RDWR : O_RDONLY);
 
 	assert(trans != BITTORRENT_SEEK);
 
@@ -671,26 +834,111 @@ open_bittorrent_file(struct bittorrent_meta *meta, struct bittorrent_file *file,
 
 	mem_free(name);
 
-	if (fd == -1) return -1;
+	return fd;
+}
 
-	if (trans == BITTORRENT_READ) {
-		struct stat stat;
+/* Get a descriptor of the file usable for the translation. Recently used
+ * descriptors are cached to avoid opening and closing files for each
+ * piece. */
+static int
+get_bittorrent_file_handle(struct bittorrent_meta *meta,
+			   struct bittorrent_piece_cache *cache,
+			   struct bittorrent_file *file,
+			   enum bittorrent_translation trans)
+{
+	struct bittorrent_file_handle *handle;
+	int handles = 0;
+	int fd;
 
-		if (fstat(fd, &stat) < -1 || stat.st_size < offset) {
-			close(fd);
-			return -1;
+	foreach (handle, cache->files) {
+		handles++;
+
+		if (handle->file != file)
+			continue;
+
+		if (trans == BITTORRENT_WRITE && !handle->writable) {
+			/* Reopen it for writing. */
+			close_bittorrent_file_handle(handle);
+			handles--;
+			break;
 		}
+
+		move_to_top_of_list(cache->files, handle);
+		return handle->fd;
 	}
 
-	seek_result = lseek(fd, offset, SEEK_SET);
-	if (seek_result == (off_t) -1 || seek_result != offset) {
-		close(fd);
-		return -1;
+	fd = open_bittorrent_file(meta, file, trans);
+	if (fd == -1) return -1;
+
+	handle = mem_alloc(sizeof(*handle));
+	if (!handle) {
+		/* Still usable for this translation only. */
+		return fd;
 	}
 
+	if (handles >= BITTORRENT_FILE_HANDLES)
+		close_bittorrent_file_handle(cache->files.prev);
+
+	handle->file	 = file;
+	handle->fd	 = fd;
+	handle->writable = (trans == BITTORRENT_WRITE);
+	add_to_list(cache->files, handle);
+
 	return fd;
 }
 
+/* Returns non-zero if @fd is cached and should not be closed after use. */
+static int
+is_bittorrent_file_handle(struct bittorrent_piece_cache *cache, int fd)
+{
+	struct bittorrent_file_handle *handle = cache->files.next;
+
+	/* The handle is always moved to the top when used. */
+	return !list_empty(cache->files) && handle->fd == fd;
+}
+
+/* Read or write all the @length bytes of @data at @offset in the file. */
+static int
+transfer_bittorrent_file_data(int fd, unsigned char *data, uint32_t length,
+			      off_t offset, enum bittorrent_translation trans)
+{
+#if !defined(HAVE_PREAD) || !defined(HAVE_PWRITE)
+	off_t seek_result = lseek(fd, offset, SEEK_SET);
+
+	if (seek_result == (off_t) -1 || seek_result != offset)
+		return 0;
+#endif
+
+	while (length > 0) {
+		ssize_t done;
+
+#if defined(HAVE_PREAD) && defined(HAVE_PWRITE)
+		if (trans == BITTORRENT_READ)
+			done = pread(fd, data, length, offset);
+		else
+			done = pwrite(fd, data, length, offset);
+
+		if (done == -1 && errno == EINTR)
+			continue;
+#else
+		if (trans == BITTORRENT_READ)
+			done = safe_read(fd, data, length);
+		else
+			done = safe_write(fd, data, length);
+#endif
+		/* Reading beyond the end of file means the piece is not
+		 * there. */
+		if (done <= 0)
+			return 0;
+
+		data   += done;
+		length -= done;
+		offset += done;
+	}
+
+	return 1;
+}
+
 static enum bittorrent_state
 bittorrent_file_piece_translation(struct bittorrent_meta *meta,
 				  struct bittorrent_piece_cache *cache,
@@ -718,7 +966,7 @@ bittorrent_file_piece_translation(struct bittorrent_meta *meta,
 		unsigned char *data;
 		off_t file_offset, file_length;
 		uint32_t data_length;
-		ssize_t length;
+		int transferred;
 		int fd;
 
 		if (piece_offset >= piece_length)
@@ -777,9 +1025,8 @@ bittorrent_file_piece_translation(struct bittorrent_meta *meta,
 			assert(entry->completed && trans == BITTORRENT_READ);
 		}
 
-		/* Open at the desired offset and possibly create the file and
-		 * parent directories. */
-		fd = open_bittorrent_file(meta, file, trans, file_offset);
+		/* Possibly create the file and parent directories. */
+		fd = get_bittorrent_file_handle(meta, cache, file, trans);
 		if (fd == -1) {
 			/* Try to gracefully handle bogus paths; empty file
 			 * names and directory names. */
@@ -803,17 +1050,15 @@ bittorrent_file_piece_translation(struct bittorrent_meta *meta,
 		data = &entry->data[piece_offset];
 
 		/* Do it! ;-) */
-		if (trans == BITTORRENT_READ) {
-			length = safe_read(fd, data, data_length);
-		} else {
-			length = safe_write(fd, data, data_length);
-		}
+		transferred = transfer_bittorrent_file_data(fd, data, data_length,
+							    file_offset, trans);
 
 		/* Cleanup. */
-		close(fd);
+		if (!is_bittorrent_file_handle(cache, fd))
+			close(fd);
 
 		/* Check if the operation failed. */
-		if (length != data_length)
+		if (!transferred)
 			return BITTORRENT_STATE_ERROR;
 
 		/* Prepare the next iteration. */
@@ -836,7 +1081,7 @@ bittorrent_file_piece_translation(struct bittorrent_meta *meta,
 	if (trans != BITTORRENT_SEEK) {
 		/* Whether we just read or wrote the piece, it is now
 		 * disposable. */
-		add_to_list(cache->queue, entry);
+		queue_bittorrent_piece_cache_entry(cache, entry, piece_length);
 	}
 
 	return BITTORRENT_STATE_OK;
@@ -955,6 +1200,9 @@ add_to_bittorrent_piece_cache(struct bittorrent_peer_connection *peer,
 		return state;
 	}
 
+	/* Make room for the written piece. */
+	shrink_bittorrent_piece_queue();
+
 	/* Handle mode changes ... */
 	handle_bittorrent_mode_changes(bittorrent);
 
@@ -977,16 +1225,20 @@ get_bittorrent_piece_cache_data(struct bittorrent_connection *bittorrent,
 		return NULL;
 
 	if (entry->data) {
-		move_to_top_of_list(cache->queue, entry);
+		move_to_top_of_list(bittorrent_piece_queue, entry);
+		cache->read_hits++;
 		return entry->data;
 	}
 
 	/* Load the piece data from disk. */
+	cache->read_misses++;
 	state = bittorrent_file_piece_translation(&bittorrent->meta, cache,
 						  entry, piece, BITTORRENT_READ);
 	if (state != BITTORRENT_STATE_OK)
 		return NULL;
 
+	shrink_bittorrent_piece_queue();
+
 	return entry->data;
 }
 
@@ -1089,7 +1341,7 @@ bittorrent_resume_writer(void *data, int fd)
 	}
 
 	memset(&cache, 0, sizeof(cache));
-	init_list(cache.queue);
+	init_list(cache.files);
 
 	if (set_blocking_fd(fd) < 0) {
 		done_bittorrent_meta(&meta);
@@ -1119,7 +1371,8 @@ bittorrent_resume_writer(void *data, int fd)
 
 		if (entry.data) {
 			if (state == BITTORRENT_STATE_OK)
-				del_from_list(&entry);
+				unqueue_bittorrent_piece_cache_entry(&cache, &entry,
+								     length);
 			mem_mmap_free(entry.data, length);
 		}
 
@@ -1128,6 +1381,7 @@ bittorrent_resume_writer(void *data, int fd)
 			break;
 	}
 
+	close_bittorrent_files(&cache);
 	done_bittorrent_meta(&meta);
 }
 
@@ -1208,40 +1462,10 @@ start_bittorrent_resume(struct bittorrent_connection *bittorrent,
 /* ************************************************************************** */
 
 /* Periodically called to shrink the cache. */
-/* The strategy is to  keep the n most recently accessed pieces in memory, chunk
- * the rest n depends on amount of memory available */
 void
 update_bittorrent_piece_cache_state(struct bittorrent_connection *bittorrent)
 {
-	struct bittorrent_piece_cache *cache = bittorrent->cache;
-	struct bittorrent_piece_cache_entry *entry, *next;
-	off_t cache_size = get_opt_int("protocol.bittorrent.piece_cache_size",
-	                               NULL);
-	off_t current_size = 0;
-
-	if (!cache_size) return;
-
-	foreachsafe (entry, next, cache->queue) {
-		uint32_t piece_length, piece;
-
-		assert(entry->data && entry->completed);
-
-		piece = entry - cache->entries;
-
-		assert(piece < bittorrent->meta.pieces);
-		assert(entry == &cache->entries[piece]);
-
-		piece_length = get_bittorrent_piece_length(&bittorrent->meta, piece);
-		current_size += piece_length;
-
-		/* Allow at least one piece! */
-		if (current_size < cache_size || entry->locked)
-			continue;
-
-		del_from_list(entry);
-		mem_mmap_free(entry->data, piece_length);
-		entry->data = NULL;
-	}
+	shrink_bittorrent_piece_queue();
 }
 
 enum bittorrent_state
@@ -1264,10 +1488,19 @@ init_bittorrent_piece_cache(struct bittorrent_connection *bittorrent,
 		return BITTORRENT_STATE_OUT_OF_MEM;
 	}
 
-	init_list(cache->queue);
 	init_list(cache->free_list);
+	init_list(cache->files);
+
+	/* Without the rarity index pieces are picked by scanning the peer
+	 * bitfields so failing to allocate it is not fatal. */
+	cache->rarity_indexed = init_bittorrent_rarity_index(&cache->rarity_index,
+							     pieces);
+	if (!cache->rarity_indexed)
+		drop_bittorrent_piece_cache_rarity_index(cache);
 
 	bittorrent->cache = cache;
+	cache->bittorrent = bittorrent;
+	add_to_list(bittorrent_piece_caches, cache);
 
 	/* Do the initialization of the connection stats; bytes left and
 	 * estimated length in particular. Placed here so that downloaded
@@ -1279,7 +1512,7 @@ init_bittorrent_piece_cache(struct bittorrent_connection *bittorrent,
 
  	start_bittorrent_resume(bittorrent, metafile);
 
-	assert(list_empty(cache->queue));
+	assert(!cache->memory_pieces);
 
  	return cache->resume_fd == -1
  		? BITTORRENT_STATE_OK : BITTORRENT_STATE_CACHE_RESUME;
@@ -1331,13 +1564,20 @@ done_bittorrent_piece_cache(struct bittorrent_connection *bittorrent)
 			continue;
 
 		length = get_bittorrent_piece_length(&bittorrent->meta, piece);
+		if (entry->queued)
+			unqueue_bittorrent_piece_cache_entry(cache, entry, length);
 		mem_mmap_free(entry->data, length);
 	}
 
+	assert(!cache->memory_pieces);
+	del_from_list(cache);
+	close_bittorrent_files(cache);
+
 	if (cache->delete_files)
 		delete_bittorrent_files(bittorrent);
 
 	free_list(cache->free_list);
+	done_bittorrent_rarity_index(&cache->rarity_index);
 	mem_free_if(cache->bitfield);
 	mem_free(cache);
 }
@@ -3,6 +3,7 @@
 #define EL__PROTOCOL_BITTORRENT_PIECECACHE_H
 
 #include "protocol/bittorrent/common.h"
+#include "protocol/bittorrent/rarity.h"
 #include "util/lists.h"
 
 struct bitfield;
@@ -23,6 +24,7 @@ struct bittorrent_piece_cache_entry {
 	unsigned int remaining:1;	/**< Nothing has been even requested. */
 	unsigned int locked:1;		/**< Edge piece from partial downloads. */
 	unsigned int selected:1;	/**< Piece is part of partial download. */
+	unsigned int queued:1;		/**< Data is disposable and queued. */
 
 	/** A bitfield of the blocks which remains to be downloaded for this
 	 * piece. May be NULL if downloading is not in progress. */
@@ -36,6 +38,11 @@ struct bittorrent_piece_cache_entry {
 };
 
 struct bittorrent_piece_cache {
+	LIST_HEAD(struct bittorrent_piece_cache);
+
+	/** The torrent owning the cache. */
+	struct bittorrent_connection *bittorrent;
+
 	/* The following is mostly maintained for making it easy to display in
 	 * dialogs. */
 	unsigned int remaining_pieces;	/**< Number of untouched pieces */
@@ -45,12 +52,20 @@ struct bittorrent_piece_cache {
 	unsigned int unavailable_pieces;/**< Number of unavailable pieces */
 	unsigned int partial_pieces;	/**< Number of selected file pieces */
 	unsigned int locked_pieces;	/**< Pieces locked due to partial download */
+	unsigned int memory_pieces;	/**< Number of disposable pieces in memory */
+	unsigned int read_hits;		/**< Uploaded pieces found in memory */
+	unsigned int read_misses;	/**< Uploaded pieces read from disk */
 
 	/* Flags set from the download dialog. */
 	unsigned int delete_files:1;	/**< Unlink files on shutdown? */
 	unsigned int notify_complete:1;	/**< Notify upon completion? */
 	unsigned int partial:1;		/**< Dealing with a partial download? */
 
+	/** Is the #rarity_index usable? It is dropped if memory for one of
+	 * its buckets could not be allocated and the piece picking then falls
+	 * back to scanning the peer bitfields. */
+	unsigned int rarity_indexed:1;
+
 	/** The pipe descripter used for communicating with the resume thread. */
 	int resume_fd;
 	uint32_t resume_pos;
@@ -58,10 +73,11 @@ struct bittorrent_piece_cache {
 	/** A bitfield of the available pieces. */
 	struct bitfield *bitfield;
 
-	/** A list of completed and saved entries which has been loaded into
-	 * memory. The allocated memory for all these entries is disposable. The
-	 * entries are sorted in a LRU-manner. */
-	LIST_OF(struct bittorrent_piece_cache_entry) queue;
+	/** The remaining pieces grouped by their rarity for piece picking. */
+	struct bittorrent_rarity_index rarity_index;
+
+	/** Recently used open files of the torrent, most recent first. */
+	LIST_OF(struct bittorrent_file_handle) files;
 
 	/** Remaining pieces are tracked using the remaining_blocks member of the
 	 * piece cache entry and a free list of piece blocks to be requested.
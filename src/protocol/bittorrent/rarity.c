@@ -0,0 +1,233 @@
+/* BitTorrent piece rarity index */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elinks.h"
+
+#include "protocol/bittorrent/rarity.h"
+#include "util/bitfield.h"
+#include "util/error.h"
+#include "util/math.h"
+#include "util/memory.h"
+
+
+/* The bitfields are scanned in chunks of this type. */
+typedef unsigned long bittorrent_rarity_chunk_T;
+
+int
+init_bittorrent_rarity_index(struct bittorrent_rarity_index *index,
+			     uint32_t pieces)
+{
+	memset(index, 0, sizeof(*index));
+
+	index->pieces	 = pieces;
+	index->remaining = init_bitfield(pieces);
+
+	return index->remaining != NULL;
+}
+
+void
+done_bittorrent_rarity_index(struct bittorrent_rarity_index *index)
+{
+	unsigned int rarity;
+
+	for (rarity = 0; rarity < index->size; rarity++)
+		mem_free_if(index->buckets[rarity]);
+
+	mem_free_if(index->buckets);
+	mem_free_if(index->bucket_sizes);
+	mem_free_if(index->remaining);
+	memset(index, 0, sizeof(*index));
+}
+
+/* Make sure that there is a bucket for @rarity. */
+static struct bitfield *
+get_bittorrent_rarity_bucket(struct bittorrent_rarity_index *index,
+			     unsigned int rarity)
+{
+	if (rarity >= index->size) {
+		/* Grow a little ahead since rarities increase one by one when
+		 * peers connect. */
+		unsigned int size = rarity + 8;
+		struct bitfield **buckets;
+		uint32_t *sizes;
+
+		buckets = mem_realloc(index->buckets, size * sizeof(*buckets));
+		if (!buckets) return NULL;
+		index->buckets = buckets;
+
+		sizes = mem_realloc(index->bucket_sizes, size * sizeof(*sizes));
+		if (!sizes) return NULL;
+		index->bucket_sizes = sizes;
+
+		memset(&buckets[index->size], 0,
+		       (size - index->size) * sizeof(*buckets));
+		memset(&sizes[index->size], 0,
+		       (size - index->size) * sizeof(*sizes));
+		index->size = size;
+	}
+
+	if (!index->buckets[rarity])
+		index->buckets[rarity] = init_bitfield(index->pieces);
+
+	return index->buckets[rarity];
+}
+
+int
+add_to_bittorrent_rarity_index(struct bittorrent_rarity_index *index,
+			       uint32_t piece, unsigned int rarity)
+{
+	struct bitfield *bucket;
+
+	assert(piece < index->pieces);
+	if_assert_failed return 1;
+
+	set_bitfield_bit(index->remaining, piece);
+	if (!rarity) return 1;
+
+	bucket = get_bittorrent_rarity_bucket(index, rarity);
+	if (!bucket) return 0;
+
+	assertm(!test_bitfield_bit(bucket, piece), "Piece %u indexed twice",
+		piece);
+
+	set_bitfield_bit(bucket, piece);
+	index->bucket_sizes[rarity]++;
+	return 1;
+}
+
+void
+del_from_bittorrent_rarity_index(struct bittorrent_rarity_index *index,
+				 uint32_t piece, unsigned int rarity)
+{
+	assert(piece < index->pieces);
+	if_assert_failed return;
+
+	clear_bitfield_bit(index->remaining, piece);
+
+	if (!rarity || rarity >= index->size || !index->buckets[rarity])
+		return;
+
+	assertm(test_bitfield_bit(index->buckets[rarity], piece),
+		"Piece %u missing from rarity bucket %u", piece, rarity);
+
+	clear_bitfield_bit(index->buckets[rarity], piece);
+	index->bucket_sizes[rarity]--;
+}
+
+/* Load the chunk at byte @offset of @bitfield. The last chunk is padded
+ * with zero bits. */
+static inline bittorrent_rarity_chunk_T
+get_bittorrent_rarity_chunk(struct bitfield *bitfield, size_t offset,
+			    size_t length)
+{
+	bittorrent_rarity_chunk_T chunk = 0;
+
+	memcpy(&chunk, &bitfield->bits[offset], length);
+	return chunk;
+}
+
+/* Pick the @nth piece set in both bitfields among the @length bytes
+ * from @offset. */
+static uint32_t
+get_bittorrent_rarity_nth_piece(struct bitfield *pieces, struct bitfield *have,
+				size_t offset, size_t length, unsigned int nth)
+{
+	size_t pos;
+
+	for (pos = offset; pos < offset + length; pos++) {
+		unsigned char bits = pieces->bits[pos] & have->bits[pos];
+		unsigned int bit;
+
+		for (bit = 0; bits && bit < 8; bit++) {
+			if (!(bits & get_bitfield_bit_offset(bit)))
+				continue;
+			if (!nth--)
+				return pos * 8 + bit;
+		}
+	}
+
+	return BITTORRENT_PIECE_UNDEF;
+}
+
+/* Find a piece set in both @pieces and @have. The search starts at a
+ * random chunk and a random piece is taken from the first chunk which has
+ * any, which gives a reasonable variety without having to collect all
+ * candidates. */
+static uint32_t
+find_bittorrent_rarity_intersection(struct bitfield *pieces,
+				    struct bitfield *have)
+{
+	size_t bytes = get_bitfield_byte_size(pieces->bitsize);
+	size_t chunk_size = sizeof(bittorrent_rarity_chunk_T);
+	size_t chunks = (bytes + chunk_size - 1) / chunk_size;
+	size_t chunk, scanned;
+
+	assert(pieces->bitsize == have->bitsize);
+	if_assert_failed return BITTORRENT_PIECE_UNDEF;
+
+	if (!chunks) return BITTORRENT_PIECE_UNDEF;
+
+	chunk = rand() % chunks;
+
+	for (scanned = 0; scanned < chunks; scanned++, chunk++) {
+		bittorrent_rarity_chunk_T both;
+		size_t offset, length;
+		unsigned int count = 0;
+		size_t pos;
+
+		if (chunk == chunks) chunk = 0;
+
+		offset = chunk * chunk_size;
+		length = int_min(chunk_size, bytes - offset);
+		both   = get_bittorrent_rarity_chunk(pieces, offset, length)
+		       & get_bittorrent_rarity_chunk(have, offset, length);
+		if (!both) continue;
+
+		for (pos = offset; pos < offset + length; pos++) {
+			unsigned char bits = pieces->bits[pos] & have->bits[pos];
+
+			for (; bits; bits &= bits - 1)
+				count++;
+		}
+
+		return get_bittorrent_rarity_nth_piece(pieces, have, offset,
+						       length, rand() % count);
+	}
+
+	return BITTORRENT_PIECE_UNDEF;
+}
+
+uint32_t
+find_rarest_in_bittorrent_rarity_index(struct bittorrent_rarity_index *index,
+				       struct bitfield *have)
+{
+	unsigned int rarity;
+
+	for (rarity = 1; rarity < index->size; rarity++) {
+		uint32_t piece;
+
+		if (!index->bucket_sizes[rarity])
+			continue;
+
+		piece = find_bittorrent_rarity_intersection(index->buckets[rarity],
+							    have);
+		if (piece != BITTORRENT_PIECE_UNDEF)
+			return piece;
+	}
+
+	return BITTORRENT_PIECE_UNDEF;
+}
+
+uint32_t
+find_random_in_bittorrent_rarity_index(struct bittorrent_rarity_index *index,
+				       struct bitfield *have)
+{
+	return find_bittorrent_rarity_intersection(index->remaining, have);
+}
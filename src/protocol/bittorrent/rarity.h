@@ -0,0 +1,55 @@
+#ifndef EL__PROTOCOL_BITTORRENT_RARITY_H
+#define EL__PROTOCOL_BITTORRENT_RARITY_H
+
+struct bitfield;
+
+/* Used as a 'not defined' value for piece indexes. */
+#define BITTORRENT_PIECE_UNDEF		UINT_MAX
+
+/** Rarity buckets of the remaining pieces
+ *
+ * The pieces that remain to be requested are kept in one bitfield per
+ * rarity, that is per number of neighbouring peers having the piece.
+ * Picking a piece for a peer then only needs to intersect the peer's
+ * bitfield with the buckets, rarest first, one machine word at a time
+ * instead of looking up every single piece the peer has.
+ *
+ * The piece cache keeps the buckets up to date by removing a piece before
+ * its rarity or remaining state changes and adding it again afterwards. */
+struct bittorrent_rarity_index {
+	uint32_t pieces;		/**< Number of pieces in the torrent. */
+
+	/** All remaining pieces regardless of their rarity. */
+	struct bitfield *remaining;
+
+	/** Bucket number N holds the remaining pieces with rarity N. Bucket
+	 * zero is never allocated since no peer can give us such pieces. */
+	struct bitfield **buckets;
+	/** The number of pieces in each bucket so empty ones can be skipped. */
+	uint32_t *bucket_sizes;
+	/** The number of allocated buckets. */
+	unsigned int size;
+};
+
+int init_bittorrent_rarity_index(struct bittorrent_rarity_index *index,
+				 uint32_t pieces);
+void done_bittorrent_rarity_index(struct bittorrent_rarity_index *index);
+
+/** Add a remaining @a piece with the given @a rarity. Returns zero if the
+ * bucket could not be allocated. */
+int add_to_bittorrent_rarity_index(struct bittorrent_rarity_index *index,
+				   uint32_t piece, unsigned int rarity);
+void del_from_bittorrent_rarity_index(struct bittorrent_rarity_index *index,
+				      uint32_t piece, unsigned int rarity);
+
+/** Pick one of the rarest remaining pieces which is set in @a have.
+ * Returns #BITTORRENT_PIECE_UNDEF if there is none. */
+uint32_t find_rarest_in_bittorrent_rarity_index(struct bittorrent_rarity_index *index,
+						struct bitfield *have);
+
+/** Pick a random remaining piece which is set in @a have.
+ * Returns #BITTORRENT_PIECE_UNDEF if there is none. */
+uint32_t find_random_in_bittorrent_rarity_index(struct bittorrent_rarity_index *index,
+						struct bitfield *have);
+
+#endif
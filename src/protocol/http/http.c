@@ -15,6 +15,7 @@
 #include "elinks.h"
 
 #include "cache/cache.h"
+#include "cache/disk.h"
 #include "config/options.h"
 #include "cookies/cookies.h"
 #include "intl/charsets.h"
@@ -680,6 +681,9 @@ http_send_header(struct socket *socket)
 	}
 
 	if (!conn->cached) conn->cached = find_in_cache(uri);
+	/* A stale copy from the disk cache can still be revalidated. */
+	if (!conn->cached && conn->cache_mode <= CACHE_MODE_CHECK_IF_MODIFIED)
+		conn->cached = load_disk_cache_entry(uri, 0);
 
 	talking_to_proxy = IS_PROXY_URI(conn->uri) && !conn->socket->ssl;
 	use_connect = connection_is_https_proxy(conn) && !conn->socket->ssl;
@@ -1570,6 +1574,8 @@ again:
 	conn->cached->cgi = conn->cgi;
 	mem_free_set(&conn->cached->head, head);
 
+	conn->cached->stale_while_revalidate = 0;
+
 	if (!get_opt_bool("document.cache.ignore_cache_control", NULL)) {
 		struct cache_entry *cached = conn->cached;
 
@@ -1622,6 +1628,10 @@ again:
 
 					cached->expire = 1;
 				}
+
+				pos = strstr(d, "stale-while-revalidate=");
+				if (pos)
+					cached->stale_while_revalidate = atol(pos + 23);
 			}
 
 			mem_free(d);
@@ -140,7 +140,7 @@ l_current_document(LS)
 {
 	if (lua_ses && lua_ses->doc_view && lua_ses->doc_view->document) {
 		struct cache_entry *cached = lua_ses->doc_view->document->cached;
-		struct fragment *f = cached ? cached->frag.next : NULL;
+		struct fragment *f = cached ? get_cache_fragment(cached) : NULL;
 
 		if (f && f->length) {
 			lua_pushlstring(S, f->data, f->length);
@@ -231,6 +231,7 @@ Functions:\n\
 \n\
 bind_key() -- Bind a keystroke to a callable object.\n\
 current_document() -- Return the body of the document being viewed.\n\
+current_document_buffer() -- Return a buffer over the body of the document.\n\
 current_header() -- Return the header of the document being viewed.\n\
 current_link_url() -- Return the URL of the currently selected link.\n\
 current_title() -- Return the title of the document being viewed.\n\
@@ -240,6 +241,7 @@ input_box() -- Prompt for user input.\n\
 load() -- Load a document into the ELinks cache.\n\
 menu() -- Display a menu.\n\
 open() -- View a document.\n\
+replace_document_range() -- Edit the body of the document in place.\n\
 \n\
 Exception classes:\n\
 \n\
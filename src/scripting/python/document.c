@@ -12,6 +12,7 @@
 #include "document/document.h"
 #include "document/view.h"
 #include "scripting/python/core.h"
+#include "scripting/python/document.h"
 #include "session/session.h"
 
 /* Python interface to get the current document's body. */
@@ -27,7 +28,7 @@ python_current_document(PyObject *self, PyObject *args)
 	if (python_ses && python_ses->doc_view
 	    && python_ses->doc_view->document) {
 		struct cache_entry *cached = python_ses->doc_view->document->cached;
-		struct fragment *f = cached ? cached->frag.next : NULL;
+		struct fragment *f = cached ? get_cache_fragment(cached) : NULL;
 
 		if (f) return PyString_FromStringAndSize(f->data, f->length);
 	}
@@ -36,6 +37,197 @@ python_current_document(PyObject *self, PyObject *args)
 	return Py_None;
 }
 
+struct cache_entry *python_cached = NULL;
+
+/* The cache entry that current_document_buffer() and
+ * replace_document_range() work on. */
+static struct cache_entry *
+get_python_cache_entry(void)
+{
+	if (python_cached) return python_cached;
+
+	if (python_ses && python_ses->doc_view
+	    && python_ses->doc_view->document)
+		return python_ses->doc_view->document->cached;
+
+	return NULL;
+}
+
+/* A cache_view is the base object of the buffers handed out by
+ * current_document_buffer().  It keeps the cache entry locked and
+ * looks up its data whenever the buffer is read, because edits and
+ * defragmentation may move the data. */
+
+struct cache_view {
+	PyObject_HEAD
+	struct cache_entry *cached;
+};
+
+static void
+cache_view_dealloc(PyObject *self)
+{
+	struct cache_view *view = (struct cache_view *) self;
+
+	object_unlock(view->cached);
+	PyObject_Del(self);
+}
+
+static Py_ssize_t
+cache_view_getreadbuffer(PyObject *self, Py_ssize_t segment, void **ptr)
+{
+	struct cache_view *view = (struct cache_view *) self;
+	struct fragment *fragment;
+
+	if (segment != 0) {
+		PyErr_SetString(PyExc_SystemError,
+				"accessing non-existent segment");
+		return -1;
+	}
+
+	fragment = get_cache_fragment(view->cached);
+	if (!fragment) {
+		*ptr = (void *) "";
+		return 0;
+	}
+
+	*ptr = fragment->data;
+	return fragment->length;
+}
+
+static Py_ssize_t
+cache_view_getsegcount(PyObject *self, Py_ssize_t *length)
+{
+	if (length) {
+		void *ptr;
+
+		*length = cache_view_getreadbuffer(self, 0, &ptr);
+	}
+
+	return 1;
+}
+
+static PyBufferProcs cache_view_as_buffer = {
+	cache_view_getreadbuffer,			/* bf_getreadbuffer */
+	NULL,						/* bf_getwritebuffer */
+	cache_view_getsegcount,				/* bf_getsegcount */
+	(charbufferproc) cache_view_getreadbuffer,	/* bf_getcharbuffer */
+};
+
+static PyTypeObject cache_view_type = {
+	PyObject_HEAD_INIT(NULL)
+	0,				/* ob_size */
+	"elinks.cache_view",		/* tp_name */
+	sizeof(struct cache_view),	/* tp_basicsize */
+	0,				/* tp_itemsize */
+	cache_view_dealloc,		/* tp_dealloc */
+	0,				/* tp_print */
+	0,				/* tp_getattr */
+	0,				/* tp_setattr */
+	0,				/* tp_compare */
+	0,				/* tp_repr */
+	0,				/* tp_as_number */
+	0,				/* tp_as_sequence */
+	0,				/* tp_as_mapping */
+	0,				/* tp_hash */
+	0,				/* tp_call */
+	0,				/* tp_str */
+	0,				/* tp_getattro */
+	0,				/* tp_setattro */
+	&cache_view_as_buffer,		/* tp_as_buffer */
+	Py_TPFLAGS_DEFAULT,		/* tp_flags */
+};
+
+/* Return a read-only buffer object over the data of @cached.  */
+
+PyObject *
+python_get_document_buffer(struct cache_entry *cached)
+{
+	struct cache_view *view;
+	PyObject *buffer;
+
+	view = PyObject_New(struct cache_view, &cache_view_type);
+	if (!view) return NULL;
+
+	object_lock(cached);
+	view->cached = cached;
+
+	buffer = PyBuffer_FromObject((PyObject *) view, 0, Py_END_OF_BUFFER);
+	Py_DECREF(view);
+
+	return buffer;
+}
+
+/* Python interface to get the current document's body without copying it. */
+
+static char python_current_document_buffer_doc[] =
+PYTHON_DOCSTRING("current_document_buffer() -> buffer or None\n\
+\n\
+If a document is being viewed or rewritten by pre_format_html_buffer_hook(),\n\
+return a read-only buffer over its body; otherwise return None.\n\
+\n\
+The body is not copied.  The buffer always shows the current body,\n\
+including changes made with replace_document_range().  Slicing the\n\
+buffer or passing it to str() copies the selected bytes.\n");
+
+static PyObject *
+python_current_document_buffer(PyObject *self, PyObject *args)
+{
+	struct cache_entry *cached = get_python_cache_entry();
+
+	if (cached && get_cache_fragment(cached))
+		return python_get_document_buffer(cached);
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+/* Python interface to edit the current document's body in place. */
+
+static char python_replace_document_range_doc[] =
+PYTHON_DOCSTRING("replace_document_range(start, end, string) -> None\n\
+\n\
+Replace the bytes from offset start up to offset end of the body of the\n\
+document returned by current_document_buffer() with a string.  The body\n\
+is edited in place.\n\
+\n\
+Arguments:\n\
+\n\
+start -- The offset of the first byte to replace.\n\
+end -- The offset after the last byte to replace.\n\
+string -- The string to put in place of the bytes.\n");
+
+static PyObject *
+python_replace_document_range(PyObject *self, PyObject *args)
+{
+	struct cache_entry *cached = get_python_cache_entry();
+	int start, end;
+	unsigned char *str;
+	int len;
+
+	if (!PyArg_ParseTuple(args, "iis#:replace_document_range",
+			      &start, &end, &str, &len))
+		return NULL;
+
+	if (!cached) {
+		PyErr_SetString(python_elinks_err, "No document");
+		return NULL;
+	}
+
+	if (start < 0 || end < start || end > cached->length) {
+		PyErr_SetString(PyExc_IndexError, "range out of bounds");
+		return NULL;
+	}
+
+	if (replace_cache_range(cached, start, end - start, str, len)) {
+		PyErr_SetString(python_elinks_err,
+				"Cannot edit the document");
+		return NULL;
+	}
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
 /* Python interface to get the current document's header. */
 
 static char python_current_header_doc[] =
@@ -121,6 +313,10 @@ static PyMethodDef document_methods[] = {
 				METH_NOARGS,
 				python_current_document_doc},
 
+	{"current_document_buffer", python_current_document_buffer,
+				METH_NOARGS,
+				python_current_document_buffer_doc},
+
 	{"current_header",	python_current_header,
 				METH_NOARGS,
 				python_current_header_doc},
@@ -137,11 +333,17 @@ static PyMethodDef document_methods[] = {
 				METH_NOARGS,
 				python_current_url_doc},
 
+	{"replace_document_range", python_replace_document_range,
+				METH_VARARGS,
+				python_replace_document_range_doc},
+
 	{NULL,			NULL, 0, NULL}
 };
 
 int
 python_init_document_interface(PyObject *dict, PyObject *name)
 {
+	if (PyType_Ready(&cache_view_type) < 0) return -1;
+
 	return add_python_methods(dict, name, document_methods);
 }
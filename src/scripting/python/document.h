@@ -3,6 +3,13 @@
 
 #include <Python.h>
 
+struct cache_entry;
+
+/* The document being rewritten by a pre-format-html hook, if any.  */
+extern struct cache_entry *python_cached;
+
+PyObject *python_get_document_buffer(struct cache_entry *cached);
+
 int python_init_document_interface(PyObject *dict, PyObject *name);
 
 #endif
@@ -15,6 +15,7 @@
 #include "main/event.h"
 #include "protocol/uri.h"
 #include "scripting/python/core.h"
+#include "scripting/python/document.h"
 #include "session/session.h"
 #include "util/memory.h"
 #include "util/string.h"
@@ -75,7 +76,10 @@ script_hook_url(va_list ap, void *data)
 	return EVENT_HOOK_STATUS_NEXT;
 }
 
-/* Call a Python hook for a pre-format-html event. */
+/* Call the Python hooks for a pre-format-html event.
+ * pre_format_html_buffer_hook() gets a buffer over the body, which it
+ * can edit with elinks.replace_document_range(); pre_format_html_hook()
+ * gets a copy of the body and may return a new one. */
 
 static enum evhook_status
 script_hook_pre_format_html(va_list ap, void *data)
@@ -85,36 +89,59 @@ script_hook_pre_format_html(va_list ap, void *data)
 	struct fragment *fragment = get_cache_fragment(cached);
 	unsigned char *url = struri(cached->uri);
 	char *method = "pre_format_html_hook";
+	char *buffer_method = "pre_format_html_buffer_hook";
 	struct session *saved_python_ses = python_ses;
-	PyObject *result;
+	struct cache_entry *saved_python_cached = python_cached;
+	PyObject *result = NULL;
 	int success = 0;
 
 	evhook_use_params(ses && cached);
 
-	if (!python_hooks || !cached->length || !*fragment->data
-	    || !PyObject_HasAttrString(python_hooks, method))
+	if (!python_hooks || !cached->length || !*fragment->data)
 		return EVENT_HOOK_STATUS_NEXT;
 
 	python_ses = ses;
+	python_cached = cached;
 
-	result = PyObject_CallMethod(python_hooks, method, "ss#", url,
-				     fragment->data, fragment->length);
-	if (!result) goto error;
+	if (PyObject_HasAttrString(python_hooks, buffer_method)) {
+		PyObject *buffer = python_get_document_buffer(cached);
 
-	if (result != Py_None) {
-		unsigned char *str;
-		Py_ssize_t len;
+		if (!buffer) goto error;
 
-		if (PyString_AsStringAndSize(result, (char **) &str, &len) != 0)
-			goto error;
+		result = PyObject_CallMethod(python_hooks, buffer_method,
+					     "sO", url, buffer);
+		Py_DECREF(buffer);
+		if (!result) goto error;
+
+		Py_DECREF(result);
+		result = NULL;
+	}
 
-		/* This assumes the Py_ssize_t len is not too large to
-		 * fit in the off_t parameter of normalize_cache_entry().
-		 * add_fragment() itself seems to assume the same thing,
-		 * and there is no standard OFF_MAX macro against which
-		 * ELinks could check the value.  */
-		(void) add_fragment(cached, 0, str, len);
-		normalize_cache_entry(cached, len);
+	/* The buffer hook may have moved or emptied the body. */
+	fragment = get_cache_fragment(cached);
+
+	if (fragment && PyObject_HasAttrString(python_hooks, method)) {
+		result = PyObject_CallMethod(python_hooks, method, "ss#", url,
+					     fragment->data, fragment->length);
+		if (!result) goto error;
+
+		if (result != Py_None) {
+			unsigned char *str;
+			Py_ssize_t len;
+
+			if (PyString_AsStringAndSize(result, (char **) &str,
+						     &len) != 0)
+				goto error;
+
+			/* This assumes the Py_ssize_t len is not too large
+			 * to fit in the off_t parameter of
+			 * normalize_cache_entry().  add_fragment() itself
+			 * seems to assume the same thing, and there is no
+			 * standard OFF_MAX macro against which ELinks could
+			 * check the value.  */
+			(void) add_fragment(cached, 0, str, len);
+			normalize_cache_entry(cached, len);
+		}
 	}
 
 	success = 1;
@@ -125,6 +152,7 @@ error:
 	Py_XDECREF(result);
 
 	python_ses = saved_python_ses;
+	python_cached = saved_python_cached;
 
 	return EVENT_HOOK_STATUS_NEXT;
 }
@@ -4,6 +4,8 @@
 #include "config.h"
 #endif
 
+#include <string.h>
+
 #include "elinks.h"
 
 #include "cache/cache.h"
@@ -13,6 +15,7 @@
 #include "scripting/smjs/core.h"
 #include "scripting/smjs/smjs.h"
 #include "util/error.h"
+#include "util/math.h"
 #include "util/memory.h"
 
 static const JSClass cache_entry_class; /* defined below */
@@ -51,6 +54,12 @@ cache_entry_get_property(JSContext *ctx, JSObject *obj, jsid id, jsval *vp)
 	if (!JS_InstanceOf(ctx, obj, (JSClass *) &cache_entry_class, NULL))
 		return JS_FALSE;
 
+	if (!JSID_IS_INT(id)) {
+		/* Note: If we return JS_FALSE here, the object's methods
+		 * do not work. */
+		return JS_TRUE;
+	}
+
 	cached = JS_GetInstancePrivate(ctx, obj,
 				       (JSClass *) &cache_entry_class, NULL);
 	if (!cached) return JS_FALSE; /* already detached */
@@ -66,9 +75,7 @@ cache_entry_get_property(JSContext *ctx, JSObject *obj, jsid id, jsval *vp)
 
 	undef_to_jsval(ctx, vp);
 
-	if (!JSID_IS_INT(id))
-		ret = JS_FALSE;
-	else switch (JSID_TO_INT(id)) {
+	switch (JSID_TO_INT(id)) {
 	case CACHE_ENTRY_CONTENT: {
 		struct fragment *fragment = get_cache_fragment(cached);
 
@@ -193,6 +200,175 @@ cache_entry_set_property(JSContext *ctx, JSObject *obj, jsid id, JSBool strict,
 	return ret;
 }
 
+/* Returns the cache entry of the cache_entry object the method was
+ * called on, or NULL if it is not one or has been detached. */
+static struct cache_entry *
+get_this_cache_entry(JSContext *ctx, jsval *rval)
+{
+	JSObject *this = JS_THIS_OBJECT(ctx, rval);
+	struct cache_entry *cached;
+
+	if (!JS_InstanceOf(ctx, this, (JSClass *) &cache_entry_class, NULL))
+		return NULL;
+
+	cached = JS_GetInstancePrivate(ctx, this,
+				       (JSClass *) &cache_entry_class, NULL);
+	if (!cached) return NULL; /* already detached */
+
+	assert(cache_entry_is_valid(cached));
+	if_assert_failed return NULL;
+
+	return cached;
+}
+
+/* Clamps the @index argument of slice() and friends to the @length of
+ * the data; negative values count from the end like in String.slice().  */
+static int32
+clamp_cache_entry_index(int32 index, int32 length)
+{
+	if (index < 0) index += length;
+	if (index < 0) return 0;
+	return index > length ? length : index;
+}
+
+/* @cache_entry_funcs{"slice"}
+ *
+ * Returns the content between the @start and @end offsets without
+ * copying the rest, so that hooks can look at big documents piecewise. */
+static JSBool
+cache_entry_slice(JSContext *ctx, uintN argc, jsval *rval)
+{
+	jsval *argv = JS_ARGV(ctx, rval);
+	struct cache_entry *cached = get_this_cache_entry(ctx, rval);
+	struct fragment *fragment;
+	int32 length, start = 0, end;
+	JSString *jsstr;
+
+	if (!cached) return JS_FALSE;
+
+	fragment = get_cache_fragment(cached);
+	length = fragment ? fragment->length : 0;
+	end = length;
+
+	if ((argc >= 1 && !JS_ValueToInt32(ctx, argv[0], &start))
+	    || (argc >= 2 && !JS_ValueToInt32(ctx, argv[1], &end)))
+		return JS_FALSE;
+
+	start = clamp_cache_entry_index(start, length);
+	end = clamp_cache_entry_index(end, length);
+	if (end < start) end = start;
+
+	jsstr = JS_NewStringCopyN(ctx, fragment
+				       ? (const char *) fragment->data + start
+				       : "",
+				  end - start);
+	if (!jsstr) return JS_FALSE;
+
+	JS_SET_RVAL(ctx, rval, STRING_TO_JSVAL(jsstr));
+	return JS_TRUE;
+}
+
+/* @cache_entry_funcs{"indexOf"}
+ *
+ * Searches the content for a string from the @from offset on and
+ * returns its offset or -1, like String.indexOf() but without copying
+ * the content to a JS string first.  */
+static JSBool
+cache_entry_index_of(JSContext *ctx, uintN argc, jsval *rval)
+{
+	jsval *argv = JS_ARGV(ctx, rval);
+	struct cache_entry *cached = get_this_cache_entry(ctx, rval);
+	struct fragment *fragment;
+	int32 length, from = 0, index = -1;
+	JSString *jsstr;
+	unsigned char *needle;
+	size_t needlelen;
+
+	if (!cached || argc < 1) return JS_FALSE;
+
+	jsstr = JS_ValueToString(ctx, argv[0]);
+	if (!jsstr) return JS_FALSE;
+	if (argc >= 2 && !JS_ValueToInt32(ctx, argv[1], &from))
+		return JS_FALSE;
+
+	needle = JS_EncodeString(ctx, jsstr);
+	if (!needle) return JS_FALSE;
+	needlelen = JS_GetStringLength(jsstr);
+
+	fragment = get_cache_fragment(cached);
+	length = fragment ? fragment->length : 0;
+	if (from < 0) from = 0;
+
+	if (!needlelen) {
+		index = from > length ? length : from;
+
+	} else if (fragment && needlelen <= (size_t) length) {
+		unsigned char *pos = fragment->data + int_min(from, length);
+		unsigned char *last = fragment->data + length - needlelen;
+
+		for (; pos <= last; pos++) {
+			pos = memchr(pos, needle[0], last - pos + 1);
+			if (!pos) break;
+
+			if (!memcmp(pos, needle, needlelen)) {
+				index = pos - fragment->data;
+				break;
+			}
+		}
+	}
+
+	JS_free(ctx, needle);
+
+	JS_SET_RVAL(ctx, rval, INT_TO_JSVAL(index));
+	return JS_TRUE;
+}
+
+/* @cache_entry_funcs{"replace"}
+ *
+ * Replaces the content between the @start and @end offsets with a
+ * string in place, see replace_cache_range().  */
+static JSBool
+cache_entry_replace(JSContext *ctx, uintN argc, jsval *rval)
+{
+	jsval *argv = JS_ARGV(ctx, rval);
+	struct cache_entry *cached = get_this_cache_entry(ctx, rval);
+	int32 length, start, end;
+	JSString *jsstr;
+	unsigned char *str;
+	int error;
+
+	if (!cached || argc != 3) return JS_FALSE;
+
+	if (!JS_ValueToInt32(ctx, argv[0], &start)
+	    || !JS_ValueToInt32(ctx, argv[1], &end))
+		return JS_FALSE;
+
+	jsstr = JS_ValueToString(ctx, argv[2]);
+	if (!jsstr) return JS_FALSE;
+
+	str = JS_EncodeString(ctx, jsstr);
+	if (!str) return JS_FALSE;
+
+	length = cached->length;
+	start = clamp_cache_entry_index(start, length);
+	end = clamp_cache_entry_index(end, length);
+	if (end < start) end = start;
+
+	error = replace_cache_range(cached, start, end - start, str,
+				    JS_GetStringLength(jsstr));
+	JS_free(ctx, str);
+
+	JS_SET_RVAL(ctx, rval, BOOLEAN_TO_JSVAL(!error));
+	return JS_TRUE;
+}
+
+static const spidermonkeyFunctionSpec cache_entry_funcs[] = {
+	{ "slice",   cache_entry_slice,    2 },
+	{ "indexOf", cache_entry_index_of, 2 },
+	{ "replace", cache_entry_replace,  3 },
+	{ NULL }
+};
+
 /** Pointed to by cache_entry_class.finalize.  SpiderMonkey
  * automatically finalizes all objects before it frees the JSRuntime,
  * so cache_entry.jsobject won't be left dangling.  */
@@ -249,6 +425,11 @@ smjs_get_cache_entry_object(struct cache_entry *cached)
 	                               (JSPropertySpec *) cache_entry_props))
 		return NULL;
 
+	if (JS_FALSE == spidermonkey_DefineFunctions(smjs_ctx,
+						     cache_entry_object,
+						     cache_entry_funcs))
+		return NULL;
+
 	/* Do this last, so that if any previous step fails, we can
 	 * just forget the object and its finalizer won't attempt to
 	 * access @cached.  */
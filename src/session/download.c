@@ -276,6 +276,8 @@ write_cache_entry_to_file(struct cache_entry *cached, struct file_download *file
 		}
 	}
 
+	uncompress_cache_entry(cached);
+
 	foreach (frag, cached->frag) {
 		off_t remain = file_download->seek - frag->offset;
 		int *h = &file_download->handle;
@@ -1702,6 +1704,18 @@ struct {
 	{ NULL,				1 },
 };
 
+int
+get_known_content_type_plain(unsigned char *ctype)
+{
+	int i;
+
+	for (i = 0; known_types[i].type; i++)
+		if (!c_strcasecmp(ctype, known_types[i].type))
+			return known_types[i].plain;
+
+	return -1;
+}
+
 /*! @relates type_query */
 int
 setup_download_handler(struct session *ses, struct download *loading,
@@ -1713,18 +1727,16 @@ setup_download_handler(struct session *ses, struct download *loading,
 	unsigned char *ctype = get_content_type(cached);
 	int plaintext = 1;
 	int ret = 0;
-	int xwin, i;
+	int xwin;
 
 	if (!ctype || !*ctype)
 		goto plaintext_follow;
 
-	for (i = 0; known_types[i].type; i++) {
-		if (c_strcasecmp(ctype, known_types[i].type))
-			continue;
-
-		plaintext = known_types[i].plain;
+	plaintext = get_known_content_type_plain(ctype);
+	if (plaintext >= 0)
 		goto plaintext_follow;
-	}
+
+	plaintext = 1;
 
 	xwin = ses->tab->term->environment & ENV_XWIN;
 	handler = get_mime_type_handler(ctype, xwin);
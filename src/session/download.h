@@ -214,6 +214,11 @@ void detach_downloads_from_terminal(struct terminal *);
 
 int setup_download_handler(struct session *, struct download *, struct cache_entry *, int);
 
+/** Returns 1 if documents of the content type @a ctype are displayed as
+ * plain text, 0 if they are rendered as HTML and -1 if the type is not
+ * one of those ELinks always displays itself. */
+int get_known_content_type_plain(unsigned char *ctype);
+
 void abort_download(struct file_download *file_download);
 void done_type_query(struct type_query *type_query);
 
@@ -0,0 +1,375 @@
+/** Prefetching of the documents likely to be visited next
+ * @file
+ *
+ * When a document has been loaded, the targets of the links around the
+ * current link and the document named by <link rel="next"> can be loaded
+ * at the lowest priority and rendered into the format cache when the
+ * select loop is idle, so that following the link does not have to wait
+ * for the network and the renderer. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "elinks.h"
+
+#include "cache/cache.h"
+#include "config/options.h"
+#include "document/document.h"
+#include "document/options.h"
+#include "document/renderer.h"
+#include "document/view.h"
+#include "main/object.h"
+#include "main/select.h"
+#include "mime/mime.h"
+#include "network/connection.h"
+#include "network/state.h"
+#include "protocol/protocol.h"
+#include "protocol/uri.h"
+#include "session/download.h"
+#include "session/prefetch.h"
+#include "session/session.h"
+#include "util/conv.h"
+#include "util/error.h"
+#include "util/lists.h"
+#include "util/math.h"
+#include "util/memory.h"
+#include "util/string.h"
+#include "viewer/text/view.h"
+#include "viewer/text/vs.h"
+
+
+struct prefetch {
+	LIST_HEAD(struct prefetch);
+
+	struct session *ses;
+	struct uri *uri;
+	struct download download;
+
+	/* Locked once the download has ended so that it is still around
+	 * when the document gets rendered. */
+	struct cache_entry *cached;
+
+	/* Whether the document is still likely to be visited next. */
+	unsigned int wanted:1;
+};
+
+static INIT_LIST_OF(struct prefetch, prefetches);
+
+static int process_prefetches(void *data);
+
+
+static void
+done_prefetch(struct prefetch *prefetch)
+{
+	if (!is_in_result_state(prefetch->download.state))
+		cancel_download(&prefetch->download, 1);
+
+	if (prefetch->cached) object_unlock(prefetch->cached);
+	done_uri(prefetch->uri);
+	del_from_list(prefetch);
+	mem_free(prefetch);
+}
+
+/* Returns 1 if the document is displayed as plain text, 0 if it is
+ * rendered as HTML and -1 if ELinks would not display it itself. */
+static int
+get_prefetch_plain(struct cache_entry *cached)
+{
+	unsigned char *ctype = get_content_type(cached);
+	int plain;
+
+	if (!ctype || !*ctype) return 1;
+
+	plain = get_known_content_type_plain(ctype);
+	if (plain < 0 && !c_strncasecmp(ctype, "text/", 5))
+		plain = 1;
+
+	return plain;
+}
+
+static inline int
+is_prefetch_too_big(struct cache_entry *cached)
+{
+	off_t size = get_opt_int("document.browse.prefetch.size", NULL);
+
+	return cached->length > size || cached->data_size > size;
+}
+
+/* Returns the number of bytes the prefetches that are being loaded or
+ * wait to be rendered take. A document counts with its expected size
+ * once the server tells it. Until then it counts with the size it may
+ * grow to before it is cancelled, so that starting many prefetches at
+ * once cannot overrun document.browse.prefetch.total_size. */
+static off_t
+get_prefetches_size(void)
+{
+	off_t max_size = get_opt_int("document.browse.prefetch.size", NULL);
+	off_t size = 0;
+	struct prefetch *prefetch;
+
+	foreach (prefetch, prefetches) {
+		struct cache_entry *cached = prefetch->cached;
+
+		if (cached) {
+			size += MAX(cached->length, cached->data_size);
+
+		} else if (!is_in_result_state(prefetch->download.state)) {
+			/* Cancelled downloads do not hold anything. */
+			cached = prefetch->download.cached;
+			size += cached && cached->length
+				? MAX(cached->length, cached->data_size)
+				: max_size;
+		}
+	}
+
+	return size;
+}
+
+static void
+prefetch_callback(struct download *download, struct prefetch *prefetch)
+{
+	struct cache_entry *cached = download->cached;
+
+	if (is_in_result_state(download->state)) {
+		if (cached && !prefetch->cached) {
+			prefetch->cached = cached;
+			object_lock(cached);
+		}
+
+		register_idle_work(process_prefetches, NULL);
+		return;
+	}
+
+	if (!cached) return;
+
+	/* Give up as soon as the document turns out not to be worth it.
+	 * The content type is only checked once the header is there so
+	 * that it is not guessed from the URI prematurely. */
+	if (cached->redirect
+	    || is_prefetch_too_big(cached)
+	    || get_prefetches_size()
+	       > get_opt_int("document.browse.prefetch.total_size", NULL)
+	    || (cached->head && get_prefetch_plain(cached) < 0)) {
+		cancel_download(download, 1);
+		register_idle_work(process_prefetches, NULL);
+	}
+}
+
+/* Render the document into the format cache the same way the session
+ * will render it when the user visits it. */
+static void
+render_prefetch(struct prefetch *prefetch, int plain)
+{
+	struct document_options options;
+	struct document_view doc_view;
+	struct view_state vs;
+
+	/* Gradual rerendering keeps the scripts of the document from
+	 * running until the user actually visits it. */
+	init_session_document_options(prefetch->ses, &options, 2);
+
+	init_vs(&vs, prefetch->cached->uri, plain);
+	options.plain = vs.plain;
+	options.wrap = vs.wrap;
+
+	memset(&doc_view, 0, sizeof(doc_view));
+	render_document(&vs, &doc_view, &options);
+
+	detach_formatted(&doc_view);
+	destroy_vs(&vs, 1);
+}
+
+/* Idle work rendering the prefetched documents that have been loaded. */
+static int
+process_prefetches(void *data)
+{
+	struct prefetch *prefetch, *next;
+	int render = get_opt_bool("document.browse.prefetch.render", NULL)
+		     && get_opt_int("document.cache.format.size", NULL);
+
+	foreachsafe (prefetch, next, prefetches) {
+		struct cache_entry *cached = prefetch->cached;
+		int plain;
+
+		if (!is_in_result_state(prefetch->download.state))
+			continue;
+
+		if (!render
+		    || !is_in_state(prefetch->download.state, S_OK)
+		    || !cached || cached->redirect
+		    || is_prefetch_too_big(cached)) {
+			done_prefetch(prefetch);
+			continue;
+		}
+
+		plain = get_prefetch_plain(cached);
+		if (plain >= 0)
+			render_prefetch(prefetch, plain);
+
+		done_prefetch(prefetch);
+
+		/* Rendering takes a while so let the select loop check
+		 * for events between the documents. */
+		if (idle_work_should_yield())
+			break;
+	}
+
+	foreach (prefetch, prefetches)
+		if (is_in_result_state(prefetch->download.state))
+			return 1;
+
+	return 0;
+}
+
+/* Returns 1 if the document was not already wanted. */
+static int
+start_prefetch(struct session *ses, struct uri *uri, struct uri *referrer)
+{
+	struct prefetch *prefetch;
+
+	foreach (prefetch, prefetches) {
+		if (prefetch->ses != ses
+		    || !compare_uri(prefetch->uri, uri, URI_BASE))
+			continue;
+
+		if (prefetch->wanted) return 0;
+
+		prefetch->wanted = 1;
+		return 1;
+	}
+
+	if (get_prefetches_size()
+	    >= get_opt_int("document.browse.prefetch.total_size", NULL))
+		return 0;
+
+	prefetch = mem_calloc(1, sizeof(*prefetch));
+	if (!prefetch) return 0;
+
+	prefetch->ses = ses;
+	prefetch->uri = get_uri_reference(uri);
+	prefetch->wanted = 1;
+	prefetch->download.callback = (download_callback_T *) prefetch_callback;
+	prefetch->download.data = prefetch;
+	add_to_list(prefetches, prefetch);
+
+	/* This may call prefetch_callback() right away. */
+	load_uri(uri, referrer, &prefetch->download, PRI_PRELOAD,
+		 CACHE_MODE_NORMAL, -1);
+
+	return 1;
+}
+
+/* Returns 1 if the target of the link is prefetched. */
+static int
+prefetch_link(struct session *ses, struct document *document,
+	      struct link *link)
+{
+	struct uri *uri;
+	int started = 0;
+
+	if (link->type != LINK_HYPERTEXT || !link->where)
+		return 0;
+
+	uri = get_uri(link->where, 0);
+	if (!uri) return 0;
+
+	/* Only documents that are safe to fetch without the user asking
+	 * for them and not just another part of this document. */
+	if ((uri->protocol == PROTOCOL_HTTP
+	     || uri->protocol == PROTOCOL_HTTPS
+	     || uri->protocol == PROTOCOL_FILE)
+	    && !uri->post
+	    && !compare_uri(uri, document->uri, URI_BASE))
+		started = start_prefetch(ses, uri, document->uri);
+
+	done_uri(uri);
+
+	return started;
+}
+
+void
+prefetch_documents(struct session *ses)
+{
+	struct document_view *doc_view = ses->doc_view;
+	struct prefetch *prefetch, *next;
+
+	foreach (prefetch, prefetches)
+		if (prefetch->ses == ses)
+			prefetch->wanted = 0;
+
+	if (doc_view && doc_view->document && doc_view->vs
+	    && !document_has_frames(doc_view->document)) {
+		struct document *document = doc_view->document;
+		int count = get_opt_int("document.browse.prefetch.links", ses);
+		int current = int_max(doc_view->vs->current_link, 0);
+		int i;
+
+		if (document->next_uri
+		    && get_opt_bool("document.browse.prefetch.next", ses))
+			start_prefetch(ses, document->next_uri, document->uri);
+
+		/* Walk the links alternately after and before the current
+		 * one. */
+		for (i = 0; count > 0 && i < 2 * document->nlinks; i++) {
+			int n = current + (i % 2 ? (i + 1) / 2 : -(i / 2));
+
+			if (n < 0 || n >= document->nlinks)
+				continue;
+
+			if (prefetch_link(ses, document, &document->links[n]))
+				count--;
+		}
+	}
+
+	foreachsafe (prefetch, next, prefetches)
+		if (prefetch->ses == ses && !prefetch->wanted)
+			done_prefetch(prefetch);
+}
+
+/* The link whose host was resolved or connected to last. It is only
+ * compared, never dereferenced. */
+static struct link *preconnected_link;
+
+void
+preconnect_link(struct session *ses, struct link *link)
+{
+	int preconnect = get_opt_int("document.browse.prefetch.preconnect", ses);
+	struct uri *uri;
+
+	if (!preconnect || link == preconnected_link)
+		return;
+
+	preconnected_link = link;
+
+	if (link->type != LINK_HYPERTEXT || !link->where)
+		return;
+
+	uri = get_uri(link->where, 0);
+	if (!uri) return;
+
+	/* A POST request is not retried if the server has closed the
+	 * connection in the meantime. */
+	preconnect_uri(uri, preconnect > 1 && !uri->post);
+	done_uri(uri);
+}
+
+void
+abort_prefetches(struct session *ses, struct uri *keep)
+{
+	struct prefetch *prefetch, *next;
+
+	foreachsafe (prefetch, next, prefetches) {
+		if (prefetch->ses != ses
+		    || (keep && compare_uri(prefetch->uri, keep, URI_BASE)))
+			continue;
+
+		done_prefetch(prefetch);
+	}
+
+	if (list_empty(prefetches))
+		unregister_idle_work(process_prefetches, NULL);
+}
@@ -0,0 +1,23 @@
+#ifndef EL__SESSION_PREFETCH_H
+#define EL__SESSION_PREFETCH_H
+
+struct link;
+struct session;
+struct uri;
+
+/** Start loading the documents the user of the session is likely to
+ * visit next from the current document, as configured by the
+ * document.browse.prefetch options, and cancel the loading of those no
+ * longer likely to be visited. */
+void prefetch_documents(struct session *ses);
+
+/** Resolve the host of the @a link the user has moved to and connect to
+ * it, as configured by the document.browse.prefetch.preconnect option, so
+ * that following the link does not have to wait for that. */
+void preconnect_link(struct session *ses, struct link *link);
+
+/** Cancel prefetching for the session except of the document @a keep,
+ * which can be NULL. */
+void abort_prefetches(struct session *ses, struct uri *keep);
+
+#endif
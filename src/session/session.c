@@ -27,6 +27,7 @@
 #include "intl/gettext/libintl.h"
 #include "main/event.h"
 #include "main/object.h"
+#include "main/select.h"
 #include "main/timer.h"
 #include "network/connection.h"
 #include "network/state.h"
@@ -39,6 +40,7 @@
 #include "session/download.h"
 #include "session/history.h"
 #include "session/location.h"
+#include "session/prefetch.h"
 #include "session/session.h"
 #include "session/task.h"
 #include "terminal/tab.h"
@@ -587,6 +589,147 @@ session_is_loading(struct session *ses)
 	return 0;
 }
 
+/** A stale document which is displayed while it is being revalidated in
+ * the background. */
+struct revalidation {
+	LIST_HEAD(struct revalidation);
+
+	struct session *ses;
+	struct download download;
+
+	/* Locked until the revalidation is over. The state it was in
+	 * tells whether the server sent a different document. */
+	struct cache_entry *cached;
+	unsigned int cache_id;
+	unsigned char *etag;
+	unsigned char *last_modified;
+};
+
+static INIT_LIST_OF(struct revalidation, revalidations);
+
+static void
+done_revalidation(struct revalidation *revalidation)
+{
+	if (!is_in_result_state(revalidation->download.state))
+		cancel_download(&revalidation->download, 1);
+
+	object_unlock(revalidation->cached);
+	mem_free_if(revalidation->etag);
+	mem_free_if(revalidation->last_modified);
+	del_from_list(revalidation);
+	mem_free(revalidation);
+}
+
+static inline int
+validators_differ(unsigned char *old, unsigned char *new)
+{
+	return (old && new) ? strcmp(old, new) : old != new;
+}
+
+static int
+revalidated_document_changed(struct revalidation *revalidation)
+{
+	struct cache_entry *cached = revalidation->cached;
+
+	if (!is_in_state(revalidation->download.state, S_OK)
+	    || cached->incomplete)
+		return 0;
+
+	return cached->cache_id != revalidation->cache_id
+	       || validators_differ(revalidation->etag, cached->etag)
+	       || validators_differ(revalidation->last_modified,
+				    cached->last_modified);
+}
+
+static int
+is_displaying_cache_entry(struct session *ses, struct cache_entry *cached)
+{
+	struct document_view *doc_view;
+
+	if (ses->doc_view && ses->doc_view->document
+	    && ses->doc_view->document->cached == cached)
+		return 1;
+
+	foreach (doc_view, ses->scrn_frames)
+		if (doc_view->document && doc_view->document->cached == cached)
+			return 1;
+
+	return 0;
+}
+
+/* Idle work swapping in the documents which turned out to have changed. */
+static int
+process_revalidations(void *data)
+{
+	struct revalidation *revalidation, *next;
+
+	foreachsafe (revalidation, next, revalidations) {
+		struct session *ses = revalidation->ses;
+
+		if (!is_in_result_state(revalidation->download.state))
+			continue;
+
+		if (revalidated_document_changed(revalidation)
+		    && is_displaying_cache_entry(ses, revalidation->cached)) {
+			draw_formatted(ses, 1);
+			load_frames(ses, ses->doc_view);
+			process_file_requests(ses);
+		}
+
+		done_revalidation(revalidation);
+	}
+
+	return 0;
+}
+
+static void
+revalidation_callback(struct download *download,
+		      struct revalidation *revalidation)
+{
+	if (is_in_result_state(download->state))
+		register_idle_work(process_revalidations, NULL);
+}
+
+/* Revalidate the stale @cached document displayed by @ses in the background
+ * at the lowest priority. */
+static void
+revalidate_document(struct session *ses, struct cache_entry *cached)
+{
+	struct revalidation *revalidation;
+
+	if (cached->uri->post) return;
+
+	foreach (revalidation, revalidations)
+		if (revalidation->ses == ses && revalidation->cached == cached)
+			return;
+
+	revalidation = mem_calloc(1, sizeof(*revalidation));
+	if (!revalidation) return;
+
+	revalidation->ses = ses;
+	revalidation->cached = cached;
+	revalidation->cache_id = cached->cache_id;
+	revalidation->etag = null_or_stracpy(cached->etag);
+	revalidation->last_modified = null_or_stracpy(cached->last_modified);
+	object_lock(cached);
+	add_to_list(revalidations, revalidation);
+
+	revalidation->download.callback = (download_callback_T *) revalidation_callback;
+	revalidation->download.data = revalidation;
+	load_uri(cached->uri, NULL, &revalidation->download, PRI_PRELOAD,
+		 CACHE_MODE_CHECK_IF_MODIFIED, -1);
+}
+
+static void
+abort_revalidations(struct session *ses)
+{
+	struct revalidation *revalidation, *next;
+
+	foreachsafe (revalidation, next, revalidations)
+		if (revalidation->ses == ses)
+			done_revalidation(revalidation);
+}
+
 void
 doc_loading_callback(struct download *download, struct session *ses)
 {
@@ -614,10 +757,21 @@ doc_loading_callback(struct download *download, struct session *ses)
 
 		start_document_refreshes(ses);
 
+		/* Documents served from the cache although they are stale
+		 * are revalidated now that they are displayed. */
+		if (is_in_state(download->state, S_OK) && !download->conn
+		    && download->cached
+		    && get_opt_int("document.cache.stale_while_revalidate", NULL) >= 0
+		    && cache_entry_is_stale(download->cached))
+			revalidate_document(ses, download->cached);
+
 		if (!is_in_state(download->state, S_OK)) {
 			print_error_dialog(ses, download->state,
 					   ses->doc_view->document->uri,
 					   download->pri);
+		} else if (have_location(ses)
+			   && download == &cur_loc(ses)->download) {
+			prefetch_documents(ses);
 		}
 
 	} else if (is_in_transfering_state(download->state)
@@ -1186,6 +1340,8 @@ destroy_session(struct session *ses)
 #endif
 	destroy_downloads(ses);
 	abort_loading(ses, 0);
+	abort_prefetches(ses, NULL);
+	abort_revalidations(ses);
 	free_files(ses);
 	if (ses->doc_view) {
 		detach_formatted(ses->doc_view);
@@ -31,6 +31,7 @@
 #include "terminal/window.h"
 #include "session/download.h"
 #include "session/location.h"
+#include "session/prefetch.h"
 #include "session/session.h"
 #include "session/task.h"
 #include "viewer/text/view.h"
@@ -193,6 +194,9 @@ ses_goto(struct session *ses, struct uri *uri, unsigned char *target_frame,
 		kill_document_refresh(ses->doc_view->document->refresh);
 	}
 
+	/* Leave the bandwidth to the document the user asked for. */
+	abort_prefetches(ses, uri);
+
 	assertm(!ses->loading_uri, "Buggy URI reference counting");
 
 	/* Reset the redirect counter if this is not a redirect. */
@@ -31,6 +31,8 @@
 #define NNTP_KEEPALIVE_TIMEOUT		600000
 #define MAX_KEEPALIVE_CONNECTIONS	30
 #define KEEPALIVE_CHECK_TIME		((milliseconds_T) 20000)
+#define PRECONNECT_TIMEOUT		10	/* in seconds */
+#define MAX_PRECONNECTIONS		4
 
 #define MAX_REDIRECTS			10
 
@@ -57,7 +59,6 @@
 #define DISPLAY_TIME			20
 
 #define HTML_LEFT_MARGIN		3
-#define HTML_MAX_TABLE_LEVEL		10
 #define HTML_MAX_FRAME_DEPTH		5
 #define HTML_CHAR_WIDTH			7
 #define HTML_CHAR_HEIGHT		12
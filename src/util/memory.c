@@ -135,7 +135,7 @@ void *
 mem_mmap_alloc(size_t size)
 {
 	if (size) {
-		void *p = mmap(NULL, round_size(size), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+		void *p = mmap(NULL, round_size(size), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
 
 		if (p != MAP_FAILED)
 			return p;
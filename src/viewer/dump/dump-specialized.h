@@ -23,6 +23,24 @@
  * - DUMP_CHARSET_UTF8
  */
 
+/* Whether the cell @sc can be copied by write_ascii_run() as part of
+ * a run, that is without any conversion and without switching colors. */
+#ifdef DUMP_COLOR_MODE_16
+#define DUMP_ASCII_CELL(sc) \
+	(is_dump_ascii((sc)->data, 1) && (sc)->c.color[0] == color)
+#elif defined(DUMP_COLOR_MODE_256)
+#define DUMP_ASCII_CELL(sc) \
+	(is_dump_ascii((sc)->data, 1) && (sc)->c.color[0] == foreground \
+	 && (sc)->c.color[1] == background)
+#elif defined(DUMP_COLOR_MODE_TRUE)
+#define DUMP_ASCII_CELL(sc) \
+	(is_dump_ascii((sc)->data, 1) \
+	 && !memcmp(foreground, &(sc)->c.color[0], 3) \
+	 && !memcmp(background, &(sc)->c.color[3], 3))
+#else
+#define DUMP_ASCII_CELL(sc) is_dump_ascii((sc)->data, 1)
+#endif
+
 static int
 DUMP_FUNCTION_SPECIALIZED(struct document *document, struct dump_output *out)
 {
@@ -42,6 +60,7 @@ DUMP_FUNCTION_SPECIALIZED(struct document *document, struct dump_output *out)
 #endif	/* DUMP_COLOR_MODE_TRUE */
 
 	for (y = 0; y < document->height; y++) {
+		struct line *line = get_document_line(document, y);
 #ifdef DUMP_COLOR_MODE_NONE
 		int white = 0;
 #endif
@@ -57,7 +76,7 @@ DUMP_FUNCTION_SPECIALIZED(struct document *document, struct dump_output *out)
 		write_true_color("48", background, out);
 #endif	/* DUMP_COLOR_MODE_TRUE */
 
-		for (x = 0; x < document->data[y].length; x++) {
+		for (x = 0; x < line->length; x++) {
 #ifdef DUMP_CHARSET_UTF8
 			unicode_val_T c;
 			const unsigned char *utf8_buf;
@@ -65,23 +84,23 @@ DUMP_FUNCTION_SPECIALIZED(struct document *document, struct dump_output *out)
 			unsigned char c;
 #endif  /* !DUMP_CHARSET_UTF8 */
 			const unsigned char attr
-				= document->data[y].chars[x].attr;
+				= line->chars[x].attr;
 #ifdef DUMP_COLOR_MODE_16
 			const unsigned char color1
-				= document->data[y].chars[x].c.color[0];
+				= line->chars[x].c.color[0];
 #elif defined(DUMP_COLOR_MODE_256)
 			const unsigned char color1
-				= document->data[y].chars[x].c.color[0];
+				= line->chars[x].c.color[0];
 			const unsigned char color2
-				= document->data[y].chars[x].c.color[1];
+				= line->chars[x].c.color[1];
 #elif defined(DUMP_COLOR_MODE_TRUE)
 			const unsigned char *const new_foreground
-				= &document->data[y].chars[x].c.color[0];
+				= &line->chars[x].c.color[0];
 			const unsigned char *const new_background
-				= &document->data[y].chars[x].c.color[3];
+				= &line->chars[x].c.color[3];
 #endif	/* DUMP_COLOR_MODE_TRUE */
 
-			c = document->data[y].chars[x].data;
+			c = line->chars[x].data;
 
 #ifdef DUMP_CHARSET_UTF8
 			if (c == UCS_NO_CHAR) {
@@ -150,6 +169,32 @@ DUMP_FUNCTION_SPECIALIZED(struct document *document, struct dump_output *out)
 			}
 #endif	/* DUMP_COLOR_MODE_NONE */
 
+			/* Most cells hold plain ASCII in the current colors, so
+			 * copy the whole run of them at once. */
+			if (is_dump_ascii(line->chars[x].data, 0)) {
+				int end = x + 1;
+
+				while (end < line->length
+				       && DUMP_ASCII_CELL(&line->chars[end]))
+					end++;
+
+#ifdef DUMP_COLOR_MODE_NONE
+				/* Spaces at the end of the run are only printed
+				 * if something else follows them. */
+				while (line->chars[end - 1].data == ' ') {
+					end--;
+					white++;
+				}
+#endif
+				if (write_ascii_run(&line->chars[x], end - x, out))
+					return -1;
+				x = end - 1;
+#ifdef DUMP_COLOR_MODE_NONE
+				x += white;
+#endif
+				continue;
+			}
+
 			/* Print normal char. */
 #ifdef DUMP_CHARSET_UTF8
 			utf8_buf = encode_utf8(c);
@@ -180,3 +225,5 @@ DUMP_FUNCTION_SPECIALIZED(struct document *document, struct dump_output *out)
 
 	return 0;
 }
+
+#undef DUMP_ASCII_CELL
@@ -40,6 +40,7 @@
 #include "terminal/color.h"
 #include "terminal/hardio.h"
 #include "terminal/terminal.h"
+#include "util/math.h"
 #include "util/memory.h"
 #include "util/string.h"
 #include "viewer/dump/dump.h"
@@ -221,6 +222,66 @@ write_char(unsigned char c, struct dump_output *out)
 	return 0;
 }
 
+/** Whether @c is printable ASCII which needs no conversion; spaces
+ * are included only if @space is non-zero. */
+#define is_dump_ascii(c, space) \
+	((c) < 0x7F && ((c) > ' ' || ((space) && (c) == ' ')))
+
+/** Copy the characters of @length cells, which must all satisfy
+ * is_dump_ascii(), to the buffer.  This is the common case and avoids
+ * the per character checks of write_char(). */
+static int
+write_ascii_run(const struct screen_char *chars, int length,
+		struct dump_output *out)
+{
+	while (length > 0) {
+		size_t room = D_BUF - out->bufpos;
+		unsigned char *dest = out->buf + out->bufpos;
+		int i, count;
+
+		if (!room) {
+			if (dump_output_flush(out))
+				return -1;
+			continue;
+		}
+
+		count = int_min(length, (int) room);
+		for (i = 0; i < count; i++)
+			dest[i] = chars[i].data;
+
+		out->bufpos += count;
+		chars += count;
+		length -= count;
+	}
+
+	return 0;
+}
+
+/** Copy @length bytes of @data to the buffer. */
+static int
+write_bytes(const unsigned char *data, int length, struct dump_output *out)
+{
+	while (length > 0) {
+		size_t room = D_BUF - out->bufpos;
+		int count;
+
+		if (!room) {
+			if (dump_output_flush(out))
+				return -1;
+			continue;
+		}
+
+		count = int_min(length, (int) room);
+		memcpy(out->buf + out->bufpos, data, count);
+
+		out->bufpos += count;
+		data += count;
+		length -= count;
+	}
+
+	return 0;
+}
+
 static int
 write_color_16(unsigned char color, struct dump_output *out)
 {
@@ -322,43 +383,44 @@ write_true_color(const unsigned char *str, const unsigned char *color,
 
 /*! @return 0 on success, -1 on error */
 static int
-dump_references(struct document *document, int fd, unsigned char buf[D_BUF])
+dump_references(struct document *document, struct dump_output *out)
 {
-	if (document->nlinks
-	    && get_opt_bool("document.dump.references", NULL)) {
+	if (document->nlinks) {
 		int x;
 		unsigned char *header = "\nReferences\n\n   Visible links\n";
-		int headlen = strlen(header);
 
-		if (hard_write(fd, header, headlen) != headlen)
+		if (write_bytes(header, strlen(header), out))
 			return -1;
 
 		for (x = 0; x < document->nlinks; x++) {
 			struct link *link = &document->links[x];
 			unsigned char *where = link->where;
-			size_t reflen;
+			unsigned char number[16];
 
 			if (!where) continue;
 
-			if (document->options.links_numbering) {
-				if (link->title && *link->title)
-					snprintf(buf, D_BUF, "%4d. %s\n\t%s\n",
-						 x + 1, link->title, where);
-				else
-					snprintf(buf, D_BUF, "%4d. %s\n",
-						 x + 1, where);
-			} else {
-				if (link->title && *link->title)
-					snprintf(buf, D_BUF, "   . %s\n\t%s\n",
-						 link->title, where);
-				else
-					snprintf(buf, D_BUF, "   . %s\n", where);
-			}
+			if (document->options.links_numbering)
+				snprintf(number, sizeof(number), "%4d. ", x + 1);
+			else
+				strcpy(number, "   . ");
+
+			if (write_bytes(number, strlen(number), out))
+				return -1;
 
-			reflen = strlen(buf);
-			if (hard_write(fd, buf, reflen) != reflen)
+			if (link->title && *link->title
+			    && (write_bytes(link->title, strlen(link->title), out)
+				|| write_bytes("\n\t", 2, out)))
+				return -1;
+
+			if (write_bytes(where, strlen(where), out)
+			    || write_bytes("\n", 1, out))
 				return -1;
 		}
+
+		/* The references are written after the document has been
+		 * flushed, so flush them too. */
+		if (dump_output_flush(out))
+			return -1;
 	}
 
 	return 0;
@@ -374,46 +436,31 @@ dump_to_file(struct document *document, int fd)
 	if (!out) return -1;
 
 	error = dump_nocolor(document, out);
-	if (!error)
-		error = dump_references(document, fd, out->buf);
+	if (!error && get_opt_bool("document.dump.references", NULL))
+		error = dump_references(document, out);
 
 	mem_free(out);
 	return error;
 }
 
-/* This dumps the given @cached's formatted output onto @fd. */
-static void
-dump_formatted(int fd, struct download *download, struct cache_entry *cached)
+int
+dump_cache_entry(struct cache_entry *cached, struct document_options *options,
+		 int references, int fd, struct string *string)
 {
-	struct document_options o;
 	struct document_view formatted;
 	struct view_state vs;
-	int width;
 	struct dump_output *out;
-
-	if (!cached) return;
+	int error = -1;
 
 	memset(&formatted, 0, sizeof(formatted));
 
-	init_document_options(NULL, &o);
-	width = get_opt_int("document.dump.width", NULL);
-	set_box(&o.box, 0, 1, width, DEFAULT_TERMINAL_HEIGHT);
-
-	o.cp = get_opt_codepage("document.dump.codepage", NULL);
-	o.color_mode = get_opt_int("document.dump.color_mode", NULL);
-	o.plain = 0;
-	o.frames = 0;
-	o.links_numbering = get_opt_bool("document.dump.numbering", NULL);
-
 	init_vs(&vs, cached->uri, -1);
 
-	render_document(&vs, &formatted, &o);
+	render_document(&vs, &formatted, options);
 
-	out = dump_output_alloc(fd, NULL, o.cp);
-	if (out) {
-		int error;
-
-		switch (o.color_mode) {
+	out = dump_output_alloc(fd, string, options->cp);
+	if (out && formatted.document) {
+		switch (options->color_mode) {
 		case COLOR_MODE_DUMP:
 		case COLOR_MODE_MONO: /* FIXME: inversion */
 			error = dump_nocolor(formatted.document, out);
@@ -445,14 +492,39 @@ dump_formatted(int fd, struct download *download, struct cache_entry *cached)
 #endif
 		}
 
-		if (!error)
-			dump_references(formatted.document, fd, out->buf);
-
-		mem_free(out);
-	} /* if out */
+		if (!error && references)
+			error = dump_references(formatted.document, out);
+	}
 
+	mem_free_if(out);
 	detach_formatted(&formatted);
 	destroy_vs(&vs, 1);
+
+	return error;
+}
+
+/* This dumps the given @cached's formatted output onto @fd. */
+static void
+dump_formatted(int fd, struct download *download, struct cache_entry *cached)
+{
+	struct document_options o;
+	int width;
+
+	if (!cached) return;
+
+	init_document_options(NULL, &o);
+	width = get_opt_int("document.dump.width", NULL);
+	set_box(&o.box, 0, 1, width, DEFAULT_TERMINAL_HEIGHT);
+
+	o.cp = get_opt_codepage("document.dump.codepage", NULL);
+	o.color_mode = get_opt_int("document.dump.color_mode", NULL);
+	o.plain = 0;
+	o.frames = 0;
+	o.links_numbering = get_opt_bool("document.dump.numbering", NULL);
+
+	dump_cache_entry(cached, &o,
+			 get_opt_bool("document.dump.references", NULL),
+			 fd, NULL);
 }
 
 #undef D_BUF
@@ -467,6 +539,8 @@ dump_source(int fd, struct download *download, struct cache_entry *cached)
 
 	if (!cached) return 0;
 
+	uncompress_cache_entry(cached);
+
 nextfrag:
 	foreach (frag, cached->frag) {
 		int d = dump_pos - frag->offset;
@@ -4,14 +4,23 @@
 
 #include "util/lists.h"
 
-struct string;
+struct cache_entry;
 struct document;
+struct document_options;
+struct string;
 
 /* Adds the content of the document to the string line by line. */
 struct string *
 add_document_to_string(struct string *string, struct document *document);
 
 int dump_to_file(struct document *, int);
+
+/* Formats @cached with @options and writes the dump, followed by the
+ * link list if @references is set, to @fd or, if @string is non-NULL,
+ * appends it to @string.  Returns 0 on success and -1 on error. */
+int dump_cache_entry(struct cache_entry *cached,
+		     struct document_options *options, int references,
+		     int fd, struct string *string);
 void dump_next(LIST_OF(struct string_list_item) *);
 
 #endif
@@ -0,0 +1,206 @@
+/* Render-to-text library API */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "elinks.h"
+
+#include "cache/cache.h"
+#include "config/options.h"
+#include "document/css/css.h"
+#include "document/document.h"
+#include "document/options.h"
+#include "intl/charsets.h"
+#include "main/event.h"
+#include "main/module.h"
+#include "protocol/uri.h"
+#include "session/download.h"
+#include "terminal/color.h"
+#include "util/color.h"
+#include "util/memory.h"
+#include "util/string.h"
+#include "viewer/dump/dump.h"
+#include "viewer/dump/librender.h"
+
+
+/* The subset of main_modules and builtin_modules that rendering needs.
+ * The options of all the modules are registered nevertheless, because
+ * the renderers look up some of them. */
+static struct module *render_modules[] = {
+	&document_module,
+#ifdef CONFIG_CSS
+	&css_module,
+#endif
+	NULL /* XXX: Keep this */
+};
+
+static int render_initialized;
+
+int
+elinks_render_init(void)
+{
+	if (render_initialized) return 0;
+
+	init_event();
+	init_charsets_lookup();
+	init_colors_lookup();
+
+	init_options();
+	register_modules_options(main_modules);
+	register_modules_options(builtin_modules);
+	init_modules(render_modules);
+
+#ifdef CONFIG_ECMASCRIPT
+	/* There is no session to run the scripts in. */
+	get_opt_bool("ecmascript.enable", NULL) = 0;
+#endif
+
+	render_initialized = 1;
+	return 0;
+}
+
+void
+elinks_render_done(void)
+{
+	if (!render_initialized) return;
+
+	shrink_format_cache(1);
+	garbage_collection(1);
+
+	done_modules(render_modules);
+	free_charsets_lookup();
+	free_colors_lookup();
+	free_conv_table();
+	unregister_modules_options(builtin_modules);
+	unregister_modules_options(main_modules);
+	done_options();
+	done_event();
+
+	render_initialized = 0;
+}
+
+/* Returns the cache entry of @uri holding @data.  The entry is reused
+ * as it is if it already has the same head and data, so that the
+ * document formatted from it last time is found in the format cache.
+ * Otherwise its content is replaced, which gives it a new cache_id. */
+static struct cache_entry *
+get_render_cache_entry(struct uri *uri, unsigned char *head,
+		       const unsigned char *content_type,
+		       const char *data, int length)
+{
+	struct cache_entry *cached = get_cache_entry(uri);
+	struct fragment *fragment;
+
+	if (!cached) return NULL;
+
+	if (!cached->incomplete
+	    && cached->length == length
+	    && cached->head && !strcmp(cached->head, head)) {
+		fragment = get_cache_fragment(cached);
+
+		if (!length
+		    || (fragment && !memcmp(fragment->data, data, length)))
+			return cached;
+	}
+
+	delete_entry_content(cached);
+	mem_free_set(&cached->head, stracpy(head));
+	mem_free_set(&cached->content_type, stracpy(content_type));
+	if (!cached->head || !cached->content_type) return NULL;
+
+	if (length
+	    && add_fragment(cached, 0, (const unsigned char *) data,
+			    length) < 0)
+		return NULL;
+	normalize_cache_entry(cached, length);
+
+	return cached;
+}
+
+char *
+elinks_render_text(const char *data, int length,
+		   const struct elinks_render_options *options,
+		   int *text_length)
+{
+	unsigned char *content_type = "text/html";
+	unsigned char *uristring = "about:blank";
+	struct document_options o;
+	struct cache_entry *cached;
+	struct string head;
+	struct string text;
+	struct uri *uri;
+	int width;
+	int error;
+
+	assert(render_initialized && data && length >= 0 && options);
+	if_assert_failed return NULL;
+
+	if (options->content_type)
+		content_type = (unsigned char *) options->content_type;
+	if (options->uri)
+		uristring = (unsigned char *) options->uri;
+
+	uri = get_uri(uristring, URI_BASE);
+	if (!uri) return NULL;
+
+	if (!init_string(&head)) {
+		done_uri(uri);
+		return NULL;
+	}
+
+	add_to_string(&head, "Content-Type: ");
+	add_to_string(&head, content_type);
+	if (options->charset) {
+		add_to_string(&head, "; charset=");
+		add_to_string(&head, (unsigned char *) options->charset);
+	}
+	add_crlf_to_string(&head);
+
+	cached = get_render_cache_entry(uri, head.source, content_type,
+					data, length);
+	done_string(&head);
+	done_uri(uri);
+	if (!cached) return NULL;
+
+	init_document_options(NULL, &o);
+	width = options->width;
+	if (width <= 0)
+		width = get_opt_int("document.dump.width", NULL);
+	set_box(&o.box, 0, 1, width, DEFAULT_TERMINAL_HEIGHT);
+
+	if (options->output_charset)
+		o.cp = get_cp_index((unsigned char *) options->output_charset);
+	else
+		o.cp = get_opt_codepage("document.dump.codepage", NULL);
+	if (o.cp < 0) return NULL;
+
+	o.color_mode = COLOR_MODE_DUMP;
+	o.plain = get_known_content_type_plain(content_type) != 0;
+	o.frames = 0;
+	o.links_numbering = !!options->numbering;
+
+	if (!init_string(&text)) return NULL;
+
+	error = dump_cache_entry(cached, &o, options->references, -1, &text);
+
+	/* Nothing runs the idle work that would normally do this. */
+	shrink_format_cache(0);
+	garbage_collection(0);
+
+	if (error) {
+		done_string(&text);
+		return NULL;
+	}
+
+	if (text_length) *text_length = text.length;
+	return text.source;
+}
+
+void
+elinks_render_free(char *text)
+{
+	mem_free_if(text);
+}
@@ -0,0 +1,72 @@
+#ifndef EL__VIEWER_DUMP_LIBRENDER_H
+#define EL__VIEWER_DUMP_LIBRENDER_H
+
+/* Render-to-text API of libelinks-render.a
+ *
+ * This is what "elinks -dump" does, minus the process: the buffer is
+ * rendered with the HTML or plain text renderer and encoded the way
+ * the dump viewer does it.  Build the archive with
+ * "make -C src libelinks-render.a" and link it with the libraries
+ * listed in LIBS in Makefile.config.
+ *
+ * Only the document and CSS modules are initialized; there are no
+ * terminals, sessions or connections and no configuration file is
+ * read.  Formatted documents and stylesheets are kept in the usual
+ * caches between calls, so rendering the same buffer again with the
+ * same options is cheap.
+ *
+ * ELinks keeps its state in globals, so the library is thread-confined:
+ * every call, from elinks_render_init() to elinks_render_done(), must
+ * be made from the same thread. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct elinks_render_options {
+	/* MIME type of the buffer.  NULL means "text/html".  Types that
+	 * ELinks would show as plain text use the plain text renderer. */
+	const char *content_type;
+
+	/* Charset of the buffer.  NULL means the <meta> declaration or
+	 * document.codepage.assume. */
+	const char *charset;
+
+	/* Charset of the returned text.  NULL means
+	 * document.dump.codepage. */
+	const char *output_charset;
+
+	/* URI the buffer was loaded from, used to resolve relative links.
+	 * NULL means "about:blank". */
+	const char *uri;
+
+	/* Width of the text in columns.  0 means document.dump.width. */
+	int width;
+
+	/* Whether to append the list of links, and whether to number the
+	 * links in the text and in that list. */
+	int references;
+	int numbering;
+};
+
+/* Sets up the library.  Returns 0 on success and -1 on error. */
+int elinks_render_init(void);
+
+/* Renders @length bytes of @data and returns the text, which must be
+ * released with elinks_render_free().  The length of the text is
+ * stored in *@text_length if that is non-NULL.  Returns NULL on
+ * error. */
+char *elinks_render_text(const char *data, int length,
+			 const struct elinks_render_options *options,
+			 int *text_length);
+
+void elinks_render_free(char *text);
+
+/* Releases the caches and everything elinks_render_init() set up. */
+void elinks_render_done(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -30,6 +30,7 @@
 #include "terminal/draw.h"
 #include "terminal/tab.h"
 #include "terminal/terminal.h"
+#include "util/conv.h"
 #include "util/error.h"
 #include "util/lists.h"
 #include "util/memory.h"
@@ -165,12 +166,58 @@ draw_frame_lines(struct terminal *term, struct frameset_desc *frameset_desc,
 	}
 }
 
+/** Draws the number of each visible link in front of it, overwriting the
+ * document text but keeping its colors. */
+static void
+draw_link_numbers(struct terminal *term, struct document_view *doc_view)
+{
+	struct document *document = doc_view->document;
+	struct box *box = &doc_view->box;
+	int xoffset = box->x - doc_view->vs->x;
+	int yoffset = box->y - doc_view->vs->y;
+	struct link *l1, *l2;
+
+	if (!document->options.links_numbering_overlay)
+		return;
+
+	l1 = get_first_link(doc_view);
+	l2 = get_last_link(doc_view);
+	if (!l1 || !l2) return;
+
+	for (; l1 <= l2; l1++) {
+		unsigned char number[64];
+		unsigned int length = 0;
+		int x, y, i;
+
+		if (!l1->npoints) continue;
+
+		x = l1->points[0].x + xoffset;
+		y = l1->points[0].y + yoffset;
+		if (!is_in_box(box, x, y)) continue;
+
+		number[length++] = '[';
+		ulongcat(number, &length, l1 - document->links + 1,
+			 sizeof(number) - 3, 0);
+		number[length++] = ']';
+
+		if ((int) length > box->width) continue;
+
+		/* Put it in front of the link but keep it inside the view. */
+		x -= (int) length;
+		int_bounds(&x, box->x, box->x + box->width - (int) length);
+
+		for (i = 0; i < length; i++)
+			draw_char_data(term, x + i, y, number[i]);
+	}
+}
+
 static void
 draw_view_status(struct session *ses, struct document_view *doc_view, int active)
 {
 	struct terminal *term = ses->tab->term;
 
 	draw_forms(term, doc_view);
+	draw_link_numbers(term, doc_view);
 	if (active) {
 		draw_searched(term, doc_view);
 		draw_current_link(ses, doc_view);
@@ -289,22 +336,21 @@ draw_doc(struct session *ses, struct document_view *doc_view, int active)
 	for (y = int_max(vy, 0);
 	     y < int_min(doc_view->document->height, box->height + vy);
 	     y++) {
+		struct line *line = get_document_line(doc_view->document, y);
 		struct screen_char *first = NULL;
 		int i, j;
 		int st = int_max(vx, 0);
-		int en = int_min(doc_view->document->data[y].length,
-				 box->width + vx);
+		int en = int_min(line->length, box->width + vx);
 		int max = int_min(en, st + 30);
 
 		if (en - st > 0) {
 			draw_line(term, box->x + st - vx, box->y + y - vy,
-				  en - st,
-				  &doc_view->document->data[y].chars[st]);
-			last = &doc_view->document->data[y].chars[en - 1];
+				  en - st, &line->chars[st]);
+			last = &line->chars[en - 1];
 		}
 		for (i = st; i < max; i++) {
-			if (doc_view->document->data[y].chars[i].data != ' ') {
-				first = &doc_view->document->data[y].chars[i];
+			if (line->chars[i].data != ' ') {
+				first = &line->chars[i];
 				break;
 			}
 		}
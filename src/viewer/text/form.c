@@ -180,6 +180,7 @@ init_form_state(struct document_view *doc_view,
 	viewer_cp = get_terminal_codepage(term);
 
 	mem_free_set(&fs->value, NULL);
+	done_textarea_layout(fs);
 
 	switch (fc->type) {
 		case FC_TEXT:
@@ -286,6 +287,7 @@ find_form_state(struct document_view *doc_view, struct form_control *fc)
 		return fs;
 
 	mem_free_if(fs->value);
+	done_textarea_layout(fs);
 	memset(fs, 0, sizeof(*fs));
 	fs->form_view = find_form_view(doc_view, fc->form);
 	fs->g_ctrl_num = fc->g_ctrl_num;
@@ -357,6 +359,7 @@ done_form_state(struct form_state *fs)
 	ecmascript_detach_form_state(fs);
 #endif
 	mem_free_if(fs->value);
+	done_textarea_layout(fs);
 }
 
 /** Free @a fv and any data owned by it.  This does not call
@@ -1472,6 +1475,7 @@ field_op(struct session *ses, struct document_view *doc_view,
 	enum edit_action action_id;
 	unsigned char *text;
 	int length;
+	int edit_state, edit_length = 0, edited = 0;
 	enum frame_event_status status = FRAME_EVENT_REFRESH;
 #ifdef CONFIG_UTF8
 	const unsigned char *ctext;
@@ -1495,6 +1499,12 @@ field_op(struct session *ses, struct document_view *doc_view,
 	fs = find_form_state(doc_view, fc);
 	if (!fs || !fs->value) return FRAME_EVENT_OK;
 
+	/* Remember where the cursor was so edits can be reported to the
+	 * cached textarea layout. */
+	edit_state = fs->state;
+	if (fc->type == FC_TEXTAREA)
+		edit_length = strlen(fs->value);
+
 	switch (action_id) {
 		case ACT_EDIT_LEFT:
 #ifdef CONFIG_UTF8
@@ -1609,8 +1619,10 @@ field_op(struct session *ses, struct document_view *doc_view,
 			break;
 		case ACT_EDIT_CUT_CLIPBOARD:
 			set_clipboard_text(fs->value);
-			if (!form_field_is_readonly(fc))
+			if (!form_field_is_readonly(fc)) {
 				fs->value[0] = 0;
+				edited = 1;
+			}
 			fs->state = 0;
 #ifdef CONFIG_UTF8
 			if (fc->type == FC_TEXTAREA)
@@ -1630,6 +1642,7 @@ field_op(struct session *ses, struct document_view *doc_view,
 				if (v) {
 					fs->value = v;
 					memmove(v, text, length + 1);
+					done_textarea_layout(fs);
 					fs->state = strlen(fs->value);
 #ifdef CONFIG_UTF8
 					if (utf8 && fc->type == FC_TEXTAREA)
@@ -1693,6 +1706,7 @@ field_op(struct session *ses, struct document_view *doc_view,
 				memmove(text - 1, text, length);
 				fs->state--;
 			}
+			edited = 1;
 			break;
 		case ACT_EDIT_DELETE:
 			if (form_field_is_readonly(fc)) {
@@ -1716,12 +1730,14 @@ field_op(struct session *ses, struct document_view *doc_view,
 					memmove(old, text,
 						(int)(end - text) + 1);
 				}
+				edited = 1;
 				break;
 			}
 #endif /* CONFIG_UTF8 */
 			text = fs->value + fs->state;
 
 			memmove(text, text + 1, length - fs->state);
+			edited = 1;
 			break;
 		case ACT_EDIT_KILL_TO_BOL:
 			if (form_field_is_readonly(fc)) {
@@ -1754,6 +1770,7 @@ field_op(struct session *ses, struct document_view *doc_view,
 					fs->state_cell = 0;
 			}
 #endif /* CONFIG_UTF8 */
+			edited = 1;
 			break;
 		case ACT_EDIT_KILL_TO_EOL:
 			if (form_field_is_readonly(fc)) {
@@ -1766,6 +1783,7 @@ field_op(struct session *ses, struct document_view *doc_view,
 				break;
 			}
 
+			edited = 1;
 			text = strchr(fs->value + fs->state, ASCII_LF);
 			if (!text) {
 				fs->value[fs->state] = '\0';
@@ -1802,6 +1820,7 @@ field_op(struct session *ses, struct document_view *doc_view,
 			memmove(text, fs->value + fs->state, length);
 
 			fs->state = (int) (text - fs->value);
+			edited = 1;
 			break;
 
 		case ACT_EDIT_MOVE_BACKWARD_WORD:
@@ -1880,9 +1899,14 @@ field_op(struct session *ses, struct document_view *doc_view,
 #else
 			fs->value[fs->state++] = get_kbd_key(ev);
 #endif /* CONFIG_UTF8 */
+			edited = 1;
 			break;
 	}
 
+	if (edited && fc->type == FC_TEXTAREA)
+		textarea_value_edited(fs, int_min(edit_state, fs->state),
+				      strlen(fs->value) - edit_length);
+
 	return status;
 }
 
@@ -12,6 +12,7 @@ struct link;
 struct session;
 struct term_event;
 struct terminal;
+struct textarea_layout;
 
 /*! This struct looks a little embarrassing, yeah. */
 struct form_view {
@@ -73,6 +74,9 @@ struct form_state {
 	int vpos;
 	/** Vertical scrolling.  */
 	int vypos;
+	/** Cached line layout of a ::FC_TEXTAREA, or NULL.  It is owned
+	 * by the form_state and maintained by viewer/text/textarea.c.  */
+	struct textarea_layout *layout;
 
 #ifdef CONFIG_ECMASCRIPT
 	/** This holds the ECMAScript object attached to this structure. It can
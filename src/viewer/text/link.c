@@ -22,6 +22,7 @@
 #include "intl/gettext/libintl.h"
 #include "main/object.h"
 #include "protocol/uri.h"
+#include "session/prefetch.h"
 #include "session/session.h"
 #include "session/task.h"
 #include "terminal/color.h"
@@ -242,6 +243,8 @@ draw_current_link(struct session *ses, struct document_view *doc_view)
 	link = get_current_link(doc_view);
 	if (!link) return;
 
+	preconnect_link(ses, link);
+
 	i = !link_is_textinput(link) || ses->insert_mode == INSERT_MODE_OFF;
 	template = init_link_drawing(doc_view, link, i);
 	if (!template) return;
@@ -298,10 +301,13 @@ draw_link(struct terminal *term, struct document_view *doc_view,
 		int y = link->points[i].y;
 
 		if (is_in_box(&doc_view->box, x + xpos, y + ypos)){
+			struct line *line = get_document_line(doc_view->document, y);
 			struct screen_char *ch;
 
+			if (x >= line->length) continue;
+
 			ch = get_char(term, x + xpos, y + ypos);
-			copy_struct(ch, &doc_view->document->data[y].chars[x]);
+			copy_struct(ch, &line->chars[x]);
 			set_screen_dirty(term->screen, y + ypos, y + ypos);
 		}
 	}
@@ -159,19 +159,20 @@ get_srch(struct document *document)
 		int height = int_min(node->box.y + node->box.height, document->height);
 
 		for (y = node->box.y; y < height; y++) {
+			struct line *line = get_document_line(document, y);
 			int width = int_min(node->box.x + node->box.width,
-					    document->data[y].length);
+					    line->length);
 
 			for (x = node->box.x;
-			     x < width && document->data[y].chars[x].data <= ' ';
+			     x < width && line->chars[x].data <= ' ';
 			     x++);
 
 			for (; x < width; x++) {
-				UCHAR c = document->data[y].chars[x].data;
+				UCHAR c = line->chars[x].data;
 				int count = 0;
 				int xx;
 
-				if (document->data[y].chars[x].attr & SCREEN_ATTR_UNSEARCHABLE)
+				if (line->chars[x].attr & SCREEN_ATTR_UNSEARCHABLE)
 					continue;
 
 #ifdef CONFIG_UTF8
@@ -186,7 +187,7 @@ get_srch(struct document *document)
 				}
 
 				for (xx = x + 1; xx < width; xx++) {
-					if (document->data[y].chars[xx].data < ' ')
+					if (line->chars[xx].data < ' ')
 						continue;
 					count = xx - x;
 					break;
@@ -1276,8 +1277,12 @@ fixup_typeahead_match(struct session *ses, struct document_view *doc_view)
 static inline UCHAR
 get_document_char(struct document *document, int x, int y)
 {
-	return (document->height > y && document->data[y].length > x)
-		? document->data[y].chars[x].data : 0;
+	struct line *line;
+
+	if (document->height <= y) return 0;
+
+	line = get_document_line(document, y);
+	return line->length > x ? line->chars[x].data : 0;
 }
 
 static void
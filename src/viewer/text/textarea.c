@@ -51,23 +51,87 @@ struct line_info {
 #define realloc_line_info(info, size) \
 	mem_align_alloc(info, size, (size) + 3, 0xFF)
 
+/** Cached layout of a textarea, kept in form_state.layout.
+ *
+ * Editing operations report where they changed form_state.value through
+ * textarea_value_edited() so that only the lines around the edit need to
+ * be formatted again; the rest of the old table is shifted and reused.
+ * Without such a report the table is only trusted as long as the value
+ * string and its length did not change. */
+struct textarea_layout {
+	struct line_info *line;
+	int lines;		/**< Number of lines without the end marker */
+
+	/* What the table was formatted for */
+	unsigned char *value;
+	int length;
+	int cols;
+	enum form_wrap wrap;
+	int utf8;
+
+	/* Summary of the edits reported since then. The text before
+	 * @dirty_from did not change and the text from @dirty_end on is
+	 * the old text shifted by @delta bytes. @dirty_from is -1 if
+	 * there were no edits. */
+	int dirty_from;
+	int dirty_end;
+	int delta;
+};
+
+/** State for stopping the formatting of an edited text as soon as the
+ * new lines line up with the old layout again. */
+struct textarea_resync {
+	struct line_info *line;	/**< The old layout */
+	int line_number;	/**< The next old line to compare against */
+	int from;		/**< Only resync at or after this position */
+	int delta;		/**< Shift between the old and new text */
+	int resynced;		/**< Set when formatting stopped early */
+};
+
+/** Checks whether a new line starting at @a begin can reuse the old layout
+ * from there on.  Lines only depend on where they start and on the text
+ * which follows, so this is the case when @a begin is past the edited text
+ * and an old line started at the same (shifted) position. */
+static inline int
+textarea_resync_at(struct textarea_resync *resync, int begin)
+{
+	struct line_info *old;
+
+	if (!resync || begin < resync->from) return 0;
+
+	old = &resync->line[resync->line_number];
+	while (old->start != -1 && old->start + resync->delta < begin)
+		old++;
+
+	resync->line_number = old - resync->line;
+	if (old->start == -1 || old->start + resync->delta != begin)
+		return 0;
+
+	resync->resynced = 1;
+	return 1;
+}
+
 #ifdef CONFIG_UTF8
 /** Allocates a line_info table describing the layout of the textarea buffer.
  *
  * @param text		the text to format; must be in UTF-8
+ * @param begin		the offset in @a text of the first line to format;
+ *			it must be at the start of a line
  * @param width		is max width and the offset at which @a text will be
  *			wrapped
  * @param wrap		controls how the wrapping of @a text is performed
  * @param format	is non zero the @a text will be modified to make it
  *			suitable for encoding it for form posting
+ * @param resync	if not NULL, stop after the line where the new layout
+ *			lines up with the old one again
  */
 static struct line_info *
-format_textutf8(unsigned char *text, int width, enum form_wrap wrap, int format)
+format_textutf8(unsigned char *text, int begin, int width,
+		enum form_wrap wrap, int format, struct textarea_resync *resync)
 {
 	struct line_info *line = NULL;
 	int line_number = 0;
-	int begin = 0;
-	int pos = 0;
+	int pos = begin;
 	unsigned char *text_end;
 	int skip;
 	unsigned char *wrappos=NULL;
@@ -121,6 +185,14 @@ format_textutf8(unsigned char *text, int width, enum form_wrap wrap, int format)
 
 		chars_cells = 0;
 		wrappos = NULL;
+
+		if (textarea_resync_at(resync, begin)) {
+			/* The end marker keeps split_prev for the next
+			 * line which is taken from the old layout. */
+			line[line_number].start = line[line_number].end = -1;
+			line[0].split_prev = 0;
+			return line;
+		}
 	}
 
 	line[line_number].split_next = 0;
@@ -142,19 +214,23 @@ format_textutf8(unsigned char *text, int width, enum form_wrap wrap, int format)
 /** Allocates a line_info table describing the layout of the textarea buffer.
  *
  * @param text		the text to format; must be in a unibyte charset
+ * @param begin		the offset in @a text of the first line to format;
+ *			it must be at the start of a line
  * @param width		is max width and the offset at which @a text will be
  *			wrapped
  * @param wrap		controls how the wrapping of @a text is performed
  * @param format	is non zero the @a text will be modified to make it
  *			suitable for encoding it for form posting
+ * @param resync	if not NULL, stop after the line where the new layout
+ *			lines up with the old one again
  */
 static struct line_info *
-format_text(unsigned char *text, int width, enum form_wrap wrap, int format)
+format_text(unsigned char *text, int begin, int width, enum form_wrap wrap,
+	    int format, struct textarea_resync *resync)
 {
 	struct line_info *line = NULL;
 	int line_number = 0;
-	int begin = 0;
-	int pos = 0;
+	int pos = begin;
 	int skip;
 
 	assert(text);
@@ -195,6 +271,11 @@ format_text(unsigned char *text, int width, enum form_wrap wrap, int format)
 		line[line_number].start = begin;
 		line[line_number++].end = pos;
 		begin = pos += skip;
+
+		if (textarea_resync_at(resync, begin)) {
+			line[line_number].start = line[line_number].end = -1;
+			return line;
+		}
 	}
 
 	/* Flush the last text before the loop ended */
@@ -229,6 +310,203 @@ get_textarea_line_number(struct line_info *line, int cursor_position)
 	return -1;
 }
 
+/** Like get_textarea_line_number() but uses binary search on the @a lines
+ * entries of a cached layout. */
+static int
+get_textarea_layout_line_number(struct textarea_layout *layout,
+				int cursor_position)
+{
+	struct line_info *line = layout->line;
+	int low = 0, high = layout->lines - 1;
+	int idx, wrap;
+
+	/* Find the last line starting before the cursor. */
+	while (low < high) {
+		int mid = (low + high + 1) / 2;
+
+		if (line[mid].start <= cursor_position)
+			low = mid;
+		else
+			high = mid - 1;
+	}
+
+	idx = low;
+	if (idx < 0 || cursor_position < line[idx].start)
+		return get_textarea_line_number(line, cursor_position);
+
+	wrap = (line[idx + 1].start == line[idx].end);
+	if (cursor_position >= line[idx].end + !wrap)
+		return get_textarea_line_number(line, cursor_position);
+
+	return idx;
+}
+
+/** Frees the cached layout of the textarea of @a fs. */
+void
+done_textarea_layout(struct form_state *fs)
+{
+	if (!fs->layout) return;
+
+	mem_free_if(fs->layout->line);
+	mem_free(fs->layout);
+	fs->layout = NULL;
+}
+
+/** Tells the cached layout of @a fs that form_state.value changed at byte
+ * @a pos by inserting (@a delta > 0) or deleting (@a delta < 0) bytes
+ * there.  Everything before @a pos must be unchanged. */
+void
+textarea_value_edited(struct form_state *fs, int pos, int delta)
+{
+	struct textarea_layout *layout = fs->layout;
+
+	if (!layout || !layout->line) return;
+
+	if (layout->dirty_from < 0) {
+		layout->dirty_from = pos;
+		layout->dirty_end = pos;
+		layout->delta = 0;
+	}
+
+	int_upper_bound(&layout->dirty_from, pos);
+	layout->dirty_end = int_max(layout->dirty_end, pos) + int_max(delta, 0);
+	layout->delta += delta;
+}
+
+static struct line_info *
+format_textarea_text(unsigned char *text, int begin, struct textarea_layout *layout,
+		     struct textarea_resync *resync)
+{
+#ifdef CONFIG_UTF8
+	if (layout->utf8)
+		return format_textutf8(text, begin, layout->cols, layout->wrap,
+				       0, resync);
+#endif /* CONFIG_UTF8 */
+	return format_text(text, begin, layout->cols, layout->wrap, 0, resync);
+}
+
+static int
+count_textarea_lines(struct line_info *line)
+{
+	int lines = 0;
+
+	while (line[lines].start != -1) lines++;
+
+	return lines;
+}
+
+/** Formats again only the lines touched by the edits reported since the
+ * layout was made, starting from the hard line break before the first edit
+ * and stopping as soon as the new lines line up with the old ones.
+ * Returns 0 if the layout has to be redone from scratch. */
+static int
+update_textarea_layout(struct textarea_layout *layout, unsigned char *text)
+{
+	struct textarea_resync resync;
+	struct line_info *changed, *line;
+	unsigned char *newline;
+	int begin, first, count, tail, idx;
+
+	if (layout->dirty_from > layout->length + layout->delta)
+		return 0;
+
+	/* A line never looks past a hard line break so the old lines before
+	 * the one containing the edit are still good. */
+	newline = memrchr(text, '\n', layout->dirty_from);
+	begin = newline ? newline - text + 1 : 0;
+
+	first = get_textarea_layout_line_number(layout, begin);
+	if (first < 0 || layout->line[first].start != begin)
+		return 0;
+
+	resync.line = layout->line;
+	resync.line_number = first;
+	resync.from = layout->dirty_end;
+	resync.delta = layout->delta;
+	resync.resynced = 0;
+
+	changed = format_textarea_text(text, begin, layout, &resync);
+	if (!changed) return 0;
+
+	count = count_textarea_lines(changed);
+	tail = resync.resynced ? layout->lines - resync.line_number : 0;
+
+	line = mem_alloc((first + count + tail + 1) * sizeof(*line));
+	if (!line) {
+		mem_free(changed);
+		return 0;
+	}
+
+	memcpy(line, layout->line, first * sizeof(*line));
+	memcpy(line + first, changed, (count + 1) * sizeof(*line));
+
+	if (tail) {
+		idx = first + count;
+		memcpy(line + idx, layout->line + resync.line_number,
+		       (tail + 1) * sizeof(*line));
+#ifdef CONFIG_UTF8
+		line[idx].split_prev = changed[count].split_prev;
+#endif
+		for (; idx < first + count + tail; idx++) {
+			line[idx].start += resync.delta;
+			line[idx].end += resync.delta;
+		}
+	}
+
+	mem_free(changed);
+	mem_free(layout->line);
+	layout->line = line;
+	layout->lines = first + count + tail;
+
+	return 1;
+}
+
+/** Returns the layout of the textarea, formatting only what is needed.
+ * The table belongs to @a fs and must not be freed by the caller. */
+static struct line_info *
+get_textarea_layout(struct form_state *fs, struct form_control *fc, int utf8)
+{
+	struct textarea_layout *layout = fs->layout;
+	int length = strlen(fs->value);
+
+	if (!layout) {
+		layout = mem_calloc(1, sizeof(*layout));
+		if (!layout) return NULL;
+		layout->dirty_from = -1;
+		fs->layout = layout;
+	}
+
+	if (layout->line
+	    && layout->cols == fc->cols
+	    && layout->wrap == fc->wrap
+	    && layout->utf8 == utf8) {
+		if (layout->dirty_from < 0) {
+			if (layout->value == fs->value
+			    && layout->length == length)
+				return layout->line;
+
+		} else if (layout->length + layout->delta == length
+			   && update_textarea_layout(layout, fs->value)) {
+			goto done;
+		}
+	}
+
+	mem_free_if(layout->line);
+	layout->cols = fc->cols;
+	layout->wrap = fc->wrap;
+	layout->utf8 = utf8;
+	layout->line = format_textarea_text(fs->value, 0, layout, NULL);
+	if (!layout->line) return NULL;
+	layout->lines = count_textarea_lines(layout->line);
+
+done:
+	layout->value = fs->value;
+	layout->length = length;
+	layout->dirty_from = -1;
+
+	return layout->line;
+}
+
 /** Fixes up the form_state.vpos and form_state.vypos members.
  * @returns the logical position in the textarea view. */
 #ifdef CONFIG_UTF8
@@ -241,22 +519,15 @@ area_cursor(struct form_control *fc, struct form_state *fs, int utf8)
 	assert(fc && fs);
 	if_assert_failed return 0;
 
-	if (utf8)
-		line = format_textutf8(fs->value, fc->cols, fc->wrap, 0);
-	else
-		line = format_text(fs->value, fc->cols, fc->wrap, 0);
-
+	line = get_textarea_layout(fs, fc, utf8);
 	if (!line) return 0;
 
 	if (fs->state_cell)
-		y = get_textarea_line_number(line, fs->state_cell);
+		y = get_textarea_layout_line_number(fs->layout, fs->state_cell);
 	else
-		y = get_textarea_line_number(line, fs->state);
+		y = get_textarea_layout_line_number(fs->layout, fs->state);
 
-	if (y == -1) {
-		mem_free(line);
-		return 0;
-	}
+	if (y == -1) return 0;
 
 	if (utf8) {
 		if (fs->state_cell) {
@@ -271,8 +542,6 @@ area_cursor(struct form_control *fc, struct form_state *fs, int utf8)
 		if (fc->wrap && x == fc->cols) x--;
 	}
 
-	mem_free(line);
-
 	int_bounds(&fs->vpos, x - fc->cols + 1, x);
 	int_bounds(&fs->vypos, y - fc->rows + 1, y);
 
@@ -293,19 +562,14 @@ area_cursor(struct form_control *fc, struct form_state *fs)
 	assert(fc && fs);
 	if_assert_failed return 0;
 
-	line = format_text(fs->value, fc->cols, fc->wrap, 0);
+	line = get_textarea_layout(fs, fc, 0);
 	if (!line) return 0;
 
-	y = get_textarea_line_number(line, fs->state);
-	if (y == -1) {
-		mem_free(line);
-		return 0;
-	}
+	y = get_textarea_layout_line_number(fs->layout, fs->state);
+	if (y == -1) return 0;
 
 	x = fs->state - line[y].start;
 
-	mem_free(line);
-
 	if (fc->wrap && x == fc->cols) x--;
 
 	int_bounds(&fs->vpos, x - fc->cols + 1, x);
@@ -323,11 +587,11 @@ static void
 draw_textarea_utf8(struct terminal *term, struct form_state *fs,
 	      struct document_view *doc_view, struct link *link)
 {
-	struct line_info *line, *linex;
+	struct line_info *line;
 	struct form_control *fc;
 	struct box *box;
 	int vx, vy;
-	int sl, ye;
+	int ye;
 	int x, xbase, y;
 
 	assert(term && doc_view && doc_view->document && doc_view->vs && link);
@@ -342,11 +606,9 @@ draw_textarea_utf8(struct terminal *term, struct form_state *fs,
 
 	if (!link->npoints) return;
 	area_cursor(fc, fs, 1);
-	linex = format_textutf8(fs->value, fc->cols, fc->wrap, 0);
-	if (!linex) return;
-	line = linex;
-	sl = fs->vypos;
-	while (line->start != -1 && sl) sl--, line++;
+	line = get_textarea_layout(fs, fc, 1);
+	if (!line) return;
+	line += int_min(fs->vypos, fs->layout->lines);
 
 	xbase = link->points[0].x + box->x - vx;
 	y = link->points[0].y + box->y - vy;
@@ -396,8 +658,6 @@ draw_textarea_utf8(struct terminal *term, struct form_state *fs,
 				draw_char_data(term, x, y, '_');
 		}
 	}
-
-	mem_free(linex);
 }
 #endif /* CONFIG_UTF8 */
 
@@ -405,11 +665,11 @@ void
 draw_textarea(struct terminal *term, struct form_state *fs,
 	      struct document_view *doc_view, struct link *link)
 {
-	struct line_info *line, *linex;
+	struct line_info *line;
 	struct form_control *fc;
 	struct box *box;
 	int vx, vy;
-	int sl, ye;
+	int ye;
 	int x, y;
 
 	assert(term && doc_view && doc_view->document && doc_view->vs && link);
@@ -435,11 +695,9 @@ draw_textarea(struct terminal *term, struct form_state *fs,
 #else
 	area_cursor(fc, fs);
 #endif /* CONFIG_UTF8 */
-	linex = format_text(fs->value, fc->cols, fc->wrap, 0);
-	if (!linex) return;
-	line = linex;
-	sl = fs->vypos;
-	while (line->start != -1 && sl) sl--, line++;
+	line = get_textarea_layout(fs, fc, 0);
+	if (!line) return;
+	line += int_min(fs->vypos, fs->layout->lines);
 
 	x = link->points[0].x + box->x - vx;
 	y = link->points[0].y + box->y - vy;
@@ -479,8 +737,6 @@ draw_textarea(struct terminal *term, struct form_state *fs,
 				draw_char_data(term, xi, y, '_');
 		}
 	}
-
-	mem_free(linex);
 }
 
 
@@ -498,7 +754,7 @@ encode_textarea(struct submitted_value *sv)
 	/* We need to reformat text now if it has to be wrapped hard, just
 	 * before encoding it. */
 	/* TODO: Do we need here UTF-8 format or not? --scrool */
-	blabla = format_text(sv->value, fc->cols, fc->wrap, 1);
+	blabla = format_text(sv->value, 0, fc->cols, fc->wrap, 1, NULL);
 	mem_free_if(blabla);
 
 	return encode_crlf(sv);
@@ -699,6 +955,7 @@ textarea_edit(int op, struct terminal *term_, struct form_state *fs_,
 		}
 
 		mem_free(td->fs->value);
+		done_textarea_layout(td->fs);
 		td->fs->value = file.source;
 		td->fs->state = file.length;
 
@@ -752,21 +1009,15 @@ textarea_op(struct form_state *fs, struct form_control *fc, int utf8,
 	assert(fs && fs->value && fc);
 	if_assert_failed return FRAME_EVENT_OK;
 
-	if (utf8)
-		line = format_textutf8(fs->value, fc->cols, fc->wrap, 0);
-	else
-		line = format_text(fs->value, fc->cols, fc->wrap, 0);
+	line = get_textarea_layout(fs, fc, utf8);
 	if (!line) return FRAME_EVENT_OK;
 
-	current = get_textarea_line_number(line, fs->state);
+	current = get_textarea_layout_line_number(fs->layout, fs->state);
 	state = fs->state;
 	state_cell = fs->state_cell;
-	if (do_op(fs, line, current, utf8)) {
-		mem_free(line);
+	if (do_op(fs, line, current, utf8))
 		return FRAME_EVENT_IGNORED;
-	}
 
-	mem_free(line);
 	return (fs->state == state && fs->state_cell == state_cell)
 		? FRAME_EVENT_OK : FRAME_EVENT_REFRESH;
 }
@@ -783,17 +1034,13 @@ textarea_op(struct form_state *fs, struct form_control *fc,
 	assert(fs && fs->value && fc);
 	if_assert_failed return FRAME_EVENT_OK;
 
-	line = format_text(fs->value, fc->cols, fc->wrap, 0);
+	line = get_textarea_layout(fs, fc, 0);
 	if (!line) return FRAME_EVENT_OK;
 
-	current = get_textarea_line_number(line, fs->state);
+	current = get_textarea_layout_line_number(fs->layout, fs->state);
 	state = fs->state;
-	if (do_op(fs, line, current)) {
-		mem_free(line);
+	if (do_op(fs, line, current))
 		return FRAME_EVENT_IGNORED;
-	}
-
-	mem_free(line);
 
 	return fs->state == state ? FRAME_EVENT_OK : FRAME_EVENT_REFRESH;
 }
@@ -1133,6 +1380,7 @@ textarea_op_enter(struct form_state *fs, struct form_control *fc)
 	    || !insert_in_string(&fs->value, fs->state, "\n", 1))
 		return FRAME_EVENT_OK;
 
+	textarea_value_edited(fs, fs->state, 1);
 	fs->state++;
 	return FRAME_EVENT_REFRESH;
 }
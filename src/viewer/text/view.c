@@ -1042,7 +1042,8 @@ try_prefix_key(struct session *ses, struct document_view *doc_view,
 	    || ses->kbdprefix.repeat_count /* The user has already begun
 	                                    * entering a prefix. */
 	    || !doc_opts->num_links_key
-	    || (doc_opts->num_links_key == 1 && !doc_opts->links_numbering)) {
+	    || (doc_opts->num_links_key == 1 && !doc_opts->links_numbering
+		&& !doc_opts->links_numbering_overlay)) {
 	        int old_count = ses->kbdprefix.repeat_count;
 		int new_count = old_count * 10 + digit;
 
@@ -1316,11 +1317,6 @@ do_mouse_event(struct session *ses, struct term_event *ev,
 		assert(doc_view && doc_view->document);
 		if_assert_failed return 0;
 
-		assertm(doc_view->document->options.box.x == doc_view->box.x
-		        && doc_view->document->options.box.y == doc_view->box.y,
-			"Jonas' 1.565 -> 1.566 patch sucks");
-		if_assert_failed return 0;
-
 		if (check_mouse_position(ev, &doc_view->box)) {
 			matched = doc_view;
 			break;
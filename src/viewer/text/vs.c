@@ -133,6 +133,7 @@ copy_vs(struct view_state *dst, struct view_state *src)
 #ifdef CONFIG_ECMASCRIPT
 				dstfs->ecmascript_obj = NULL;
 #endif
+				dstfs->layout = NULL;
 				if (srcfs->value)
 					dstfs->value = stracpy(srcfs->value);
 				/* XXX: This makes it O(nm). */
@@ -0,0 +1,87 @@
+#!/bin/sh
+#
+# Time laying out a frameset of sixteen frames again after the terminal is
+# resized.  A frameset of four times four table pages is generated, shown
+# in an ELinks running inside tmux and the terminal is then made shorter
+# and taller again a number of times.  The CPU time ELinks spends on that
+# is printed.  Frames which keep their width should be taken from the
+# format cache instead of being rendered again, so it should be close to
+# nothing.
+#
+# Set ELINKS to change the binary to execute ELinks, ROWS to change the
+# number of table rows in each frame and RESIZES to change how many times
+# the terminal is resized.  All arguments to this script are passed to
+# ELinks.  Needs tmux and /proc.
+
+elinks=${ELINKS:-elinks}
+rows=${ROWS:-400}
+resizes=${RESIZES:-10}
+args="$@"
+socket="elinks-frameset-bench-$$"
+
+die()
+{
+	echo "$@" >&2
+	exit 1
+}
+
+cpu_ticks()
+{
+	# utime and stime are the 14th and 15th field.
+	sed 's/.*) //' "/proc/$1/stat" | awk '{ print $12 + $13 }'
+}
+
+command -v tmux >/dev/null || die "tmux is needed to run this test"
+
+dir=$(mktemp -d) || die "Cannot create a temporary directory"
+trap 'tmux -L "$socket" kill-server 2>/dev/null; rm -rf "$dir"' 0
+
+frames=""
+frame=0
+while [ $frame -lt 16 ]; do
+	{
+		echo "<html><body><h1>Frame $frame</h1><table border=1>"
+		row=0
+		while [ $row -lt $rows ]; do
+			echo "<tr><td>$frame.$row</td><td>some text</td>"
+			echo "<td><b>more</b> text</td><td colspan=2>$row</td></tr>"
+			row=$(expr $row + 1)
+		done
+		echo "</table></body></html>"
+	} > "$dir/frame$frame.html"
+
+	if [ $(expr $frame % 4) = 0 ]; then
+		frames="$frames<frameset cols=\"25%,25%,25%,25%\">"
+	fi
+	frames="$frames<frame name=\"frame$frame\" src=\"frame$frame.html\">"
+	if [ $(expr $frame % 4) = 3 ]; then
+		frames="$frames</frameset>"
+	fi
+	frame=$(expr $frame + 1)
+done
+
+echo "<html><frameset rows=\"25%,25%,25%,25%\">$frames</frameset></html>" \
+	> "$dir/frameset.html"
+
+tmux -L "$socket" new-session -d -x 160 -y 60 \
+	"exec $elinks -no-home -no-connect $args file://$dir/frameset.html" \
+	|| die "Cannot start ELinks in tmux"
+sleep 3
+
+pid=$(tmux -L "$socket" list-panes -F '#{pane_pid}')
+[ -r "/proc/$pid/stat" ] || die "ELinks is not running"
+
+start=$(cpu_ticks $pid)
+resize=0
+while [ $resize -lt $resizes ]; do
+	tmux -L "$socket" resize-window -y 50
+	sleep 1
+	tmux -L "$socket" resize-window -y 60
+	sleep 1
+	resize=$(expr $resize + 1)
+done
+end=$(cpu_ticks $pid)
+
+hz=$(getconf CLK_TCK)
+echo "$resizes resizes of $rows rows per frame:" \
+     "$(expr \( $end - $start \) \* 1000 / $hz) ms of CPU time"